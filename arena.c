@@ -0,0 +1,134 @@
+#include "arena.h"
+
+#define ARENA_ALIGNMENT 16
+#define ARENA_SMALL_LIMIT 512 // up to it sizes are rounded to the alignment
+#define ARENA_SMALL_CLASSES (ARENA_SMALL_LIMIT / ARENA_ALIGNMENT)
+#define ARENA_FIRST_LARGE_SHIFT 10 // larger sizes are rounded to a power of 2
+#define ARENA_HEADER_SIZE ((sizeof (ArenaBlock) + ARENA_ALIGNMENT - 1) \
+                           & ~(size_t) (ARENA_ALIGNMENT - 1))
+
+/**
+ * round size up to its size class.
+ * @param size
+ * @param size_class out parameter, the index of the free list of the class
+ * @return the rounded size
+ */
+static size_t round_size (size_t size, int *size_class)
+{
+  if (size == 0)
+  {
+    size = 1;
+  }
+  if (size <= ARENA_SMALL_LIMIT)
+  {
+    size_t rounded = (size + ARENA_ALIGNMENT - 1)
+                     & ~(size_t) (ARENA_ALIGNMENT - 1);
+    *size_class = (int) (rounded / ARENA_ALIGNMENT) - 1;
+    return rounded;
+  }
+  int shift = ARENA_FIRST_LARGE_SHIFT;
+  while (((size_t) 1 << shift) < size)
+  {
+    shift++;
+  }
+  *size_class = ARENA_SMALL_CLASSES + shift - ARENA_FIRST_LARGE_SHIFT;
+  return (size_t) 1 << shift;
+}
+/**
+ * allocate a new block and link it to the blocks list of the arena.
+ * @param arena
+ * @param size number of usable bytes in the block
+ * @return the new block, NULL if allocation failed.
+ */
+static ArenaBlock *new_block (Arena *arena, size_t size)
+{
+  ArenaBlock *block = malloc (ARENA_HEADER_SIZE + size);
+  if (block == NULL)
+  {
+    return NULL;
+  }
+  block->next = arena->blocks;
+  block->size = size;
+  block->used = 0;
+  arena->blocks = block;
+  return block;
+}
+Arena *arena_create (size_t block_size)
+{
+  Arena *arena = malloc (sizeof (Arena));
+  if (arena == NULL)
+  {
+    return NULL;
+  }
+  arena->current = NULL;
+  arena->blocks = NULL;
+  arena->block_size = block_size;
+  for (int i = 0; i < ARENA_SIZE_CLASSES; i++)
+  {
+    arena->free_lists[i] = NULL;
+  }
+  return arena;
+}
+void *arena_alloc (Arena *arena, size_t size)
+{
+  int size_class;
+  size = round_size (size, &size_class);
+  // reuse a released allocation of the same class if there is one
+  void *recycled = arena->free_lists[size_class];
+  if (recycled != NULL)
+  {
+    arena->free_lists[size_class] = *(void **) recycled;
+    return recycled;
+  }
+  if (size > arena->block_size / 4)
+  {
+    // big allocations get a block of their own so they don't waste the
+    // rest of the current block
+    ArenaBlock *block = new_block (arena, size);
+    if (block == NULL)
+    {
+      return NULL;
+    }
+    block->used = size;
+    return (char *) block + ARENA_HEADER_SIZE;
+  }
+  if (arena->current == NULL
+      || arena->current->size - arena->current->used < size)
+  {
+    arena->current = new_block (arena, arena->block_size);
+    if (arena->current == NULL)
+    {
+      return NULL;
+    }
+  }
+  void *memory = (char *) arena->current + ARENA_HEADER_SIZE
+                 + arena->current->used;
+  arena->current->used += size;
+  return memory;
+}
+void arena_release (Arena *arena, void *ptr, size_t size)
+{
+  if (ptr == NULL)
+  {
+    return;
+  }
+  int size_class;
+  round_size (size, &size_class);
+  *(void **) ptr = arena->free_lists[size_class];
+  arena->free_lists[size_class] = ptr;
+}
+void arena_free (Arena *arena)
+{
+  if (arena == NULL)
+  {
+    return;
+  }
+  ArenaBlock *block = arena->blocks;
+  while (block != NULL)
+  {
+    ArenaBlock *next = block->next;
+    free (block);
+    block = next;
+  }
+  free (arena);
+}
@@ -0,0 +1,65 @@
+#ifndef _ARENA_H_
+#define _ARENA_H_
+#include <stdlib.h> // For malloc(), size_t
+
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+#define ARENA_SIZE_CLASSES 96
+
+/**
+ * a block of memory the arena hands out allocations from. the allocations
+ * start right after the header.
+ */
+typedef struct ArenaBlock
+{
+    struct ArenaBlock *next;
+    size_t size;// the number of usable bytes in the block
+    size_t used;// the number of bytes already handed out
+} ArenaBlock;
+
+/**
+ * a region allocator: allocations are bumped out of big blocks and are all
+ * freed together by arena_free. released allocations are kept in free
+ * lists by size class and reused by later allocations of the same class.
+ */
+typedef struct Arena
+{
+    ArenaBlock *current;// the block small allocations are bumped from
+    ArenaBlock *blocks;// all the blocks of the arena
+    size_t block_size;
+    void *free_lists[ARENA_SIZE_CLASSES];
+} Arena;
+
+/**
+ * Create a new empty arena.
+ * @param block_size the size of the blocks the arena allocates, allocations
+ * bigger than a quarter of it get a block of their own.
+ * @return a pointer to the new arena, NULL if allocation failed.
+ * @attention the arena must be freed with arena_free.
+ */
+Arena *arena_create (size_t block_size);
+
+/**
+ * Allocate memory from the arena. the memory is aligned for any type and
+ * stays valid until the arena is freed or the memory is released.
+ * @param arena
+ * @param size number of bytes to allocate
+ * @return pointer to the memory, NULL if allocation failed.
+ */
+void *arena_alloc (Arena *arena, size_t size);
+
+/**
+ * Return memory to the arena so later allocations of the same size class
+ * can reuse it. does nothing if ptr is NULL.
+ * @param arena
+ * @param ptr memory returned by arena_alloc of this arena
+ * @param size the size ptr was allocated with
+ */
+void arena_release (Arena *arena, void *ptr, size_t size);
+
+/**
+ * Free the arena and all the memory allocated from it at once.
+ * @param arena
+ */
+void arena_free (Arena *arena);
+
+#endif //_ARENA_H_
@@ -0,0 +1,476 @@
+#define _POSIX_C_SOURCE 200809L
+#include "markov_chain.h"
+#include "compiled_chain.h"
+#include "string_pool.h"
+#include "corpus_reader.h"
+#include "partial_chain.h"
+#include <string.h>
+#include <math.h> // For pow()
+#include <time.h> // For clock_gettime()
+#include <sys/resource.h> // For getrusage()
+
+#define INT_BASE 10
+#define MAX_LEN_TWEET 20
+#define MAX_SCALES 16
+#define WORDS_PER_LINE 12
+#define SENTENCE_END_EVERY 10
+#define NANOSECONDS_PER_SECOND 1000000000.0
+#define DEFAULT_SCALES "1,10,100,1000"
+#define DEFAULT_TWEETS 100000
+#define DEFAULT_VOCABULARY 20000
+#define DEFAULT_SKEW 1.0
+#define DEFAULT_SEED 1
+
+/**
+ * the settings of a run of the benchmark.
+ */
+typedef struct BenchOptions
+{
+    int scales[MAX_SCALES];// the sizes of the synthetic corpora, in
+    // multiples of the size of the real corpus
+    int num_scales;
+    int tweets;// the number of tweets generated from every corpus
+    int vocabulary;// the number of distinct words of the synthetic corpora
+    double skew;// the exponent of the zipf distribution of their words
+    unsigned int seed;
+    const char *corpus_path;// the real corpus
+} BenchOptions;
+
+/**
+ * the measurements of one corpus.
+ */
+typedef struct BenchResult
+{
+    long long words;// the number of words read
+    uint32_t states;
+    uint32_t edges;
+    double train_seconds;// reading the corpus into the chain
+    double compile_seconds;
+    long long tokens;// the number of words generated
+    double generate_seconds;
+    uint64_t *latencies;// the time of every tweet in nanoseconds
+} BenchResult;
+
+/**
+ * a partial chain and the number of words passed to it.
+ */
+typedef struct CountedPartial
+{
+    PartialChain partial;
+    long long words;
+} CountedPartial;
+
+/**
+ * the pool of the words of the chain being measured.
+ */
+static StringPool *word_pool = NULL;
+
+/**
+ * print the usage of the program.
+ */
+static void print_usage (void);
+/**
+ * parse the arguments of the program.
+ * @param argc
+ * @param argv
+ * @param options out parameter
+ * @return true if the arguments are valid, false else.
+ */
+static bool parse_bench_options (int argc, char *argv[],
+                                 BenchOptions *options);
+/**
+ * write a synthetic corpus of about length bytes to a temporary file. the
+ * words are drawn from a zipf distribution over the vocabulary, every
+ * SENTENCE_END_EVERY-th word of the vocabulary ends a sentence.
+ * @param options
+ * @param length
+ * @return the file, rewound, NULL if it could not be written.
+ */
+static FILE *write_synthetic_corpus (const BenchOptions *options,
+                                     long long length);
+/**
+ * train a chain on a corpus, compile it and generate tweets from it,
+ * measuring every phase.
+ * @param fp the corpus
+ * @param options
+ * @param result out parameter, its latencies must have room for
+ * options->tweets tweets
+ * @return 0 on success, 1 in case of allocation error.
+ */
+static int run_benchmark (FILE *fp, const BenchOptions *options,
+                          BenchResult *result);
+/**
+ * print the measurements of a corpus as one line of JSON.
+ * @param corpus the name of the corpus
+ * @param scale its size in multiples of the real corpus
+ * @param bytes its length
+ * @param options
+ * @param result
+ */
+static void print_result (const char *corpus, int scale, long long bytes,
+                          const BenchOptions *options,
+                          const BenchResult *result);
+/**
+ * the time of a monotonic clock in seconds.
+ */
+static double now_seconds (void);
+/**
+ * count a word of the corpus before passing it to the partial chain.
+ * @param token
+ * @param length
+ * @param context the CountedPartial
+ * @return the result of partial_chain_add_word
+ */
+static bool count_word (const char *token, size_t length, void *context);
+/**
+ * the functions of a chain of words, the same as the ones of the tweets
+ * generator.
+ */
+static void print_func (const void *data);
+static bool format_func (const void *data, ByteBuffer *text);
+static bool is_last (const void *data);
+static int comp_func (const void *data1, const void *data2);
+static void *copy_func (const void *source);
+static void free_func (void *pointer);
+static size_t hash_func (const void *data);
+/**
+ * compare two latencies for qsort.
+ */
+static int compare_latencies (const void *latency1, const void *latency2);
+
+int main (int argc, char *argv[])
+{
+  BenchOptions options;
+  if (!parse_bench_options (argc, argv, &options))
+  {
+    print_usage ();
+    return EXIT_FAILURE;
+  }
+  FILE *corpus = fopen (options.corpus_path, "r");
+  if (corpus == NULL)
+  {
+    printf ("Error: failed to open the file or path is invalid\n");
+    return EXIT_FAILURE;
+  }
+  fseek (corpus, 0, SEEK_END);
+  long long corpus_length = ftell (corpus);
+  rewind (corpus);
+  BenchResult result;
+  result.latencies = malloc ((options.tweets + 1) * sizeof (uint64_t));
+  if (result.latencies == NULL)
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    fclose (corpus);
+    return EXIT_FAILURE;
+  }
+  int failed = run_benchmark (corpus, &options, &result);
+  fclose (corpus);
+  if (failed == 0)
+  {
+    print_result (options.corpus_path, 0, corpus_length, &options, &result);
+  }
+  for (int i = 0; i < options.num_scales && failed == 0; i++)
+  {
+    FILE *synthetic = write_synthetic_corpus (&options, corpus_length
+                                                        * options.scales[i]);
+    if (synthetic == NULL)
+    {
+      printf ("Error: failed to write a synthetic corpus\n");
+      free (result.latencies);
+      return EXIT_FAILURE;
+    }
+    long long length = ftell (synthetic);
+    rewind (synthetic);
+    failed = run_benchmark (synthetic, &options, &result);
+    fclose (synthetic);
+    if (failed == 0)
+    {
+      print_result ("synthetic", options.scales[i], length, &options,
+                    &result);
+    }
+  }
+  free (result.latencies);
+  if (failed == 1)
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+static void print_usage (void)
+{
+  printf ("USAGE:./markov_bench [--scales 1,10,100,1000] [--tweets N] "
+          "[--vocabulary N] [--skew s] [--seed N] text_corpus_path\n");
+}
+static bool parse_bench_options (int argc, char *argv[],
+                                 BenchOptions *options)
+{
+  *options = (BenchOptions) {{0}, 0, DEFAULT_TWEETS, DEFAULT_VOCABULARY,
+                             DEFAULT_SKEW, DEFAULT_SEED, NULL};
+  const char *scales = DEFAULT_SCALES;
+  for (int i = 1; i < argc; i++)
+  {
+    bool has_value = i + 1 < argc;
+    if (strcmp (argv[i], "--scales") == 0 && has_value)
+    {
+      scales = argv[++i];
+    }
+    else if (strcmp (argv[i], "--tweets") == 0 && has_value)
+    {
+      options->tweets = (int) strtol (argv[++i], NULL, INT_BASE);
+    }
+    else if (strcmp (argv[i], "--vocabulary") == 0 && has_value)
+    {
+      options->vocabulary = (int) strtol (argv[++i], NULL, INT_BASE);
+    }
+    else if (strcmp (argv[i], "--skew") == 0 && has_value)
+    {
+      options->skew = strtod (argv[++i], NULL);
+    }
+    else if (strcmp (argv[i], "--seed") == 0 && has_value)
+    {
+      options->seed = (unsigned int) strtol (argv[++i], NULL, INT_BASE);
+    }
+    else if (strncmp (argv[i], "--", 2) != 0 && options->corpus_path == NULL)
+    {
+      options->corpus_path = argv[i];
+    }
+    else
+    {
+      return false;
+    }
+  }
+  // the scales are a comma separated list, an empty list measures only the
+  // real corpus
+  for (const char *scale = scales; *scale != '\0'
+                                   && options->num_scales < MAX_SCALES;)
+  {
+    char *end = NULL;
+    int value = (int) strtol (scale, &end, INT_BASE);
+    if (end == scale || value < 1)
+    {
+      return false;
+    }
+    options->scales[options->num_scales++] = value;
+    scale = (*end == ',') ? end + 1 : end;
+  }
+  return options->corpus_path != NULL && options->tweets > 0
+         && options->vocabulary > 0 && options->skew >= 0;
+}
+static FILE *write_synthetic_corpus (const BenchOptions *options,
+                                     long long length)
+{
+  double *cumulative = malloc (options->vocabulary * sizeof (double));
+  FILE *fp = tmpfile ();
+  if (cumulative == NULL || fp == NULL)
+  {
+    free (cumulative);
+    if (fp != NULL)
+    {
+      fclose (fp);
+    }
+    return NULL;
+  }
+  // the word of rank r has weight 1 / r^skew
+  double total = 0;
+  for (int rank = 0; rank < options->vocabulary; rank++)
+  {
+    total += 1.0 / pow (rank + 1, options->skew);
+    cumulative[rank] = total;
+  }
+  Rng rng;
+  rng_seed (&rng, options->seed);
+  long long written = 0;
+  for (long long words = 1; written < length; words++)
+  {
+    double u = (double) (rng_next (&rng) >> 11) / (double) (1ULL << 53)
+               * total;
+    int low = 0;
+    int high = options->vocabulary - 1;
+    while (low < high)
+    {
+      int middle = (low + high) / 2;
+      if (cumulative[middle] < u)
+      {
+        low = middle + 1;
+      }
+      else
+      {
+        high = middle;
+      }
+    }
+    bool ends = low % SENTENCE_END_EVERY == SENTENCE_END_EVERY - 1;
+    int printed = fprintf (fp, "w%d%s%c", low, ends ? "." : "",
+                           (words % WORDS_PER_LINE == 0) ? '\n' : ' ');
+    if (printed < 0)
+    {
+      free (cumulative);
+      fclose (fp);
+      return NULL;
+    }
+    written += printed;
+  }
+  free (cumulative);
+  if (fflush (fp) != 0)
+  {
+    fclose (fp);
+    return NULL;
+  }
+  return fp;
+}
+static int run_benchmark (FILE *fp, const BenchOptions *options,
+                          BenchResult *result)
+{
+  word_pool = string_pool_create ();
+  MarkovChain *markov_chain = create_markov_chain (print_func, copy_func,
+                                                   free_func, comp_func,
+                                                   is_last);
+  CountedPartial counted = {{0}, 0};
+  bool failed = word_pool == NULL || markov_chain == NULL
+                || !set_hash_func (markov_chain, hash_func)
+                || !partial_chain_init (&counted.partial, is_last);
+  double start = now_seconds ();
+  if (!failed)
+  {
+    markov_chain->format_func = format_func;
+    failed = read_corpus (fp, count_word, &counted) == 1
+             || counted.partial.failed
+             || !merge_partial_chains (markov_chain, &counted.partial, 1);
+  }
+  partial_chain_free (&counted.partial);
+  result->train_seconds = now_seconds () - start;
+  result->words = counted.words;
+  CompiledChain *compiled = NULL;
+  if (!failed)
+  {
+    start = now_seconds ();
+    compiled = compile_markov_chain (markov_chain, SAMPLER_ALIAS);
+    result->compile_seconds = now_seconds () - start;
+    failed = compiled == NULL;
+  }
+  free_database (&markov_chain);
+  ByteBuffer text;
+  byte_buffer_init (&text);
+  result->tokens = 0;
+  result->generate_seconds = 0;
+  if (!failed)
+  {
+    result->states = compiled->num_states;
+    result->edges = compiled->num_edges;
+    uint32_t states[MAX_LEN_TWEET];
+    start = now_seconds ();
+    for (int i = 0; i < options->tweets && !failed; i++)
+    {
+      struct timespec begin, end;
+      clock_gettime (CLOCK_MONOTONIC, &begin);
+      Rng rng;
+      rng_seed_stream (&rng, options->seed, (uint64_t) i);
+      int length = compiled_walk (compiled, COMPILED_RANDOM_START,
+                                  MAX_LEN_TWEET, &rng, states);
+      text.length = 0;
+      failed = !format_compiled_walk (compiled, states, length, &text);
+      clock_gettime (CLOCK_MONOTONIC, &end);
+      result->latencies[i] = (uint64_t) (end.tv_sec - begin.tv_sec)
+                             * 1000000000ULL + end.tv_nsec - begin.tv_nsec;
+      result->tokens += length;
+    }
+    result->generate_seconds = now_seconds () - start;
+  }
+  byte_buffer_free (&text);
+  free_compiled_chain (&compiled);
+  string_pool_free (word_pool);
+  word_pool = NULL;
+  return failed ? 1 : 0;
+}
+static void print_result (const char *corpus, int scale, long long bytes,
+                          const BenchOptions *options,
+                          const BenchResult *result)
+{
+  qsort (result->latencies, options->tweets, sizeof (uint64_t),
+         compare_latencies);
+  const uint64_t *latencies = result->latencies;
+  int last = options->tweets - 1;
+  struct rusage usage;
+  getrusage (RUSAGE_SELF, &usage);
+  printf ("{\"corpus\":\"%s\",\"scale\":%d,\"bytes\":%lld,\"words\":%lld,"
+          "\"states\":%u,\"edges\":%u,\"train_seconds\":%.6f,"
+          "\"train_words_per_second\":%.0f,\"compile_seconds\":%.6f,"
+          "\"tweets\":%d,\"tokens\":%lld,\"generate_seconds\":%.6f,"
+          "\"tweets_per_second\":%.0f,\"tokens_per_second\":%.0f,"
+          "\"latency_ns\":{\"p50\":%llu,\"p90\":%llu,\"p99\":%llu,"
+          "\"p999\":%llu,\"max\":%llu},\"peak_rss_kb\":%ld}\n",
+          corpus, scale, bytes, result->words, result->states, result->edges,
+          result->train_seconds, result->words / result->train_seconds,
+          result->compile_seconds, options->tweets, result->tokens,
+          result->generate_seconds,
+          options->tweets / result->generate_seconds,
+          result->tokens / result->generate_seconds,
+          (unsigned long long) latencies[last * 50 / 100],
+          (unsigned long long) latencies[last * 90 / 100],
+          (unsigned long long) latencies[last * 99 / 100],
+          (unsigned long long) latencies[last * 999 / 1000],
+          (unsigned long long) latencies[last], usage.ru_maxrss);
+  fflush (stdout);
+}
+static double now_seconds (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + now.tv_nsec / NANOSECONDS_PER_SECOND;
+}
+static bool count_word (const char *token, size_t length, void *context)
+{
+  CountedPartial *counted = (CountedPartial *) context;
+  counted->words++;
+  return partial_chain_add_word (token, length, &counted->partial);
+}
+static int compare_latencies (const void *latency1, const void *latency2)
+{
+  uint64_t first = *(const uint64_t *) latency1;
+  uint64_t second = *(const uint64_t *) latency2;
+  return (first > second) - (first < second);
+}
+
+//***************markov chain functions***************//
+static void print_func (const void *data)
+{
+  printf ("%s", (const char *) data);
+  if (!is_last (data))
+  {
+    printf (" ");
+  }
+}
+static bool format_func (const void *data, ByteBuffer *text)
+{
+  const char *str = (const char *) data;
+  return byte_buffer_append_string (text, str)
+         && (is_last (str) || byte_buffer_append (text, " ", 1));
+}
+static bool is_last (const void *data)
+{
+  const char *str = (const char *) data;
+  return str[strlen (str) - 1] == '.';
+}
+static int comp_func (const void *data1, const void *data2)
+{
+  return strcmp ((const char *) data1, (const char *) data2);
+}
+static void *copy_func (const void *source)
+{
+  const char *str = (const char *) source;
+  uint32_t id = string_pool_intern (word_pool, str, strlen (str));
+  if (id == STRING_POOL_NO_ID)
+  {
+    return NULL;
+  }
+  return (void *) string_pool_get (word_pool, id);
+}
+static void free_func (void *pointer)
+{
+  (void) pointer;
+}
+static size_t hash_func (const void *data)
+{
+  const char *str = (const char *) data;
+  return string_pool_hash (str, strlen (str));
+}
@@ -0,0 +1,88 @@
+#include "byte_buffer.h"
+#include <string.h> // For memcpy(), strlen()
+#include <stdarg.h> // For va_list
+
+#define BUFFER_INITIAL_CAPACITY 4096
+
+/**
+ * make sure the buffer has room for extra more bytes.
+ * @param buffer
+ * @param extra
+ * @return true on success, false in case of allocation error.
+ */
+static bool reserve (ByteBuffer *buffer, size_t extra)
+{
+  if (buffer->capacity - buffer->length >= extra)
+  {
+    return true;
+  }
+  size_t new_capacity = (buffer->capacity == 0) ? BUFFER_INITIAL_CAPACITY
+                                                : buffer->capacity;
+  while (new_capacity - buffer->length < extra)
+  {
+    new_capacity *= 2;
+  }
+  char *new_bytes = realloc (buffer->bytes, new_capacity);
+  if (new_bytes == NULL)
+  {
+    return false;
+  }
+  buffer->bytes = new_bytes;
+  buffer->capacity = new_capacity;
+  return true;
+}
+void byte_buffer_init (ByteBuffer *buffer)
+{
+  buffer->bytes = NULL;
+  buffer->length = 0;
+  buffer->capacity = 0;
+}
+bool byte_buffer_append (ByteBuffer *buffer, const char *bytes,
+                         size_t length)
+{
+  if (!reserve (buffer, length))
+  {
+    return false;
+  }
+  memcpy (buffer->bytes + buffer->length, bytes, length);
+  buffer->length += length;
+  return true;
+}
+bool byte_buffer_append_string (ByteBuffer *buffer, const char *str)
+{
+  return byte_buffer_append (buffer, str, strlen (str));
+}
+bool byte_buffer_printf (ByteBuffer *buffer, const char *format, ...)
+{
+  va_list args;
+  va_start (args, format);
+  int length = vsnprintf (NULL, 0, format, args);
+  va_end (args);
+  // one more byte for the '\0' vsnprintf writes, it is not counted
+  if (length < 0 || !reserve (buffer, (size_t) length + 1))
+  {
+    return false;
+  }
+  va_start (args, format);
+  vsnprintf (buffer->bytes + buffer->length, (size_t) length + 1, format,
+             args);
+  va_end (args);
+  buffer->length += (size_t) length;
+  return true;
+}
+bool byte_buffer_flush (ByteBuffer *buffer, FILE *stream)
+{
+  if (buffer->length == 0)
+  {
+    return true;
+  }
+  size_t written = fwrite (buffer->bytes, 1, buffer->length, stream);
+  bool success = written == buffer->length;
+  buffer->length = 0;
+  return success;
+}
+void byte_buffer_free (ByteBuffer *buffer)
+{
+  free (buffer->bytes);
+  byte_buffer_init (buffer);
+}
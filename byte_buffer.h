@@ -0,0 +1,64 @@
+#ifndef _BYTE_BUFFER_H_
+#define _BYTE_BUFFER_H_
+#include <stdio.h> // For FILE, fwrite()
+#include <stdlib.h> // For malloc(), size_t
+#include <stdbool.h> // for bool
+
+/**
+ * a growable array of bytes output is collected in, so it can be written
+ * with one call instead of a printf per token.
+ */
+typedef struct ByteBuffer
+{
+    char *bytes;
+    size_t length;// the number of bytes written to the buffer
+    size_t capacity;// the allocated length of bytes
+} ByteBuffer;
+
+/**
+ * Initialize an empty buffer. does not allocate.
+ * @param buffer
+ */
+void byte_buffer_init (ByteBuffer *buffer);
+
+/**
+ * Append bytes to the end of the buffer, growing it if needed.
+ * @param buffer
+ * @param bytes
+ * @param length the number of bytes to append
+ * @return true on success, false in case of allocation error.
+ */
+bool byte_buffer_append (ByteBuffer *buffer, const char *bytes,
+                         size_t length);
+
+/**
+ * Append a '\0' terminated string to the end of the buffer.
+ * @param buffer
+ * @param str
+ * @return true on success, false in case of allocation error.
+ */
+bool byte_buffer_append_string (ByteBuffer *buffer, const char *str);
+
+/**
+ * Append printf formatted text to the end of the buffer.
+ * @param buffer
+ * @param format a printf format string
+ * @return true on success, false in case of allocation error.
+ */
+bool byte_buffer_printf (ByteBuffer *buffer, const char *format, ...);
+
+/**
+ * Write the content of the buffer to a stream and empty the buffer.
+ * @param buffer
+ * @param stream
+ * @return true on success, false if the write failed.
+ */
+bool byte_buffer_flush (ByteBuffer *buffer, FILE *stream);
+
+/**
+ * Free the memory of the buffer, leaving it empty.
+ * @param buffer
+ */
+void byte_buffer_free (ByteBuffer *buffer);
+
+#endif //_BYTE_BUFFER_H_
@@ -0,0 +1,769 @@
+#define _POSIX_C_SOURCE 200809L
+#include "compiled_chain.h"
+#include <string.h> // For memcpy()
+#include <fcntl.h> // For open()
+#include <unistd.h> // For close()
+#include <sys/mman.h> // For mmap()
+#include <sys/stat.h> // For fstat()
+
+#define MODEL_ALIGNMENT 8
+// the most bytes a 32 bit varint takes
+#define VARINT_MAX_LENGTH 5
+// the most bytes a packed successor takes
+#define PACKED_SUCCESSOR_MAX_LENGTH (VARINT_MAX_LENGTH + 4)
+
+/**
+ * the header of a model file. the offsets are from the start of the file.
+ */
+typedef struct ModelHeader
+{
+    char magic[8];// MODEL_MAGIC, without its '\0'
+    uint32_t version;
+    uint32_t num_states;
+    uint32_t num_edges;
+    uint32_t num_starts;
+    uint64_t row_offsets;// num_states + 1 uint32_t
+    uint64_t successor_ids;// num_edges uint32_t
+    uint64_t weights;// num_edges uint32_t
+    uint64_t terminal;// num_states uint8_t
+    uint64_t start_ids;// num_starts uint32_t
+    uint64_t data_offsets;// num_states + 1 uint64_t offsets into data
+    uint64_t data;// the data of the states one after the other, each one
+    // MODEL_ALIGNMENT aligned
+    uint64_t file_length;
+} ModelHeader;
+
+/**
+ * write a section of a model file followed by padding to MODEL_ALIGNMENT.
+ * @param fp
+ * @param bytes
+ * @param length
+ * @param offset in/out parameter, the offset in the file, moved past the
+ * section and its padding
+ * @return true on success, false if writing failed.
+ */
+static bool write_section (FILE *fp, const void *bytes, uint64_t length,
+                           uint64_t *offset);
+/**
+ * check that a section of a mapped model file is in the file and aligned.
+ * @param header
+ * @param offset the offset of the section
+ * @param length the length of the section
+ * @return true if the section is valid.
+ */
+static bool valid_section (const ModelHeader *header, uint64_t offset,
+                           uint64_t length);
+/**
+ * check that the arrays of a loaded chain describe a valid chain.
+ * @param compiled a chain pointing into its mapped model file
+ * @param data_offsets
+ * @param data the data section of the file
+ * @param data_length
+ * @return true if every id and offset is in range and the data of every
+ * state is a non empty '\0' terminated string that ends inside its range.
+ */
+static bool valid_model (const CompiledChain *compiled,
+                         const uint64_t *data_offsets, const char *data,
+                         uint64_t data_length);
+
+/**
+ * an edge of a row being packed.
+ */
+typedef struct PackedEdge
+{
+    uint32_t id;
+    uint32_t weight;
+} PackedEdge;
+/**
+ * compare packed edges by the id of their successor, for qsort.
+ */
+static int compare_packed_edges (const void *first, const void *second);
+/**
+ * write a value as a varint: 7 bits in every byte from the lowest, with the
+ * top bit set on all the bytes but the last.
+ * @param bytes room for VARINT_MAX_LENGTH bytes
+ * @param value
+ * @return the number of bytes written
+ */
+static size_t write_varint (uint8_t *bytes, uint32_t value);
+/**
+ * read a varint written by write_varint.
+ * @param bytes in/out parameter, moved past the varint
+ * @return the value
+ */
+static uint32_t read_varint (const uint8_t **bytes);
+/**
+ * pack one row of a compiled chain.
+ * @param compiled
+ * @param state the row to pack
+ * @param edges room for the successors of the row
+ * @param bytes room for 1 + PACKED_SUCCESSOR_MAX_LENGTH bytes per successor
+ * @return the number of bytes written
+ */
+static size_t pack_row (const CompiledChain *compiled, uint32_t state,
+                        PackedEdge *edges, uint8_t *bytes);
+/**
+ * choose a successor of a packed row like sample_cumulative, decoding the
+ * row until it is found.
+ * @param compiled a packed chain
+ * @param state a state with successors
+ * @param rng the generator to draw from
+ * @return the id of the chosen state
+ */
+static uint32_t packed_next_random_state (const CompiledChain *compiled,
+                                          uint32_t state, Rng *rng);
+
+// see all documentation in the header file
+/**
+ * build the sampler of every row of the compiled chain.
+ * @param compiled a compiled chain with its weights filled
+ * @param kind
+ * @return true on success, false in case of allocation error.
+ */
+static bool build_samplers (CompiledChain *compiled, SamplerKind kind)
+{
+  size_t length = compiled->num_edges;
+  if (kind == SAMPLER_ALIAS)
+  {
+    length *= 2;
+  }
+  compiled->sampler_kind = kind;
+  compiled->sampler = malloc ((length + 1) * sizeof (uint32_t));
+  if (compiled->sampler == NULL)
+  {
+    return false;
+  }
+  for (uint32_t state = 0; state < compiled->num_states; state++)
+  {
+    uint32_t begin = compiled->row_offsets[state];
+    uint32_t size = compiled->row_offsets[state + 1] - begin;
+    if (size == 0)
+    {
+      continue;
+    }
+    if (kind == SAMPLER_ALIAS)
+    {
+      if (!build_alias_table (compiled->weights + begin, size,
+                              compiled->sampler + begin,
+                              compiled->sampler + compiled->num_edges
+                              + begin))
+      {
+        return false;
+      }
+    }
+    else
+    {
+      uint32_t cumulative = 0;
+      for (uint32_t i = begin; i < begin + size; i++)
+      {
+        cumulative += compiled->weights[i];
+        compiled->sampler[i] = cumulative;
+      }
+    }
+  }
+  return true;
+}
+CompiledChain *compile_markov_chain (const MarkovChain *markov_chain,
+                                     SamplerKind kind)
+{
+  CompiledChain *compiled = calloc (1, sizeof (CompiledChain));
+  if (compiled == NULL)
+  {
+    return NULL;
+  }
+  uint32_t num_states = 0;
+  if (markov_chain->database != NULL)
+  {
+    num_states = (uint32_t) markov_chain->database->size;
+  }
+  uint32_t num_edges = 0;
+  for (uint32_t id = 0; id < num_states; id++)
+  {
+    num_edges += (uint32_t) markov_chain->states[id]
+        ->current_successive_nodes;
+  }
+  compiled->num_states = num_states;
+  compiled->num_edges = num_edges;
+  compiled->format_func = markov_chain->format_func;
+  // one extra element keeps malloc from getting 0 for an empty chain
+  compiled->row_offsets = malloc ((num_states + 1) * sizeof (uint32_t));
+  compiled->successor_ids = malloc ((num_edges + 1) * sizeof (uint32_t));
+  compiled->weights = malloc ((num_edges + 1) * sizeof (uint32_t));
+  compiled->row_totals = malloc ((num_states + 1) * sizeof (uint32_t));
+  compiled->terminal = malloc ((num_states + 1) * sizeof (uint8_t));
+  // walks start from the same states get_first_random_node chooses from,
+  // with the same weights
+  const uint32_t *start_ids = markov_chain->start_candidates;
+  uint32_t num_starts = markov_chain->num_start_candidates;
+  if (markov_chain->weighted_starts && markov_chain->num_sentence_starts > 0)
+  {
+    start_ids = markov_chain->sentence_starts;
+    num_starts = markov_chain->num_sentence_starts;
+  }
+  compiled->start_ids = malloc ((num_starts + 1) * sizeof (uint32_t));
+  compiled->state_data = malloc ((num_states + 1) * sizeof (void *));
+  if (compiled->row_offsets == NULL || compiled->successor_ids == NULL
+      || compiled->weights == NULL || compiled->row_totals == NULL
+      || compiled->terminal == NULL || compiled->start_ids == NULL
+      || compiled->state_data == NULL)
+  {
+    free_compiled_chain (&compiled);
+    return NULL;
+  }
+  uint32_t edge = 0;
+  for (uint32_t id = 0; id < num_states; id++)
+  {
+    const MarkovNode *node = markov_chain->states[id];
+    compiled->row_offsets[id] = edge;
+    compiled->row_totals[id] = (uint32_t) node->total_occurrences;
+    compiled->state_data[id] = node->data;
+    compiled->terminal[id] = markov_chain->is_last (node->data) ? 1 : 0;
+    for (int i = 0; i < node->current_successive_nodes; i++, edge++)
+    {
+      compiled->successor_ids[edge] = node->frequencies_list[i].next_id;
+      compiled->weights[edge] = (uint32_t) node->frequencies_list[i]
+          .frequency;
+    }
+  }
+  compiled->row_offsets[num_states] = edge;
+  if (num_starts > 0)
+  {
+    memcpy (compiled->start_ids, start_ids, num_starts * sizeof (uint32_t));
+  }
+  compiled->num_starts = num_starts;
+  if (!build_samplers (compiled, kind))
+  {
+    free_compiled_chain (&compiled);
+    return NULL;
+  }
+  return compiled;
+}
+static int compare_packed_edges (const void *first, const void *second)
+{
+  uint32_t first_id = ((const PackedEdge *) first)->id;
+  uint32_t second_id = ((const PackedEdge *) second)->id;
+  return (first_id > second_id) - (first_id < second_id);
+}
+static size_t write_varint (uint8_t *bytes, uint32_t value)
+{
+  size_t length = 0;
+  while (value >= 0x80)
+  {
+    bytes[length++] = (uint8_t) (value | 0x80);
+    value >>= 7;
+  }
+  bytes[length++] = (uint8_t) value;
+  return length;
+}
+static uint32_t read_varint (const uint8_t **bytes)
+{
+  uint32_t value = 0;
+  int shift = 0;
+  const uint8_t *current = *bytes;
+  while (*current & 0x80)
+  {
+    value |= (uint32_t) (*current++ & 0x7f) << shift;
+    shift += 7;
+  }
+  value |= (uint32_t) *current++ << shift;
+  *bytes = current;
+  return value;
+}
+static size_t pack_row (const CompiledChain *compiled, uint32_t state,
+                        PackedEdge *edges, uint8_t *bytes)
+{
+  uint32_t begin = compiled->row_offsets[state];
+  uint32_t size = compiled->row_offsets[state + 1] - begin;
+  if (size == 0)
+  {
+    return 0;
+  }
+  uint32_t max_weight = 0;
+  for (uint32_t i = 0; i < size; i++)
+  {
+    edges[i].id = compiled->successor_ids[begin + i];
+    edges[i].weight = compiled->weights[begin + i];
+    if (edges[i].weight > max_weight)
+    {
+      max_weight = edges[i].weight;
+    }
+  }
+  qsort (edges, size, sizeof (PackedEdge), compare_packed_edges);
+  int width = PACKED_WEIGHTS_32;
+  if (max_weight <= UINT8_MAX)
+  {
+    width = PACKED_WEIGHTS_8;
+  }
+  else if (max_weight <= UINT16_MAX)
+  {
+    width = PACKED_WEIGHTS_16;
+  }
+  size_t length = 0;
+  bytes[length++] = (uint8_t) width;
+  for (uint32_t i = 0; i < size; i++)
+  {
+    // the ids of a row are distinct, so the distances are at least 1
+    uint32_t delta = (i == 0) ? edges[i].id
+                              : edges[i].id - edges[i - 1].id - 1;
+    length += write_varint (bytes + length, delta);
+    // the weights are little endian, a byte at a time
+    for (int byte = 0; byte < (1 << width); byte++)
+    {
+      bytes[length++] = (uint8_t) (edges[i].weight >> (8 * byte));
+    }
+  }
+  return length;
+}
+bool pack_compiled_chain (CompiledChain *compiled)
+{
+  if (compiled->packed != NULL)
+  {
+    return true;
+  }
+  uint32_t max_size = 0;
+  for (uint32_t state = 0; state < compiled->num_states; state++)
+  {
+    uint32_t size = compiled->row_offsets[state + 1]
+                    - compiled->row_offsets[state];
+    if (size > max_size)
+    {
+      max_size = size;
+    }
+  }
+  // packed is allocated for the longest possible rows and shrunk after
+  size_t capacity = (size_t) compiled->num_states
+                    + (size_t) compiled->num_edges
+                      * PACKED_SUCCESSOR_MAX_LENGTH + 1;
+  uint8_t *packed = malloc (capacity);
+  uint32_t *packed_offsets = malloc ((compiled->num_states + 1)
+                                     * sizeof (uint32_t));
+  PackedEdge *edges = malloc ((max_size + 1) * sizeof (PackedEdge));
+  if (packed == NULL || packed_offsets == NULL || edges == NULL)
+  {
+    free (packed);
+    free (packed_offsets);
+    free (edges);
+    return false;
+  }
+  size_t length = 0;
+  for (uint32_t state = 0; state < compiled->num_states; state++)
+  {
+    packed_offsets[state] = (uint32_t) length;
+    length += pack_row (compiled, state, edges, packed + length);
+    if (length > UINT32_MAX)
+    {
+      free (packed);
+      free (packed_offsets);
+      free (edges);
+      return false;
+    }
+  }
+  packed_offsets[compiled->num_states] = (uint32_t) length;
+  free (edges);
+  uint8_t *shrunk = realloc (packed, length + 1);
+  compiled->packed = (shrunk != NULL) ? shrunk : packed;
+  compiled->packed_offsets = packed_offsets;
+  if (compiled->mapping == NULL)
+  {
+    free (compiled->successor_ids);
+    free (compiled->weights);
+  }
+  compiled->successor_ids = NULL;
+  compiled->weights = NULL;
+  free (compiled->sampler);
+  compiled->sampler = NULL;
+  return true;
+}
+size_t compiled_chain_bytes (const CompiledChain *compiled)
+{
+  size_t states = compiled->num_states;
+  // the row totals and state data are always allocated
+  size_t bytes = states * (sizeof (uint32_t) + sizeof (void *));
+  if (compiled->mapping == NULL)
+  {
+    bytes += (states + 1) * sizeof (uint32_t) + states * sizeof (uint8_t)
+             + compiled->num_starts * sizeof (uint32_t);
+    if (compiled->successor_ids != NULL)
+    {
+      bytes += 2 * (size_t) compiled->num_edges * sizeof (uint32_t);
+    }
+  }
+  if (compiled->sampler != NULL)
+  {
+    bytes += (size_t) compiled->num_edges * sizeof (uint32_t)
+             * ((compiled->sampler_kind == SAMPLER_ALIAS) ? 2 : 1);
+  }
+  if (compiled->packed != NULL)
+  {
+    bytes += compiled->packed_offsets[states]
+             + (states + 1) * sizeof (uint32_t);
+  }
+  return bytes;
+}
+static uint32_t packed_next_random_state (const CompiledChain *compiled,
+                                          uint32_t state, Rng *rng)
+{
+  uint32_t size = compiled->row_offsets[state + 1]
+                  - compiled->row_offsets[state];
+  const uint8_t *bytes = compiled->packed + compiled->packed_offsets[state];
+  int width = *bytes++;
+  uint32_t chosen = rng_bounded (rng, compiled->row_totals[state]);
+  uint32_t id = 0;
+  uint32_t cumulative = 0;
+  for (uint32_t i = 0; i < size; i++)
+  {
+    id += read_varint (&bytes) + ((i == 0) ? 0 : 1);
+    uint32_t weight = 0;
+    for (int byte = 0; byte < (1 << width); byte++)
+    {
+      weight |= (uint32_t) *bytes++ << (8 * byte);
+    }
+    cumulative += weight;
+    if (chosen < cumulative)
+    {
+      return id;
+    }
+  }
+  // the weights of a row add up to its total, so this is never reached
+  return id;
+}
+uint32_t compiled_first_random_state (const CompiledChain *compiled,
+                                      Rng *rng)
+{
+  return compiled->start_ids[rng_bounded (rng, compiled->num_starts)];
+}
+uint32_t compiled_next_random_state (const CompiledChain *compiled,
+                                     uint32_t state, Rng *rng)
+{
+  if (compiled->packed != NULL)
+  {
+    return packed_next_random_state (compiled, state, rng);
+  }
+  uint32_t begin = compiled->row_offsets[state];
+  uint32_t size = compiled->row_offsets[state + 1] - begin;
+  uint32_t chosen;
+  if (compiled->sampler_kind == SAMPLER_ALIAS)
+  {
+    chosen = sample_alias_table (compiled->sampler + begin,
+                                 compiled->sampler + compiled->num_edges
+                                 + begin, size, compiled->row_totals[state],
+                                 rng);
+  }
+  else
+  {
+    chosen = sample_cumulative (compiled->sampler + begin, size, rng);
+  }
+  return compiled->successor_ids[begin + chosen];
+}
+int compiled_walk (const CompiledChain *compiled, uint32_t first_state,
+                   int max_length, Rng *rng, uint32_t *states)
+{
+  if (compiled == NULL || compiled->num_starts == 0 || max_length < 1)
+  {
+    return 0;
+  }
+  uint32_t current = first_state;
+  if (current == COMPILED_RANDOM_START)
+  {
+    current = compiled_first_random_state (compiled, rng);
+  }
+  int length = 0;
+  while ((max_length > 1)
+         && (compiled->row_offsets[current + 1]
+             > compiled->row_offsets[current])
+         && !compiled->terminal[current])
+  {
+    states[length++] = current;
+    current = compiled_next_random_state (compiled, current, rng);
+    max_length--;
+  }
+  states[length++] = current;
+  return length;
+}
+bool format_compiled_walk (const CompiledChain *compiled,
+                           const uint32_t *states, int length,
+                           ByteBuffer *text)
+{
+  if (compiled->format_func == NULL)
+  {
+    return false;
+  }
+  for (int i = 0; i < length; i++)
+  {
+    if (!compiled->format_func (compiled->state_data[states[i]], text))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+bool save_compiled_chain (const CompiledChain *compiled,
+                          size_func_ptr size_func, const char *path)
+{
+  if (compiled->packed != NULL)
+  {
+    return false;
+  }
+  uint64_t *data_offsets = malloc ((compiled->num_states + 1)
+                                   * sizeof (uint64_t));
+  FILE *fp = fopen (path, "wb");
+  if (data_offsets == NULL || fp == NULL)
+  {
+    free (data_offsets);
+    if (fp != NULL)
+    {
+      fclose (fp);
+    }
+    return false;
+  }
+  uint64_t data_length = 0;
+  for (uint32_t id = 0; id < compiled->num_states; id++)
+  {
+    data_offsets[id] = data_length;
+    data_length += size_func (compiled->state_data[id]);
+    data_length += (MODEL_ALIGNMENT - data_length % MODEL_ALIGNMENT)
+                   % MODEL_ALIGNMENT;
+  }
+  data_offsets[compiled->num_states] = data_length;
+  ModelHeader header = {{0}, MODEL_VERSION, compiled->num_states,
+                        compiled->num_edges, compiled->num_starts,
+                        0, 0, 0, 0, 0, 0, 0, 0};
+  memcpy (header.magic, MODEL_MAGIC, sizeof (header.magic));
+  // the offsets follow from the lengths, so they are set before writing
+  uint64_t offset = sizeof (ModelHeader);
+  header.row_offsets = offset;
+  offset += ((compiled->num_states + 1) * sizeof (uint32_t)
+             + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+  header.successor_ids = offset;
+  offset += ((uint64_t) compiled->num_edges * sizeof (uint32_t)
+             + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+  header.weights = offset;
+  offset += ((uint64_t) compiled->num_edges * sizeof (uint32_t)
+             + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+  header.terminal = offset;
+  offset += ((uint64_t) compiled->num_states
+             + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+  header.start_ids = offset;
+  offset += ((uint64_t) compiled->num_starts * sizeof (uint32_t)
+             + MODEL_ALIGNMENT - 1) / MODEL_ALIGNMENT * MODEL_ALIGNMENT;
+  header.data_offsets = offset;
+  offset += (compiled->num_states + 1) * sizeof (uint64_t);
+  header.data = offset;
+  header.file_length = offset + data_length;
+  offset = 0;
+  bool success = write_section (fp, &header, sizeof (ModelHeader), &offset)
+      && write_section (fp, compiled->row_offsets, (compiled->num_states + 1)
+                                                   * sizeof (uint32_t),
+                        &offset)
+      && write_section (fp, compiled->successor_ids, (uint64_t)
+          compiled->num_edges * sizeof (uint32_t), &offset)
+      && write_section (fp, compiled->weights, (uint64_t)
+          compiled->num_edges * sizeof (uint32_t), &offset)
+      && write_section (fp, compiled->terminal, compiled->num_states,
+                        &offset)
+      && write_section (fp, compiled->start_ids, (uint64_t)
+          compiled->num_starts * sizeof (uint32_t), &offset)
+      && write_section (fp, data_offsets, (compiled->num_states + 1)
+                                          * sizeof (uint64_t), &offset);
+  for (uint32_t id = 0; success && id < compiled->num_states; id++)
+  {
+    success = write_section (fp, compiled->state_data[id],
+                             size_func (compiled->state_data[id]), &offset);
+  }
+  free (data_offsets);
+  // size_func must give the same sizes the offsets were computed with
+  return fclose (fp) == 0 && success && offset == header.file_length;
+}
+CompiledChain *load_compiled_chain (const char *path, SamplerKind kind,
+                                    format_func_ptr format_func)
+{
+  int fd = open (path, O_RDONLY);
+  if (fd == -1)
+  {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat (fd, &info) != 0 || (size_t) info.st_size < sizeof (ModelHeader))
+  {
+    close (fd);
+    return NULL;
+  }
+  void *mapping = mmap (NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE,
+                        fd, 0);
+  close (fd);
+  if (mapping == MAP_FAILED)
+  {
+    return NULL;
+  }
+  const ModelHeader *header = (const ModelHeader *) mapping;
+  CompiledChain *compiled = calloc (1, sizeof (CompiledChain));
+  if (compiled == NULL)
+  {
+    munmap (mapping, (size_t) info.st_size);
+    return NULL;
+  }
+  compiled->mapping = mapping;
+  compiled->mapping_length = (size_t) info.st_size;
+  if (memcmp (header->magic, MODEL_MAGIC, sizeof (header->magic)) != 0
+      || header->version != MODEL_VERSION
+      || header->file_length != (uint64_t) info.st_size
+      || !valid_section (header, header->row_offsets,
+                         ((uint64_t) header->num_states + 1)
+                         * sizeof (uint32_t))
+      || !valid_section (header, header->successor_ids,
+                         (uint64_t) header->num_edges * sizeof (uint32_t))
+      || !valid_section (header, header->weights,
+                         (uint64_t) header->num_edges * sizeof (uint32_t))
+      || !valid_section (header, header->terminal, header->num_states)
+      || !valid_section (header, header->start_ids,
+                         (uint64_t) header->num_starts * sizeof (uint32_t))
+      || !valid_section (header, header->data_offsets,
+                         ((uint64_t) header->num_states + 1)
+                         * sizeof (uint64_t))
+      || !valid_section (header, header->data,
+                         header->file_length - header->data))
+  {
+    free_compiled_chain (&compiled);
+    return NULL;
+  }
+  char *bytes = (char *) mapping;
+  compiled->num_states = header->num_states;
+  compiled->num_edges = header->num_edges;
+  compiled->num_starts = header->num_starts;
+  compiled->row_offsets = (uint32_t *) (bytes + header->row_offsets);
+  compiled->successor_ids = (uint32_t *) (bytes + header->successor_ids);
+  compiled->weights = (uint32_t *) (bytes + header->weights);
+  compiled->terminal = (uint8_t *) (bytes + header->terminal);
+  compiled->start_ids = (uint32_t *) (bytes + header->start_ids);
+  compiled->format_func = format_func;
+  const uint64_t *data_offsets = (const uint64_t *) (bytes
+                                                     + header->data_offsets);
+  if (!valid_model (compiled, data_offsets, bytes + header->data,
+                    header->file_length - header->data))
+  {
+    free_compiled_chain (&compiled);
+    return NULL;
+  }
+  compiled->row_totals = malloc ((compiled->num_states + 1)
+                                 * sizeof (uint32_t));
+  compiled->state_data = malloc ((compiled->num_states + 1)
+                                 * sizeof (void *));
+  if (compiled->row_totals == NULL || compiled->state_data == NULL)
+  {
+    free_compiled_chain (&compiled);
+    return NULL;
+  }
+  for (uint32_t id = 0; id < compiled->num_states; id++)
+  {
+    compiled->state_data[id] = bytes + header->data + data_offsets[id];
+    compiled->row_totals[id] = 0;
+    for (uint32_t i = compiled->row_offsets[id];
+         i < compiled->row_offsets[id + 1]; i++)
+    {
+      compiled->row_totals[id] += compiled->weights[i];
+    }
+  }
+  if (!build_samplers (compiled, kind))
+  {
+    free_compiled_chain (&compiled);
+    return NULL;
+  }
+  return compiled;
+}
+static bool write_section (FILE *fp, const void *bytes, uint64_t length,
+                           uint64_t *offset)
+{
+  static const char padding[MODEL_ALIGNMENT] = {0};
+  size_t padding_length = (MODEL_ALIGNMENT - length % MODEL_ALIGNMENT)
+                          % MODEL_ALIGNMENT;
+  if ((length > 0 && fwrite (bytes, 1, length, fp) != length)
+      || (padding_length > 0
+          && fwrite (padding, 1, padding_length, fp) != padding_length))
+  {
+    return false;
+  }
+  *offset += length + padding_length;
+  return true;
+}
+static bool valid_section (const ModelHeader *header, uint64_t offset,
+                           uint64_t length)
+{
+  return offset % MODEL_ALIGNMENT == 0 && offset >= sizeof (ModelHeader)
+         && offset <= header->file_length
+         && length <= header->file_length - offset;
+}
+static bool valid_model (const CompiledChain *compiled,
+                         const uint64_t *data_offsets, const char *data,
+                         uint64_t data_length)
+{
+  if (compiled->row_offsets[0] != 0
+      || compiled->row_offsets[compiled->num_states] != compiled->num_edges
+      || data_offsets[compiled->num_states] > data_length)
+  {
+    return false;
+  }
+  for (uint32_t id = 0; id < compiled->num_states; id++)
+  {
+    if (compiled->row_offsets[id] > compiled->row_offsets[id + 1]
+        || data_offsets[id] > data_offsets[id + 1])
+    {
+      return false;
+    }
+    // the data is read as a string, so it must end inside its range (the
+    // padding after it is zeros)
+    const char *begin = data + data_offsets[id];
+    size_t length = (size_t) (data_offsets[id + 1] - data_offsets[id]);
+    if (length == 0 || begin[0] == '\0'
+        || memchr (begin, '\0', length) == NULL)
+    {
+      return false;
+    }
+    // the row total must fit the 32 bit samplers
+    uint64_t total = 0;
+    for (uint32_t i = compiled->row_offsets[id];
+         i < compiled->row_offsets[id + 1]; i++)
+    {
+      total += compiled->weights[i];
+      if (compiled->successor_ids[i] >= compiled->num_states
+          || compiled->weights[i] == 0 || total > UINT32_MAX)
+      {
+        return false;
+      }
+    }
+  }
+  for (uint32_t i = 0; i < compiled->num_starts; i++)
+  {
+    if (compiled->start_ids[i] >= compiled->num_states)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+void free_compiled_chain (CompiledChain **compiled)
+{
+  if (compiled == NULL || *compiled == NULL)
+  {
+    return;
+  }
+  if ((*compiled)->mapping != NULL)
+  {
+    // the arrays of a loaded chain point into its model file
+    munmap ((*compiled)->mapping, (*compiled)->mapping_length);
+  }
+  else
+  {
+    free ((*compiled)->row_offsets);
+    free ((*compiled)->successor_ids);
+    free ((*compiled)->weights);
+    free ((*compiled)->terminal);
+    free ((*compiled)->start_ids);
+  }
+  free ((*compiled)->row_totals);
+  free ((*compiled)->sampler);
+  free ((*compiled)->packed);
+  free ((*compiled)->packed_offsets);
+  free ((*compiled)->state_data);
+  free (*compiled);
+  *compiled = NULL;
+}
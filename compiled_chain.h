@@ -0,0 +1,178 @@
+#ifndef _COMPILED_CHAIN_H_
+#define _COMPILED_CHAIN_H_
+
+#include "markov_chain.h"
+
+// the first bytes of a model file
+#define MODEL_MAGIC "MKVCHAIN"
+#define MODEL_VERSION 1
+
+// passed as the first state to start from a random state
+#define COMPILED_RANDOM_START UINT32_MAX
+
+// the widths of the weights of a packed row, by the first byte of the row
+#define PACKED_WEIGHTS_8 0
+#define PACKED_WEIGHTS_16 1
+#define PACKED_WEIGHTS_32 2
+
+/**
+ * a read only MarkovChain flattened to compressed sparse row arrays. the
+ * successors of state i are successor_ids[row_offsets[i]] up to
+ * successor_ids[row_offsets[i + 1]], so generating walks contiguous memory
+ * instead of chasing the pointers of the chain.
+ */
+typedef struct CompiledChain
+{
+    uint32_t num_states;
+    uint32_t num_edges;
+    uint32_t *row_offsets;// num_states + 1 offsets into the edge arrays
+    uint32_t *successor_ids;// the successor state of every edge
+    uint32_t *weights;// the frequency of every edge
+    uint32_t *row_totals;// the sum of the weights of every state
+    uint32_t *sampler;// for SAMPLER_ALIAS the thresholds of all the edges
+    // followed by their aliases (relative to the row), for
+    // SAMPLER_CUMULATIVE the cumulative weights within the row.
+    SamplerKind sampler_kind;
+    uint8_t *terminal;// 1 if the state is a last state, 0 otherwise
+    uint32_t *start_ids;// the states a walk can start from, a state may
+    // appear more than once when starts are weighted
+    uint32_t num_starts;
+    void **state_data;// the data of every state, owned by the source chain
+    // (the chain can be freed if its free_data doesn't free the data)
+    format_func_ptr format_func;
+    void *mapping;// the mapped model file a loaded chain points into, NULL
+    // if the arrays are allocated
+    size_t mapping_length;
+    uint8_t *packed;// the successors of all the rows packed by
+    // pack_compiled_chain, NULL if the chain is not packed. a row starts
+    // with the PACKED_WEIGHTS_* width of its weights, followed by every
+    // successor in increasing id order as a varint of its id (the first)
+    // or of its distance from the previous id minus 1 (the rest), then
+    // its weight in that width.
+    uint32_t *packed_offsets;// num_states + 1 offsets of the rows into
+    // packed
+} CompiledChain;
+
+/**
+ * Flatten a trained chain into a CompiledChain. the state ids are the ids
+ * of the chain.
+ * @param markov_chain the chain to compile, it is not changed
+ * @param kind the kind of sampler to build for every state
+ * @return a pointer to the new compiled chain, NULL if allocation failed.
+ * @attention the compiled chain must be freed with free_compiled_chain.
+ */
+CompiledChain *compile_markov_chain (const MarkovChain *markov_chain,
+                                     SamplerKind kind);
+
+/**
+ * Pack the successors of a compiled chain into the variable length rows of
+ * packed, and free its successor ids, weights and samplers. most ids are
+ * close to the previous one and most weights are small, so a successor
+ * takes 2 or 3 bytes instead of the 12 to 16 of the arrays. the rows are
+ * decoded on the fly by compiled_next_random_state, which scans the row
+ * instead of sampling in O(1): the distribution is the same, the walks of
+ * a seed are not. a packed chain can't be saved.
+ * @param compiled a compiled or loaded chain that is not packed
+ * @return true on success, false in case of allocation error or if the
+ * rows don't fit 32 bit offsets (the chain is not changed then).
+ */
+bool pack_compiled_chain (CompiledChain *compiled);
+
+/**
+ * Get the number of bytes the arrays of a compiled chain take in memory,
+ * without the data of the states. the arrays a loaded chain maps from its
+ * model file are not counted.
+ * @param compiled
+ * @return the number of bytes
+ */
+size_t compiled_chain_bytes (const CompiledChain *compiled);
+
+/**
+ * Choose a random state to start a walk from in O(1), with the same weights
+ * get_first_random_node of the source chain uses.
+ * @param compiled
+ * @param rng the generator to draw from
+ * @return the id of the state
+ */
+uint32_t compiled_first_random_state (const CompiledChain *compiled,
+                                      Rng *rng);
+
+/**
+ * Choose randomly the next state, depend on it's occurrence frequency. a
+ * packed row is decoded until the chosen successor, in O(successors).
+ * @param compiled
+ * @param state the id of a state with successors
+ * @param rng the generator to draw from
+ * @return the id of the chosen state
+ */
+uint32_t compiled_next_random_state (const CompiledChain *compiled,
+                                     uint32_t state, Rng *rng);
+
+/**
+ * Generate a random walk like generate_tweet, but store the states of the
+ * walk instead of printing them. only reads the compiled chain, so any
+ * number of threads can walk it at once with their own generators.
+ * @param compiled
+ * @param first_state the state to start from, or COMPILED_RANDOM_START to
+ * choose a random one
+ * @param max_length maximum length of walk to generate
+ * @param rng the generator to draw from
+ * @param states out parameter, room for max_length state ids
+ * @return the number of states in the walk
+ */
+int compiled_walk (const CompiledChain *compiled, uint32_t first_state,
+                   int max_length, Rng *rng, uint32_t *states);
+
+/**
+ * Append the formatted states of a walk to a byte buffer, with the
+ * format_func of the source chain.
+ * @param compiled
+ * @param states the ids of the states of the walk
+ * @param length the number of states in the walk
+ * @param text the buffer to append to
+ * @return true on success, false if the buffer failed to grow or the
+ * source chain had no format_func.
+ */
+bool format_compiled_walk (const CompiledChain *compiled,
+                           const uint32_t *states, int length,
+                           ByteBuffer *text);
+
+/**
+ * Write a compiled chain to a binary model file: a header with the magic,
+ * the version, the sizes and the file offset of every section, then the
+ * row offsets, successor ids, weights, terminal flags, start ids, the
+ * offset of the data of every state, and the data of the states. every
+ * section starts 8 byte aligned and is in the byte order of the machine,
+ * so the file can be mapped and its arrays used in place.
+ * @param compiled a chain that is not packed
+ * @param size_func returns the number of bytes of the data of a state, for
+ * example strlen + 1 for strings
+ * @param path
+ * @return true on success, false if the file could not be written or the
+ * chain is packed.
+ */
+bool save_compiled_chain (const CompiledChain *compiled,
+                          size_func_ptr size_func, const char *path);
+
+/**
+ * Load a model file written by save_compiled_chain. the file is mapped to
+ * memory and the arrays and data of the chain point into it, only the
+ * samplers are built.
+ * @param path
+ * @param kind the kind of sampler to build for every state
+ * @param format_func formats the data of a state as saved, may be NULL
+ * @return a pointer to the loaded chain, NULL if the file could not be
+ * read, is not a valid model of this version, or allocation failed.
+ * @attention the chain must be freed with free_compiled_chain, which unmaps
+ * the file.
+ */
+CompiledChain *load_compiled_chain (const char *path, SamplerKind kind,
+                                    format_func_ptr format_func);
+
+/**
+ * Free a compiled chain.
+ * @param compiled
+ */
+void free_compiled_chain (CompiledChain **compiled);
+
+#endif //_COMPILED_CHAIN_H_
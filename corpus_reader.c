@@ -0,0 +1,304 @@
+#define _POSIX_C_SOURCE 200809L
+#include "corpus_reader.h"
+#include <string.h> // For memmove()
+#include <sys/mman.h> // For mmap(), posix_madvise()
+#include <sys/stat.h> // For fstat()
+#include <pthread.h>
+
+/**
+ * the bytes that separate tokens: spaces and line breaks.
+ */
+static const bool is_delimiter[256] = {[' '] = true, ['\n'] = true,
+                                       ['\r'] = true};
+
+/**
+ * a byte range of the corpus, tokenized by one thread.
+ */
+typedef struct CorpusShard
+{
+    const char *bytes;
+    size_t length;
+    token_func_ptr on_token;
+    void *context;
+} CorpusShard;
+
+/**
+ * pass the tokens of bytes to on_token.
+ * @param bytes
+ * @param length
+ * @param is_end true if bytes ends the corpus, else the last token is not
+ * passed if it touches the end of bytes, since it may go on in the next
+ * chunk.
+ * @param on_token
+ * @param context
+ * @param stopped set to true if on_token returned false
+ * @return the number of bytes consumed, the rest starts an unfinished token.
+ */
+static size_t tokenize (const char *bytes, size_t length, bool is_end,
+                        token_func_ptr on_token, void *context,
+                        bool *stopped);
+/**
+ * tokenize a regular file by mapping it to memory.
+ * @param fp
+ * @param on_token
+ * @param context
+ * @param mapped set to false if the file could not be mapped and nothing
+ * was read
+ * @return 0 on success, 1 else.
+ */
+static int read_mapped (FILE *fp, token_func_ptr on_token, void *context,
+                        bool *mapped);
+/**
+ * tokenize a stream chunk by chunk. a token that crosses the end of a chunk
+ * is moved to the start of the buffer and completed by the next chunk.
+ * @param fp
+ * @param on_token
+ * @param context
+ * @return 0 on success, 1 else.
+ */
+static int read_streamed (FILE *fp, token_func_ptr on_token, void *context);
+
+/**
+ * map a regular file to memory, or read a stream whole into memory.
+ * @param fp
+ * @param length out parameter, the length of the corpus
+ * @param mapped out parameter, true if the bytes are mapped and must be
+ * unmapped, false if they must be freed
+ * @return the bytes of the corpus, NULL if reading failed or in case of
+ * allocation error. an empty corpus may be a non NULL pointer to 0 bytes.
+ */
+static char *load_corpus (FILE *fp, size_t *length, bool *mapped);
+/**
+ * tokenize a shard. the start routine of the shard threads.
+ * @param arg the CorpusShard
+ * @return NULL
+ */
+static void *read_shard (void *arg);
+
+// see all documentation in the header file
+int read_corpus (FILE *fp, token_func_ptr on_token, void *context)
+{
+  bool mapped = false;
+  int result = read_mapped (fp, on_token, context, &mapped);
+  if (mapped)
+  {
+    return result;
+  }
+  return read_streamed (fp, on_token, context);
+}
+static size_t tokenize (const char *bytes, size_t length, bool is_end,
+                        token_func_ptr on_token, void *context,
+                        bool *stopped)
+{
+  size_t i = 0;
+  while (i < length)
+  {
+    while (i < length && is_delimiter[(unsigned char) bytes[i]])
+    {
+      i++;
+    }
+    size_t start = i;
+    while (i < length && !is_delimiter[(unsigned char) bytes[i]])
+    {
+      i++;
+    }
+    if (i == start)
+    {
+      break;
+    }
+    if (i == length && !is_end)
+    {
+      return start;
+    }
+    if (!on_token (bytes + start, i - start, context))
+    {
+      *stopped = true;
+      return i;
+    }
+  }
+  return i;
+}
+static int read_mapped (FILE *fp, token_func_ptr on_token, void *context,
+                        bool *mapped)
+{
+  struct stat info;
+  *mapped = false;
+  if (fstat (fileno (fp), &info) != 0 || !S_ISREG (info.st_mode)
+      || info.st_size == 0)
+  {
+    return 1;
+  }
+  size_t length = (size_t) info.st_size;
+  void *bytes = mmap (NULL, length, PROT_READ, MAP_PRIVATE, fileno (fp), 0);
+  if (bytes == MAP_FAILED)
+  {
+    return 1;
+  }
+  *mapped = true;
+  // the corpus is read once front to back, let the kernel read ahead
+  posix_madvise (bytes, length, POSIX_MADV_SEQUENTIAL);
+  bool stopped = false;
+  tokenize ((const char *) bytes, length, true, on_token, context, &stopped);
+  munmap (bytes, length);
+  return 0;
+}
+static int read_streamed (FILE *fp, token_func_ptr on_token, void *context)
+{
+  size_t capacity = CORPUS_CHUNK_SIZE;
+  char *buffer = malloc (capacity);
+  if (buffer == NULL)
+  {
+    return 1;
+  }
+  size_t carried = 0;// the bytes of an unfinished token at the buffer start
+  bool stopped = false;
+  while (!stopped)
+  {
+    if (capacity - carried < CORPUS_CHUNK_SIZE / 2)
+    {
+      // a token longer than the buffer, make room for the rest of it
+      char *new_buffer = realloc (buffer, capacity * 2);
+      if (new_buffer == NULL)
+      {
+        free (buffer);
+        return 1;
+      }
+      buffer = new_buffer;
+      capacity *= 2;
+    }
+    size_t read = fread (buffer + carried, 1, capacity - carried, fp);
+    bool is_end = read < capacity - carried;
+    if (is_end && ferror (fp))
+    {
+      free (buffer);
+      return 1;
+    }
+    size_t length = carried + read;
+    size_t consumed = tokenize (buffer, length, is_end, on_token, context,
+                                &stopped);
+    if (is_end)
+    {
+      break;
+    }
+    carried = length - consumed;
+    memmove (buffer, buffer + consumed, carried);
+  }
+  free (buffer);
+  return 0;
+}
+int read_corpus_shards (FILE *fp, int shards, token_func_ptr on_token,
+                        void **contexts)
+{
+  size_t length = 0;
+  bool mapped = false;
+  char *bytes = load_corpus (fp, &length, &mapped);
+  CorpusShard *ranges = malloc (shards * sizeof (CorpusShard));
+  pthread_t *workers = malloc (shards * sizeof (pthread_t));
+  bool *started = malloc (shards * sizeof (bool));
+  int result = 0;
+  if (bytes == NULL || ranges == NULL || workers == NULL || started == NULL)
+  {
+    result = 1;
+    shards = 0;
+  }
+  size_t begin = 0;
+  for (int i = 0; i < shards; i++)
+  {
+    size_t end = (size_t) ((unsigned long long) length * (i + 1) / shards);
+    if (end < begin)
+    {
+      end = begin;
+    }
+    // move the end past the token it falls in, so no token is split
+    while (end < length && !is_delimiter[(unsigned char) bytes[end]])
+    {
+      end++;
+    }
+    ranges[i] = (CorpusShard) {bytes + begin, end - begin, on_token,
+                               contexts[i]};
+    begin = end;
+  }
+  // the calling thread reads shard 0, and any shard whose thread could not
+  // be started
+  for (int i = 0; i < shards; i++)
+  {
+    started[i] = i > 0 && pthread_create (&workers[i], NULL, read_shard,
+                                          &ranges[i]) == 0;
+  }
+  for (int i = 0; i < shards; i++)
+  {
+    if (!started[i])
+    {
+      read_shard (&ranges[i]);
+    }
+  }
+  for (int i = 1; i < shards; i++)
+  {
+    if (started[i])
+    {
+      pthread_join (workers[i], NULL);
+    }
+  }
+  if (mapped)
+  {
+    munmap (bytes, length);
+  }
+  else
+  {
+    free (bytes);
+  }
+  free (ranges);
+  free (workers);
+  free (started);
+  return result;
+}
+static void *read_shard (void *arg)
+{
+  CorpusShard *shard = (CorpusShard *) arg;
+  bool stopped = false;
+  tokenize (shard->bytes, shard->length, true, shard->on_token,
+            shard->context, &stopped);
+  return NULL;
+}
+static char *load_corpus (FILE *fp, size_t *length, bool *mapped)
+{
+  struct stat info;
+  *mapped = false;
+  if (fstat (fileno (fp), &info) == 0 && S_ISREG (info.st_mode)
+      && info.st_size > 0)
+  {
+    void *bytes = mmap (NULL, (size_t) info.st_size, PROT_READ, MAP_PRIVATE,
+                        fileno (fp), 0);
+    if (bytes != MAP_FAILED)
+    {
+      *mapped = true;
+      *length = (size_t) info.st_size;
+      return (char *) bytes;
+    }
+  }
+  size_t capacity = CORPUS_CHUNK_SIZE;
+  char *bytes = malloc (capacity);
+  *length = 0;
+  while (bytes != NULL)
+  {
+    *length += fread (bytes + *length, 1, capacity - *length, fp);
+    if (*length < capacity)
+    {
+      break;
+    }
+    char *new_bytes = realloc (bytes, capacity * 2);
+    if (new_bytes == NULL)
+    {
+      free (bytes);
+      return NULL;
+    }
+    bytes = new_bytes;
+    capacity *= 2;
+  }
+  if (bytes != NULL && ferror (fp))
+  {
+    free (bytes);
+    return NULL;
+  }
+  return bytes;
+}
@@ -0,0 +1,45 @@
+#ifndef _CORPUS_READER_H_
+#define _CORPUS_READER_H_
+#include <stdio.h> // For FILE
+#include <stdlib.h> // For size_t
+#include <stdbool.h> // for bool
+
+#define CORPUS_CHUNK_SIZE (1 << 20)
+
+// Define a typedef for a function pointer that receives a token of the
+// corpus, its length and the context given to read_corpus
+// The token is not '\0' terminated and is valid only during the call
+// The function returns false to stop reading
+typedef bool (*token_func_ptr) (const char *, size_t, void *);
+
+/**
+ * Split a corpus into tokens separated by spaces and line breaks and pass
+ * them in order to on_token, until the corpus ends or on_token returns false.
+ * a regular file is memory mapped and tokenized in place, other streams
+ * (or a file that fails to map) are read in chunks of CORPUS_CHUNK_SIZE
+ * bytes, so no line length limit applies either way.
+ * @param fp the corpus, read from its start
+ * @param on_token
+ * @param context passed to on_token as is
+ * @return 0 on success, 1 if reading failed or in case of allocation error.
+ */
+int read_corpus (FILE *fp, token_func_ptr on_token, void *context);
+
+/**
+ * Split a corpus into shards and tokenize every shard on its own thread
+ * like read_corpus, shard i passing its tokens to on_token with
+ * contexts[i]. the shards are byte ranges of about the same length that
+ * start and end at a separator, so every token is in exactly one shard and
+ * shard i holds the tokens that come before those of shard i+1. the
+ * corpus is memory mapped, or read whole into memory if it can't be.
+ * @param fp the corpus, read from its start
+ * @param shards the number of shards and threads, positive
+ * @param on_token must be safe to call from several threads with different
+ * contexts
+ * @param contexts the context of every shard
+ * @return 0 on success, 1 if reading failed or in case of allocation error.
+ */
+int read_corpus_shards (FILE *fp, int shards, token_func_ptr on_token,
+                        void **contexts);
+
+#endif //_CORPUS_READER_H_
@@ -0,0 +1,149 @@
+#include "dedupe_filter.h"
+#include <math.h> // For exp()
+#define FNV_PRIME 0x100000001b3ULL
+// the byte hashed between two words, so "a bc" and "ab c" differ
+#define WORD_SEPARATOR ' '
+
+/**
+ * the smallest power of 2 that is at least a number.
+ * @param number
+ * @return the power of 2
+ */
+static uint64_t power_of_two_at_least (uint64_t number);
+
+// see all documentation in the header file
+static uint64_t power_of_two_at_least (uint64_t number)
+{
+  uint64_t power = 1;
+  while (power < number)
+  {
+    power *= 2;
+  }
+  return power;
+}
+uint64_t dedupe_hash_word (uint64_t hash, const char *word, size_t length)
+{
+  if (hash != DEDUPE_HASH_EMPTY)
+  {
+    hash ^= (unsigned char) WORD_SEPARATOR;
+    hash *= FNV_PRIME;
+  }
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= (unsigned char) word[i];
+    hash *= FNV_PRIME;
+  }
+  return hash;
+}
+uint64_t dedupe_hash_finish (uint64_t hash)
+{
+  // the finalizer of splitmix64
+  hash ^= hash >> 30;
+  hash *= 0xbf58476d1ce4e5b9ULL;
+  hash ^= hash >> 27;
+  hash *= 0x94d049bb133111ebULL;
+  hash ^= hash >> 31;
+  return hash;
+}
+bool bloom_filter_init (BloomFilter *filter, size_t expected_items)
+{
+  // at least one word of bits
+  filter->num_bits = power_of_two_at_least
+      ((uint64_t) expected_items * BLOOM_BITS_PER_ITEM + 64);
+  filter->items = 0;
+  filter->bits = calloc (filter->num_bits / 64, sizeof (uint64_t));
+  return filter->bits != NULL;
+}
+void bloom_filter_add (BloomFilter *filter, uint64_t hash)
+{
+  // the bits of a hash are h1 + i * h2 for i < BLOOM_HASHES, h2 odd so the
+  // bits differ
+  uint64_t mask = filter->num_bits - 1;
+  uint64_t h1 = hash;
+  uint64_t h2 = (hash >> 32 | hash << 32) | 1;
+  for (int i = 0; i < BLOOM_HASHES; i++)
+  {
+    uint64_t bit = (h1 + (uint64_t) i * h2) & mask;
+    filter->bits[bit / 64] |= 1ULL << (bit % 64);
+  }
+  filter->items++;
+}
+bool bloom_filter_contains (const BloomFilter *filter, uint64_t hash)
+{
+  uint64_t mask = filter->num_bits - 1;
+  uint64_t h1 = hash;
+  uint64_t h2 = (hash >> 32 | hash << 32) | 1;
+  for (int i = 0; i < BLOOM_HASHES; i++)
+  {
+    uint64_t bit = (h1 + (uint64_t) i * h2) & mask;
+    if ((filter->bits[bit / 64] & (1ULL << (bit % 64))) == 0)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+double bloom_filter_false_positive_rate (const BloomFilter *filter)
+{
+  double unset = exp (-(double) BLOOM_HASHES * (double) filter->items
+                      / (double) filter->num_bits);
+  return pow (1 - unset, BLOOM_HASHES);
+}
+void bloom_filter_free (BloomFilter *filter)
+{
+  free (filter->bits);
+  filter->bits = NULL;
+  filter->num_bits = 0;
+  filter->items = 0;
+}
+bool hash_set_init (HashSet *set, size_t max_size)
+{
+  // the load factor of a full set is at most 1/2
+  set->capacity = (size_t) power_of_two_at_least ((uint64_t) max_size * 2
+                                                  + 1);
+  set->size = 0;
+  set->max_size = max_size;
+  set->slots = calloc (set->capacity, sizeof (uint64_t));
+  return set->slots != NULL;
+}
+bool hash_set_contains (const HashSet *set, uint64_t hash)
+{
+  hash = (hash == 0) ? 1 : hash;
+  size_t mask = set->capacity - 1;
+  for (size_t i = (size_t) hash & mask; set->slots[i] != 0;
+       i = (i + 1) & mask)
+  {
+    if (set->slots[i] == hash)
+    {
+      return true;
+    }
+  }
+  return false;
+}
+bool hash_set_insert (HashSet *set, uint64_t hash)
+{
+  hash = (hash == 0) ? 1 : hash;
+  size_t mask = set->capacity - 1;
+  size_t i = (size_t) hash & mask;
+  for (; set->slots[i] != 0; i = (i + 1) & mask)
+  {
+    if (set->slots[i] == hash)
+    {
+      return true;
+    }
+  }
+  if (set->size == set->max_size)
+  {
+    return false;
+  }
+  set->slots[i] = hash;
+  set->size++;
+  return true;
+}
+void hash_set_free (HashSet *set)
+{
+  free (set->slots);
+  set->slots = NULL;
+  set->capacity = 0;
+  set->size = 0;
+}
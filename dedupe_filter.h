@@ -0,0 +1,124 @@
+#ifndef _DEDUPE_FILTER_H_
+#define _DEDUPE_FILTER_H_
+#include <stdlib.h> // For malloc(), size_t
+#include <stdint.h> // For uint64_t
+#include <stdbool.h> // for bool
+
+// the bits of a Bloom filter per item it was sized for, and the number of
+// bits an item sets. 10 bits and 7 hashes give about 1% false positives.
+#define BLOOM_BITS_PER_ITEM 10
+#define BLOOM_HASHES 7
+// the hash of an empty sequence of words
+#define DEDUPE_HASH_EMPTY 0xcbf29ce484222325ULL
+
+/**
+ * a Bloom filter of 64 bit hashes: a hash that was added is always found,
+ * one that was not is found with a small probability.
+ */
+typedef struct BloomFilter
+{
+    uint64_t *bits;// num_bits bits, 64 in a word
+    uint64_t num_bits;// always a power of 2
+    uint64_t items;// the number of hashes added
+} BloomFilter;
+
+/**
+ * an open addressing set of 64 bit hashes that holds up to a fixed number
+ * of them, so its memory is bounded from the start.
+ */
+typedef struct HashSet
+{
+    uint64_t *slots;// 0 if empty, the hash 0 is kept as 1
+    size_t capacity;// always a power of 2
+    size_t size;// the number of hashes in the set
+    size_t max_size;// the set is full with this many hashes
+} HashSet;
+
+/**
+ * Add a word to the hash of a sequence of words. the hash of a sequence
+ * starts as DEDUPE_HASH_EMPTY and is finished with dedupe_hash_finish.
+ * @param hash the hash of the words before it
+ * @param word the bytes of the word, doesn't have to be '\0' terminated
+ * @param length the number of bytes in word
+ * @return the hash of the sequence with the word
+ */
+uint64_t dedupe_hash_word (uint64_t hash, const char *word, size_t length);
+
+/**
+ * Mix the bits of the hash of a sequence of words, so any part of it can
+ * index a filter.
+ * @param hash
+ * @return the finished hash
+ */
+uint64_t dedupe_hash_finish (uint64_t hash);
+
+/**
+ * Initialize a Bloom filter with BLOOM_BITS_PER_ITEM bits for every item
+ * it is expected to hold.
+ * @param filter
+ * @param expected_items
+ * @return true on success, false in case of allocation error.
+ */
+bool bloom_filter_init (BloomFilter *filter, size_t expected_items);
+
+/**
+ * Add a finished hash to a filter.
+ * @param filter
+ * @param hash
+ */
+void bloom_filter_add (BloomFilter *filter, uint64_t hash);
+
+/**
+ * Check if a finished hash may have been added to a filter.
+ * @param filter
+ * @param hash
+ * @return false if it was not added, true if it was or in case of a false
+ * positive.
+ */
+bool bloom_filter_contains (const BloomFilter *filter, uint64_t hash);
+
+/**
+ * Estimate the probability that a hash that was not added is found, from
+ * the number of hashes that were.
+ * @param filter
+ * @return the false positive rate
+ */
+double bloom_filter_false_positive_rate (const BloomFilter *filter);
+
+/**
+ * Free the bits of a filter, leaving it empty.
+ * @param filter
+ */
+void bloom_filter_free (BloomFilter *filter);
+
+/**
+ * Initialize an empty set that holds up to max_size hashes.
+ * @param set
+ * @param max_size
+ * @return true on success, false in case of allocation error.
+ */
+bool hash_set_init (HashSet *set, size_t max_size);
+
+/**
+ * Check if a hash is in a set.
+ * @param set
+ * @param hash
+ * @return true if it is, false otherwise.
+ */
+bool hash_set_contains (const HashSet *set, uint64_t hash);
+
+/**
+ * Add a hash to a set, if it is not there yet.
+ * @param set
+ * @param hash
+ * @return true if the hash is in the set, false if the set is full.
+ */
+bool hash_set_insert (HashSet *set, uint64_t hash);
+
+/**
+ * Free the slots of a set, leaving it empty.
+ * @param set
+ */
+void hash_set_free (HashSet *set);
+
+#endif //_DEDUPE_FILTER_H_
@@ -0,0 +1,78 @@
+#include "kgram.h"
+#include <string.h> // For memcpy(), memcmp(), memmove()
+
+// see all documentation in the header file
+bool kgram_window_init (KGramWindow *window, uint32_t max_order)
+{
+  window->max_order = max_order;
+  window->top_power = 1;
+  for (uint32_t i = 1; i < max_order; i++)
+  {
+    window->top_power *= KGRAM_HASH_BASE;
+  }
+  window->gram = malloc (sizeof (KGram) + max_order * sizeof (uint32_t));
+  if (window->gram == NULL)
+  {
+    return false;
+  }
+  kgram_window_reset (window);
+  return true;
+}
+void kgram_window_push (KGramWindow *window, uint32_t id)
+{
+  KGram *gram = window->gram;
+  // ids are hashed plus one, so a window never hashes like a shorter one
+  // padded with zeros
+  if (gram->order == window->max_order)
+  {
+    gram->hash -= (gram->ids[0] + 1ULL) * window->top_power;
+    memmove (gram->ids, gram->ids + 1, (gram->order - 1) * sizeof (uint32_t));
+    gram->order--;
+  }
+  gram->hash = gram->hash * KGRAM_HASH_BASE + id + 1ULL;
+  gram->ids[gram->order++] = id;
+}
+void kgram_window_reset (KGramWindow *window)
+{
+  window->gram->hash = 0;
+  window->gram->order = 0;
+}
+void kgram_window_free (KGramWindow *window)
+{
+  free (window->gram);
+  window->gram = NULL;
+}
+size_t kgram_hash (const void *data)
+{
+  // the polynomial hash is mixed, so its low bits depend on all the ids
+  uint64_t key = ((const KGram *) data)->hash;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (size_t) key;
+}
+int kgram_compare (const void *data1, const void *data2)
+{
+  const KGram *gram1 = (const KGram *) data1;
+  const KGram *gram2 = (const KGram *) data2;
+  if (gram1->hash != gram2->hash || gram1->order != gram2->order)
+  {
+    return (gram1->hash < gram2->hash
+            || (gram1->hash == gram2->hash && gram1->order < gram2->order))
+           ? -1 : 1;
+  }
+  return memcmp (gram1->ids, gram2->ids, gram1->order * sizeof (uint32_t));
+}
+size_t kgram_size (const KGram *gram)
+{
+  return sizeof (KGram) + gram->order * sizeof (uint32_t);
+}
+KGram *kgram_copy (const KGram *gram, Arena *arena)
+{
+  KGram *copy = arena_alloc (arena, kgram_size (gram));
+  if (copy != NULL)
+  {
+    memcpy (copy, gram, kgram_size (gram));
+  }
+  return copy;
+}
@@ -0,0 +1,90 @@
+#ifndef _KGRAM_H_
+#define _KGRAM_H_
+#include "arena.h"
+#include <stdlib.h> // For malloc(), size_t
+#include <stdint.h> // For uint32_t, uint64_t
+#include <stdbool.h> // for bool
+
+#define KGRAM_HASH_BASE 1099511628211ULL
+
+/**
+ * a state of an order-k chain: a window of up to k word ids, the last one
+ * being the word the state stands for. the window is identified by a
+ * polynomial hash of its ids, updated in O(1) as the window slides, so
+ * looking a state up never builds a string out of its words.
+ */
+typedef struct KGram
+{
+    uint64_t hash;// the polynomial hash of ids
+    uint32_t order;// the number of ids
+    uint32_t ids[];
+} KGram;
+
+/**
+ * the last words of a text, as the KGram of the current state.
+ */
+typedef struct KGramWindow
+{
+    uint32_t max_order;// k
+    uint64_t top_power;// KGRAM_HASH_BASE^(k - 1), to roll the oldest id out
+    KGram *gram;// room for k ids
+} KGramWindow;
+
+/**
+ * Create an empty window.
+ * @param window
+ * @param max_order the number of words in a full window, positive
+ * @return true on success, false in case of allocation error.
+ */
+bool kgram_window_init (KGramWindow *window, uint32_t max_order);
+
+/**
+ * Add a word to the window, dropping its oldest word if it is full.
+ * @param window
+ * @param id
+ */
+void kgram_window_push (KGramWindow *window, uint32_t id);
+
+/**
+ * Empty the window, so the next word starts a new one.
+ * @param window
+ */
+void kgram_window_reset (KGramWindow *window);
+
+/**
+ * Free the memory of a window.
+ * @param window
+ */
+void kgram_window_free (KGramWindow *window);
+
+/**
+ * Hash a KGram for the index of a chain. a hash_func_ptr.
+ * @param data the KGram
+ * @return the hash
+ */
+size_t kgram_hash (const void *data);
+
+/**
+ * Compare two KGrams by their ids. a cmp_func_ptr.
+ * @param data1
+ * @param data2
+ * @return 0 if equal, non zero else.
+ */
+int kgram_compare (const void *data1, const void *data2);
+
+/**
+ * The number of bytes of a KGram.
+ * @param gram
+ * @return the size of the struct and its ids
+ */
+size_t kgram_size (const KGram *gram);
+
+/**
+ * Copy a KGram into an arena.
+ * @param gram
+ * @param arena
+ * @return the copy, NULL in case of allocation error.
+ */
+KGram *kgram_copy (const KGram *gram, Arena *arena);
+
+#endif //_KGRAM_H_
@@ -21,4 +21,13 @@ typedef struct LinkedList {
  */
 int add (LinkedList *link_list, void *data);
 
+/**
+ * Link an already allocated node holding data at the end of the given link
+ * list. Lets the caller choose where the node memory comes from.
+ * @param link_list Link list to add the node to
+ * @param new_node the node to link
+ * @param data pointer to dynamically allocated data
+ */
+void append_node (LinkedList *link_list, Node *new_node, void *data);
+
 #endif //_LINKEDLIST_H_
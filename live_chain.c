@@ -0,0 +1,151 @@
+#include "live_chain.h"
+#include <string.h> // For memset()
+
+#define RETIRED_INITIAL_CAPACITY 8
+
+/**
+ * free the retired snapshots that no reader inside can be using.
+ * @param live
+ */
+static void reclaim_snapshots (LiveChain *live);
+
+// see all documentation in the header file
+LiveChain *live_chain_create (MarkovChain *markov_chain, SamplerKind kind)
+{
+  // the reader slots are cache line aligned, so the chain must be too
+  LiveChain *live = aligned_alloc (LIVE_CACHE_LINE, sizeof (LiveChain));
+  if (live == NULL)
+  {
+    return NULL;
+  }
+  memset (live, 0, sizeof (LiveChain));
+  CompiledChain *compiled = compile_markov_chain (markov_chain, kind);
+  if (compiled == NULL || pthread_mutex_init (&live->writer_lock, NULL) != 0)
+  {
+    free_compiled_chain (&compiled);
+    free (live);
+    return NULL;
+  }
+  live->markov_chain = markov_chain;
+  live->sampler_kind = kind;
+  atomic_init (&live->snapshot, compiled);
+  atomic_init (&live->epoch, LIVE_IDLE + 1);
+  for (int i = 0; i < LIVE_MAX_READERS; i++)
+  {
+    atomic_init (&live->readers[i].in_use, false);
+    atomic_init (&live->readers[i].epoch, LIVE_IDLE);
+  }
+  return live;
+}
+int live_chain_register_reader (LiveChain *live)
+{
+  for (int i = 0; i < LIVE_MAX_READERS; i++)
+  {
+    bool expected = false;
+    if (atomic_compare_exchange_strong (&live->readers[i].in_use, &expected,
+                                        true))
+    {
+      return i;
+    }
+  }
+  return -1;
+}
+void live_chain_unregister_reader (LiveChain *live, int reader)
+{
+  atomic_store (&live->readers[reader].in_use, false);
+}
+const CompiledChain *live_chain_enter (LiveChain *live, int reader)
+{
+  // the epoch is announced before the snapshot is read, so a writer that
+  // replaces the snapshot after this reads it sees the reader inside
+  atomic_store (&live->readers[reader].epoch, atomic_load (&live->epoch));
+  return atomic_load (&live->snapshot);
+}
+void live_chain_exit (LiveChain *live, int reader)
+{
+  atomic_store_explicit (&live->readers[reader].epoch, LIVE_IDLE,
+                         memory_order_release);
+}
+MarkovChain *live_chain_begin_update (LiveChain *live)
+{
+  pthread_mutex_lock (&live->writer_lock);
+  return live->markov_chain;
+}
+bool live_chain_publish (LiveChain *live)
+{
+  if (live->num_retired == live->retired_capacity)
+  {
+    size_t new_capacity = (live->retired_capacity == 0)
+                          ? RETIRED_INITIAL_CAPACITY
+                          : live->retired_capacity * 2;
+    RetiredSnapshot *new_retired = realloc
+        (live->retired, new_capacity * sizeof (RetiredSnapshot));
+    if (new_retired == NULL)
+    {
+      return false;
+    }
+    live->retired = new_retired;
+    live->retired_capacity = new_capacity;
+  }
+  CompiledChain *compiled = compile_markov_chain (live->markov_chain,
+                                                  live->sampler_kind);
+  if (compiled == NULL)
+  {
+    return false;
+  }
+  CompiledChain *old = atomic_exchange (&live->snapshot, compiled);
+  // readers that announce this epoch or a later one read the snapshot after
+  // the exchange
+  uint64_t epoch = atomic_fetch_add (&live->epoch, 1) + 1;
+  live->retired[live->num_retired++] = (RetiredSnapshot) {old, epoch};
+  reclaim_snapshots (live);
+  return true;
+}
+bool live_chain_end_update (LiveChain *live)
+{
+  bool published = live_chain_publish (live);
+  pthread_mutex_unlock (&live->writer_lock);
+  return published;
+}
+void live_chain_free (LiveChain **live)
+{
+  if (live == NULL || *live == NULL)
+  {
+    return;
+  }
+  for (size_t i = 0; i < (*live)->num_retired; i++)
+  {
+    free_compiled_chain (&(*live)->retired[i].compiled);
+  }
+  free ((*live)->retired);
+  CompiledChain *compiled = atomic_load (&(*live)->snapshot);
+  free_compiled_chain (&compiled);
+  pthread_mutex_destroy (&(*live)->writer_lock);
+  free (*live);
+  *live = NULL;
+}
+static void reclaim_snapshots (LiveChain *live)
+{
+  uint64_t oldest = UINT64_MAX;
+  for (int i = 0; i < LIVE_MAX_READERS; i++)
+  {
+    uint64_t epoch = atomic_load (&live->readers[i].epoch);
+    if (epoch != LIVE_IDLE && epoch < oldest)
+    {
+      oldest = epoch;
+    }
+  }
+  size_t kept = 0;
+  for (size_t i = 0; i < live->num_retired; i++)
+  {
+    if (live->retired[i].epoch <= oldest)
+    {
+      free_compiled_chain (&live->retired[i].compiled);
+    }
+    else
+    {
+      live->retired[kept++] = live->retired[i];
+    }
+  }
+  live->num_retired = kept;
+}
@@ -0,0 +1,128 @@
+#ifndef _LIVE_CHAIN_H_
+#define _LIVE_CHAIN_H_
+#include "compiled_chain.h"
+#include <pthread.h>
+#include <stdatomic.h>
+
+#define LIVE_MAX_READERS 64
+// the epoch of a reader that is not reading a snapshot
+#define LIVE_IDLE 0
+#define LIVE_CACHE_LINE 64
+
+/**
+ * a slot of a thread reading the snapshots of a live chain. the slot is on
+ * a cache line of its own since its reader writes it on every read.
+ */
+typedef struct LiveReader
+{
+    _Alignas (LIVE_CACHE_LINE) atomic_bool in_use;
+    _Atomic uint64_t epoch;// the epoch the reader entered at, LIVE_IDLE
+    // when it is outside
+} LiveReader;
+
+/**
+ * a snapshot that was replaced, waiting for the readers that may still use
+ * it to leave.
+ */
+typedef struct RetiredSnapshot
+{
+    CompiledChain *compiled;
+    uint64_t epoch;// readers that entered at this epoch or later got a
+    // newer snapshot
+} RetiredSnapshot;
+
+/**
+ * a chain that keeps learning while other threads generate from it. the
+ * readers generate from a compiled snapshot of the chain, which they get
+ * without locking. one writer at a time trains the chain itself and
+ * publishes a new snapshot by compiling it, the old snapshot is freed once
+ * every reader that could have seen it left (epoch based reclamation), so a
+ * reader never waits for the writer and never sees freed memory.
+ */
+typedef struct LiveChain
+{
+    MarkovChain *markov_chain;// not owned, changed only between
+    // live_chain_begin_update and live_chain_end_update
+    SamplerKind sampler_kind;
+    pthread_mutex_t writer_lock;
+    CompiledChain *_Atomic snapshot;// the latest published snapshot
+    _Atomic uint64_t epoch;// moves forward on every publication
+    LiveReader readers[LIVE_MAX_READERS];
+    RetiredSnapshot *retired;// guarded by writer_lock
+    size_t num_retired;
+    size_t retired_capacity;
+} LiveChain;
+
+/**
+ * Create a live chain over a trained chain and publish its first snapshot.
+ * @param markov_chain the chain to train and generate from. its data must
+ * stay valid and in place while the chain learns, since snapshots point to
+ * it
+ * @param kind the kind of sampler of the snapshots
+ * @return a pointer to the live chain, NULL in case of allocation error.
+ * @attention the live chain must be freed with live_chain_free, the chain
+ * is not freed with it.
+ */
+LiveChain *live_chain_create (MarkovChain *markov_chain, SamplerKind kind);
+
+/**
+ * Take a reader slot for the calling thread.
+ * @param live
+ * @return the slot, -1 if all LIVE_MAX_READERS slots are taken.
+ */
+int live_chain_register_reader (LiveChain *live);
+
+/**
+ * Give a reader slot back. the reader must be outside.
+ * @param live
+ * @param reader
+ */
+void live_chain_unregister_reader (LiveChain *live, int reader);
+
+/**
+ * Get the latest snapshot to read from, without blocking. the snapshot
+ * stays valid until live_chain_exit with the same slot.
+ * @param live
+ * @param reader the slot of the calling thread
+ * @return the snapshot
+ */
+const CompiledChain *live_chain_enter (LiveChain *live, int reader);
+
+/**
+ * Stop using the snapshot of the last live_chain_enter.
+ * @param live
+ * @param reader the slot of the calling thread
+ */
+void live_chain_exit (LiveChain *live, int reader);
+
+/**
+ * Lock the chain for training, waiting for any other writer.
+ * @param live
+ * @return the chain, to add states and transitions to.
+ */
+MarkovChain *live_chain_begin_update (LiveChain *live);
+
+/**
+ * Compile the chain as trained so far and make it the snapshot of new
+ * readers. snapshots no reader can see anymore are freed. must be called
+ * between live_chain_begin_update and live_chain_end_update.
+ * @param live
+ * @return true on success, false in case of allocation error, in which
+ * case the previous snapshot stays published.
+ */
+bool live_chain_publish (LiveChain *live);
+
+/**
+ * Publish the trained chain and unlock it for the next writer.
+ * @param live
+ * @return the result of the publication.
+ */
+bool live_chain_end_update (LiveChain *live);
+
+/**
+ * Free a live chain and all its snapshots. no reader may be inside.
+ * @param live
+ */
+void live_chain_free (LiveChain **live);
+
+#endif //_LIVE_CHAIN_H_
@@ -0,0 +1,297 @@
+#include "markov_analysis.h"
+#include <string.h> // For memset()
+
+/**
+ * order the states so every state comes after the states it leads to,
+ * except along the edges that close a cycle: the post order of a depth
+ * first search, kept on an explicit stack so long chains don't overflow
+ * the call stack.
+ * @param matrix
+ * @param order out parameter, the num_states ids in post order
+ * @return true on success, false in case of allocation error.
+ */
+static bool post_order_states (const MarkovMatrix *matrix, uint32_t *order);
+
+// see all documentation in the header file
+static bool post_order_states (const MarkovMatrix *matrix, uint32_t *order)
+{
+  uint32_t num_states = matrix->num_states;
+  uint8_t *visited = calloc ((size_t) num_states + 1, sizeof (uint8_t));
+  uint32_t *stack = malloc (((size_t) num_states + 1) * sizeof (uint32_t));
+  // the next entry of the row of every state on the stack to follow
+  uint32_t *next_entry = malloc (((size_t) num_states + 1)
+                                 * sizeof (uint32_t));
+  if (visited == NULL || stack == NULL || next_entry == NULL)
+  {
+    free (visited);
+    free (stack);
+    free (next_entry);
+    return false;
+  }
+  uint32_t ordered = 0;
+  for (uint32_t root = 0; root < num_states; root++)
+  {
+    if (visited[root])
+    {
+      continue;
+    }
+    uint32_t depth = 0;
+    stack[depth++] = root;
+    visited[root] = 1;
+    next_entry[root] = matrix->row_offsets[root];
+    while (depth > 0)
+    {
+      uint32_t id = stack[depth - 1];
+      if (next_entry[id] == matrix->row_offsets[id + 1])
+      {
+        order[ordered++] = id;
+        depth--;
+        continue;
+      }
+      uint32_t successor = matrix->columns[next_entry[id]++];
+      if (!visited[successor])
+      {
+        visited[successor] = 1;
+        next_entry[successor] = matrix->row_offsets[successor];
+        stack[depth++] = successor;
+      }
+    }
+  }
+  free (visited);
+  free (stack);
+  free (next_entry);
+  return true;
+}
+bool build_markov_matrix (const MarkovChain *markov_chain,
+                          MarkovMatrix *matrix)
+{
+  uint32_t num_states = 0;
+  if (markov_chain->database != NULL)
+  {
+    num_states = (uint32_t) markov_chain->database->size;
+  }
+  uint32_t num_entries = 0;
+  for (uint32_t id = 0; id < num_states; id++)
+  {
+    if (!markov_chain->is_last (markov_chain->states[id]->data))
+    {
+      num_entries += (uint32_t) markov_chain->states[id]
+          ->current_successive_nodes;
+    }
+  }
+  matrix->num_states = num_states;
+  // one extra element keeps malloc from getting 0 for an empty chain
+  matrix->row_offsets = malloc ((num_states + 1) * sizeof (uint32_t));
+  matrix->columns = malloc ((num_entries + 1) * sizeof (uint32_t));
+  matrix->probabilities = malloc ((num_entries + 1) * sizeof (double));
+  matrix->absorbing = malloc ((num_states + 1) * sizeof (uint8_t));
+  if (matrix->row_offsets == NULL || matrix->columns == NULL
+      || matrix->probabilities == NULL || matrix->absorbing == NULL)
+  {
+    free_markov_matrix (matrix);
+    return false;
+  }
+  uint32_t entry = 0;
+  for (uint32_t id = 0; id < num_states; id++)
+  {
+    const MarkovNode *node = markov_chain->states[id];
+    matrix->row_offsets[id] = entry;
+    matrix->absorbing[id] = markov_chain->is_last (node->data) ? 1 : 0;
+    if (matrix->absorbing[id])
+    {
+      continue;
+    }
+    for (int i = 0; i < node->current_successive_nodes; i++, entry++)
+    {
+      matrix->columns[entry] = node->frequencies_list[i].next_id;
+      matrix->probabilities[entry] = (double) node->frequencies_list[i]
+          .frequency / (double) node->total_occurrences;
+    }
+  }
+  matrix->row_offsets[num_states] = entry;
+  return true;
+}
+bool build_compiled_matrix (const CompiledChain *compiled,
+                            MarkovMatrix *matrix)
+{
+  uint32_t num_states = compiled->num_states;
+  uint32_t num_entries = compiled->num_edges;
+  matrix->num_states = num_states;
+  matrix->row_offsets = malloc ((num_states + 1) * sizeof (uint32_t));
+  matrix->columns = malloc ((num_entries + 1) * sizeof (uint32_t));
+  matrix->probabilities = malloc ((num_entries + 1) * sizeof (double));
+  matrix->absorbing = malloc ((num_states + 1) * sizeof (uint8_t));
+  if (matrix->row_offsets == NULL || matrix->columns == NULL
+      || matrix->probabilities == NULL || matrix->absorbing == NULL)
+  {
+    free_markov_matrix (matrix);
+    return false;
+  }
+  uint32_t entry = 0;
+  for (uint32_t id = 0; id < num_states; id++)
+  {
+    matrix->row_offsets[id] = entry;
+    matrix->absorbing[id] = compiled->terminal[id];
+    if (matrix->absorbing[id])
+    {
+      continue;
+    }
+    for (uint32_t i = compiled->row_offsets[id];
+         i < compiled->row_offsets[id + 1]; i++, entry++)
+    {
+      matrix->columns[entry] = compiled->successor_ids[i];
+      matrix->probabilities[entry] = (double) compiled->weights[i]
+                                     / (double) compiled->row_totals[id];
+    }
+  }
+  matrix->row_offsets[num_states] = entry;
+  return true;
+}
+int expected_steps_to_absorption (const MarkovMatrix *matrix,
+                                  double *expected)
+{
+  memset (expected, 0, matrix->num_states * sizeof (double));
+  uint32_t *order = malloc (((size_t) matrix->num_states + 1)
+                            * sizeof (uint32_t));
+  if (order == NULL || !post_order_states (matrix, order))
+  {
+    free (order);
+    return ANALYSIS_ALLOCATION_ERROR;
+  }
+  int sweeps = -1;
+  bool stuck = false;// a state leads only back to itself
+  for (int sweep = 1; sweep <= ANALYSIS_MAX_SWEEPS && sweeps == -1 && !stuck;
+       sweep++)
+  {
+    double largest_change = 0;
+    for (uint32_t position = 0; position < matrix->num_states && !stuck;
+         position++)
+    {
+      uint32_t id = order[position];
+      uint32_t begin = matrix->row_offsets[id];
+      uint32_t end = matrix->row_offsets[id + 1];
+      if (matrix->absorbing[id] || begin == end)
+      {
+        // a state without successors that is not last ends the walk too
+        continue;
+      }
+      // the state may lead back to itself, so its own term is moved to the
+      // left side of t = 1 + sum p t
+      double stay = 0;
+      double estimate = 1;
+      for (uint32_t i = begin; i < end; i++)
+      {
+        if (matrix->columns[i] == id)
+        {
+          stay += matrix->probabilities[i];
+        }
+        else
+        {
+          estimate += matrix->probabilities[i]
+                      * expected[matrix->columns[i]];
+        }
+      }
+      if (stay >= 1)
+      {
+        stuck = true;
+        continue;
+      }
+      estimate /= 1 - stay;
+      // an estimate is at least 1, so the relative change is well defined
+      double change = (estimate - expected[id]) / estimate;
+      if (change < 0)
+      {
+        change = -change;
+      }
+      if (change > largest_change)
+      {
+        largest_change = change;
+      }
+      expected[id] = estimate;
+    }
+    if (!stuck && largest_change <= ANALYSIS_TOLERANCE)
+    {
+      sweeps = sweep;
+    }
+  }
+  free (order);
+  return sweeps;
+}
+double absorption_time_distribution (const MarkovMatrix *matrix,
+                                     uint32_t start, int horizon,
+                                     double *probabilities)
+{
+  size_t length = (size_t) matrix->num_states + 1;
+  double *current = calloc (length, sizeof (double));
+  double *next = calloc (length, sizeof (double));
+  if (current == NULL || next == NULL)
+  {
+    free (current);
+    free (next);
+    return -1;
+  }
+  // current holds the probability of every transient state after t steps,
+  // the mass that reaches an absorbing state is taken out of it
+  memset (probabilities, 0, ((size_t) horizon + 1) * sizeof (double));
+  double remaining = 1;
+  if (matrix->absorbing[start]
+      || matrix->row_offsets[start] == matrix->row_offsets[start + 1])
+  {
+    probabilities[0] = 1;
+    remaining = 0;
+  }
+  else
+  {
+    current[start] = 1;
+  }
+  for (int step = 1; step <= horizon && remaining > 0; step++)
+  {
+    memset (next, 0, matrix->num_states * sizeof (double));
+    for (uint32_t id = 0; id < matrix->num_states; id++)
+    {
+      double mass = current[id];
+      if (mass == 0)
+      {
+        continue;
+      }
+      for (uint32_t i = matrix->row_offsets[id];
+           i < matrix->row_offsets[id + 1]; i++)
+      {
+        next[matrix->columns[i]] += mass * matrix->probabilities[i];
+      }
+    }
+    double absorbed = 0;
+    remaining = 0;
+    for (uint32_t id = 0; id < matrix->num_states; id++)
+    {
+      if (matrix->absorbing[id]
+          || matrix->row_offsets[id] == matrix->row_offsets[id + 1])
+      {
+        absorbed += next[id];
+        next[id] = 0;
+      }
+      else
+      {
+        remaining += next[id];
+      }
+    }
+    probabilities[step] = absorbed;
+    double *swap = current;
+    current = next;
+    next = swap;
+  }
+  free (current);
+  free (next);
+  return remaining;
+}
+void free_markov_matrix (MarkovMatrix *matrix)
+{
+  free (matrix->row_offsets);
+  matrix->row_offsets = NULL;
+  free (matrix->columns);
+  matrix->columns = NULL;
+  free (matrix->probabilities);
+  matrix->probabilities = NULL;
+  free (matrix->absorbing);
+  matrix->absorbing = NULL;
+}
@@ -0,0 +1,86 @@
+#ifndef _MARKOV_ANALYSIS_H_
+#define _MARKOV_ANALYSIS_H_
+#include "compiled_chain.h"
+
+// the largest change of an estimate Gauss-Seidel stops at, relative to
+// the estimate
+#define ANALYSIS_TOLERANCE 1e-14
+#define ANALYSIS_MAX_SWEEPS 100000
+// returned by expected_steps_to_absorption in case of allocation error
+#define ANALYSIS_ALLOCATION_ERROR (-2)
+
+/**
+ * the transition matrix of a MarkovChain in compressed sparse row form:
+ * the probabilities of leaving state i are probabilities[row_offsets[i]]
+ * up to probabilities[row_offsets[i + 1]], to the states in columns. the
+ * last states of the chain are absorbing, they have no row.
+ */
+typedef struct MarkovMatrix
+{
+    uint32_t num_states;
+    uint32_t *row_offsets;// num_states + 1 offsets into the entries
+    uint32_t *columns;// the id of the state every entry leads to
+    double *probabilities;// the probability of every entry
+    uint8_t *absorbing;// 1 if the state is a last state, 0 otherwise
+} MarkovMatrix;
+
+/**
+ * Build the transition matrix of a chain from the frequencies of its
+ * states.
+ * @param markov_chain
+ * @param matrix out parameter, freed with free_markov_matrix
+ * @return true on success, false in case of allocation error.
+ */
+bool build_markov_matrix (const MarkovChain *markov_chain,
+                          MarkovMatrix *matrix);
+
+/**
+ * Build the transition matrix of a compiled chain from the weights of its
+ * rows.
+ * @param compiled a chain that is not packed
+ * @param matrix out parameter, freed with free_markov_matrix
+ * @return true on success, false in case of allocation error.
+ */
+bool build_compiled_matrix (const CompiledChain *compiled,
+                            MarkovMatrix *matrix);
+
+/**
+ * Compute the expected number of steps from every state until a walk
+ * reaches a last state, by solving t = 1 + Q t with Gauss-Seidel sweeps
+ * over the rows of the transient states until no estimate changes by more
+ * than ANALYSIS_TOLERANCE of itself. a sweep visits the states in depth
+ * first post order, so a state is updated after the states it leads to:
+ * without cycles the first sweep is exact, and the next one confirms it.
+ * @param matrix
+ * @param expected out parameter, num_states expectations, 0 for the
+ * absorbing states and the states without successors
+ * @return the number of sweeps, -1 if they didn't converge within
+ * ANALYSIS_MAX_SWEEPS (some state may never be absorbed), or
+ * ANALYSIS_ALLOCATION_ERROR.
+ */
+int expected_steps_to_absorption (const MarkovMatrix *matrix,
+                                  double *expected);
+
+/**
+ * Compute the distribution of the number of steps a walk from a state
+ * takes until it reaches a last state, by propagating the distribution of
+ * its position one step at a time.
+ * @param matrix
+ * @param start the id of the state the walk starts from
+ * @param horizon the largest number of steps to follow
+ * @param probabilities out parameter, horizon + 1 probabilities: the walk
+ * is absorbed after exactly t steps with probability probabilities[t]
+ * @return the probability that the walk is not absorbed within horizon
+ * steps, or -1 in case of allocation error.
+ */
+double absorption_time_distribution (const MarkovMatrix *matrix,
+                                     uint32_t start, int horizon,
+                                     double *probabilities);
+
+/**
+ * Free the arrays of a transition matrix.
+ * @param matrix
+ */
+void free_markov_matrix (MarkovMatrix *matrix);
+
+#endif //_MARKOV_ANALYSIS_H_
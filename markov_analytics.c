@@ -0,0 +1,356 @@
+#include "markov_analytics.h"
+#include <string.h> // For memcpy()
+#include <math.h> // For log2()
+#include <pthread.h>
+
+/**
+ * one product of the power iteration, shared by the threads computing it.
+ */
+typedef struct RankingStep
+{
+    const MarkovMatrix *matrix;
+    const MarkovMatrix *transposed;// the predecessors of every state
+    const double *restart;// the probability to restart from every state
+    double damping;
+    double teleport;// the probability of the walk to restart at this step
+    const double *rank;// the distribution before the step
+    double *next;// the distribution after the step
+    double *block_change;// the L1 change of every block
+    double *block_restart;// the mass of every block at the states the walk
+    // restarts from
+    uint32_t num_blocks;
+} RankingStep;
+
+/**
+ * the blocks of a product one thread computes.
+ */
+typedef struct RankingShard
+{
+    RankingStep *step;
+    uint32_t first_block;// the shard computes blocks first_block,
+    // first_block + stride, ...
+    uint32_t stride;
+} RankingShard;
+
+/**
+ * check if a walk restarts once it reaches a state: the state is last or
+ * has no successors.
+ * @param matrix
+ * @param id
+ * @return true if it restarts, false otherwise.
+ */
+static bool restarts_from (const MarkovMatrix *matrix, uint32_t id);
+/**
+ * compute the probability to restart from every state.
+ * @param num_states
+ * @param restart_ids
+ * @param num_restarts
+ * @return num_states probabilities, NULL in case of allocation error.
+ */
+static double *restart_distribution (uint32_t num_states,
+                                     const uint32_t *restart_ids,
+                                     uint32_t num_restarts);
+/**
+ * build the transpose of a matrix: row j holds the states that lead to j
+ * and the probabilities they do.
+ * @param matrix
+ * @param transposed out parameter, freed with free_markov_matrix
+ * @return true on success, false in case of allocation error.
+ */
+static bool transpose_matrix (const MarkovMatrix *matrix,
+                              MarkovMatrix *transposed);
+/**
+ * compute the blocks of a shard of one product.
+ * @param arg the RankingShard to compute
+ * @return NULL
+ */
+static void *multiply_shard (void *arg);
+
+// see all documentation in the header file
+static bool restarts_from (const MarkovMatrix *matrix, uint32_t id)
+{
+  return matrix->absorbing[id]
+         || matrix->row_offsets[id] == matrix->row_offsets[id + 1];
+}
+static double *restart_distribution (uint32_t num_states,
+                                     const uint32_t *restart_ids,
+                                     uint32_t num_restarts)
+{
+  double *restart = calloc ((size_t) num_states + 1, sizeof (double));
+  if (restart == NULL)
+  {
+    return NULL;
+  }
+  if (num_restarts == 0)
+  {
+    for (uint32_t id = 0; id < num_states; id++)
+    {
+      restart[id] = 1.0 / num_states;
+    }
+    return restart;
+  }
+  for (uint32_t i = 0; i < num_restarts; i++)
+  {
+    restart[restart_ids[i]] += 1.0 / num_restarts;
+  }
+  return restart;
+}
+static bool transpose_matrix (const MarkovMatrix *matrix,
+                              MarkovMatrix *transposed)
+{
+  uint32_t num_states = matrix->num_states;
+  uint32_t num_entries = matrix->row_offsets[num_states];
+  transposed->num_states = num_states;
+  transposed->row_offsets = calloc ((size_t) num_states + 1,
+                                    sizeof (uint32_t));
+  transposed->columns = malloc ((num_entries + 1) * sizeof (uint32_t));
+  transposed->probabilities = malloc ((num_entries + 1) * sizeof (double));
+  transposed->absorbing = NULL;
+  if (transposed->row_offsets == NULL || transposed->columns == NULL
+      || transposed->probabilities == NULL)
+  {
+    free_markov_matrix (transposed);
+    return false;
+  }
+  // count the predecessors of every state into the offset after it, then
+  // sum them up so row_offsets[j] is where row j is filled from
+  for (uint32_t i = 0; i < num_entries; i++)
+  {
+    transposed->row_offsets[matrix->columns[i] + 1]++;
+  }
+  for (uint32_t id = 1; id <= num_states; id++)
+  {
+    transposed->row_offsets[id] += transposed->row_offsets[id - 1];
+  }
+  for (uint32_t from = 0; from < num_states; from++)
+  {
+    for (uint32_t i = matrix->row_offsets[from];
+         i < matrix->row_offsets[from + 1]; i++)
+    {
+      uint32_t slot = transposed->row_offsets[matrix->columns[i]]++;
+      transposed->columns[slot] = from;
+      transposed->probabilities[slot] = matrix->probabilities[i];
+    }
+  }
+  // filling moved every offset to the start of the next row
+  memmove (transposed->row_offsets + 1, transposed->row_offsets,
+           num_states * sizeof (uint32_t));
+  transposed->row_offsets[0] = 0;
+  return true;
+}
+static void *multiply_shard (void *arg)
+{
+  RankingShard *shard = (RankingShard *) arg;
+  RankingStep *step = shard->step;
+  uint32_t num_states = step->matrix->num_states;
+  const MarkovMatrix *transposed = step->transposed;
+  for (uint32_t block = shard->first_block; block < step->num_blocks;
+       block += shard->stride)
+  {
+    uint32_t begin = block * ANALYTICS_BLOCK_STATES;
+    uint32_t end = begin + ANALYTICS_BLOCK_STATES;
+    if (end > num_states)
+    {
+      end = num_states;
+    }
+    double change = 0;
+    double restarting = 0;
+    for (uint32_t id = begin; id < end; id++)
+    {
+      double mass = 0;
+      for (uint32_t i = transposed->row_offsets[id];
+           i < transposed->row_offsets[id + 1]; i++)
+      {
+        mass += transposed->probabilities[i]
+                * step->rank[transposed->columns[i]];
+      }
+      mass = step->damping * mass + step->teleport * step->restart[id];
+      step->next[id] = mass;
+      change += fabs (mass - step->rank[id]);
+      if (restarts_from (step->matrix, id))
+      {
+        restarting += mass;
+      }
+    }
+    step->block_change[block] = change;
+    step->block_restart[block] = restarting;
+  }
+  return NULL;
+}
+bool stationary_distribution (const MarkovMatrix *matrix,
+                              const uint32_t *restart_ids,
+                              uint32_t num_restarts, double damping,
+                              int threads, double *rank,
+                              StationaryReport *report)
+{
+  *report = (StationaryReport) {0, 0, true};
+  uint32_t num_states = matrix->num_states;
+  if (num_states == 0)
+  {
+    return true;
+  }
+  uint32_t num_blocks = (num_states + ANALYTICS_BLOCK_STATES - 1)
+                        / ANALYTICS_BLOCK_STATES;
+  MarkovMatrix transposed;
+  if (!transpose_matrix (matrix, &transposed))
+  {
+    return false;
+  }
+  double *restart = restart_distribution (num_states, restart_ids,
+                                          num_restarts);
+  double *other = malloc (num_states * sizeof (double));
+  double *block_change = malloc (num_blocks * sizeof (double));
+  double *block_restart = malloc (num_blocks * sizeof (double));
+  RankingShard *shards = malloc (threads * sizeof (RankingShard));
+  pthread_t *workers = malloc (threads * sizeof (pthread_t));
+  bool *started = malloc (threads * sizeof (bool));
+  bool failed = restart == NULL || other == NULL || block_change == NULL
+                || block_restart == NULL || shards == NULL
+                || workers == NULL || started == NULL;
+  if (!failed)
+  {
+    // the walk starts where it restarts from
+    memcpy (rank, restart, num_states * sizeof (double));
+    double restarting = 0;
+    for (uint32_t id = 0; id < num_states; id++)
+    {
+      if (restarts_from (matrix, id))
+      {
+        restarting += rank[id];
+      }
+    }
+    double *current = rank;
+    double *next = other;
+    RankingStep step = {matrix, &transposed, restart, damping, 0, current,
+                        next, block_change, block_restart, num_blocks};
+    for (int t = 0; t < threads; t++)
+    {
+      shards[t] = (RankingShard) {&step, (uint32_t) t, (uint32_t) threads};
+    }
+    while (report->iterations < ANALYTICS_MAX_ITERATIONS)
+    {
+      // the mass that reaches a state it restarts from is spread over the
+      // restart states with the mass that teleports
+      step.teleport = damping * restarting + (1 - damping);
+      // the calling thread computes shard 0, and any shard whose thread
+      // could not be started
+      for (int t = 1; t < threads; t++)
+      {
+        started[t] = pthread_create (&workers[t], NULL, multiply_shard,
+                                     &shards[t]) == 0;
+      }
+      started[0] = false;
+      for (int t = 0; t < threads; t++)
+      {
+        if (!started[t])
+        {
+          multiply_shard (&shards[t]);
+        }
+      }
+      for (int t = 1; t < threads; t++)
+      {
+        if (started[t])
+        {
+          pthread_join (workers[t], NULL);
+        }
+      }
+      report->iterations++;
+      report->change = 0;
+      restarting = 0;
+      for (uint32_t block = 0; block < num_blocks; block++)
+      {
+        report->change += block_change[block];
+        restarting += block_restart[block];
+      }
+      double *swap = current;
+      current = next;
+      next = swap;
+      step.rank = current;
+      step.next = next;
+      if (report->change <= ANALYTICS_TOLERANCE)
+      {
+        break;
+      }
+    }
+    report->converged = report->change <= ANALYTICS_TOLERANCE;
+    if (current != rank)
+    {
+      memcpy (rank, current, num_states * sizeof (double));
+    }
+  }
+  free_markov_matrix (&transposed);
+  free (restart);
+  free (other);
+  free (block_change);
+  free (block_restart);
+  free (shards);
+  free (workers);
+  free (started);
+  return !failed;
+}
+void state_entropies (const MarkovMatrix *matrix, double *entropy)
+{
+  for (uint32_t id = 0; id < matrix->num_states; id++)
+  {
+    entropy[id] = 0;
+    if (matrix->absorbing[id])
+    {
+      continue;
+    }
+    for (uint32_t i = matrix->row_offsets[id];
+         i < matrix->row_offsets[id + 1]; i++)
+    {
+      double probability = matrix->probabilities[i];
+      entropy[id] -= probability * log2 (probability);
+    }
+  }
+}
+double entropy_rate (const MarkovMatrix *matrix, const double *rank,
+                     const double *entropy, const uint32_t *restart_ids,
+                     uint32_t num_restarts)
+{
+  double *restart = restart_distribution (matrix->num_states, restart_ids,
+                                          num_restarts);
+  if (restart == NULL)
+  {
+    return -1;
+  }
+  double restart_entropy = 0;
+  for (uint32_t id = 0; id < matrix->num_states; id++)
+  {
+    if (restart[id] > 0)
+    {
+      restart_entropy -= restart[id] * log2 (restart[id]);
+    }
+  }
+  free (restart);
+  double rate = 0;
+  for (uint32_t id = 0; id < matrix->num_states; id++)
+  {
+    rate += rank[id] * (restarts_from (matrix, id) ? restart_entropy
+                                                   : entropy[id]);
+  }
+  return rate;
+}
+uint32_t top_ranked_states (const double *rank, uint32_t num_states,
+                            uint32_t count, uint32_t *top)
+{
+  // top holds the best states seen so far in order, a state is inserted
+  // into it only if it beats the last one
+  uint32_t found = 0;
+  for (uint32_t id = 0; id < num_states; id++)
+  {
+    if (found == count && (count == 0 || rank[id] <= rank[top[found - 1]]))
+    {
+      continue;
+    }
+    uint32_t slot = (found < count) ? found++ : found - 1;
+    while (slot > 0 && rank[top[slot - 1]] < rank[id])
+    {
+      top[slot] = top[slot - 1];
+      slot--;
+    }
+    top[slot] = id;
+  }
+  return found;
+}
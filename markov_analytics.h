@@ -0,0 +1,89 @@
+#ifndef _MARKOV_ANALYTICS_H_
+#define _MARKOV_ANALYTICS_H_
+#include "markov_analysis.h"
+
+// the probability a walk follows a transition of the chain instead of
+// restarting, as in PageRank
+#define ANALYTICS_DAMPING 0.85
+// the L1 change of the distribution power iteration stops at
+#define ANALYTICS_TOLERANCE 1e-10
+#define ANALYTICS_MAX_ITERATIONS 1000
+// the number of states in a block of a product, the changes of the blocks
+// are summed in block order so the result is the same for any number of
+// threads
+#define ANALYTICS_BLOCK_STATES 4096
+
+/**
+ * how the power iteration of a stationary distribution went.
+ */
+typedef struct StationaryReport
+{
+    int iterations;// the number of products computed
+    double change;// the L1 distance between the last two distributions
+    bool converged;// true if change is at most ANALYTICS_TOLERANCE
+} StationaryReport;
+
+/**
+ * Compute the stationary distribution of a walk that follows the
+ * transitions of the chain with probability damping and restarts from a
+ * start state otherwise, and always restarts once it reaches a last state
+ * or a state without successors. the distribution is found by power
+ * iteration: every iteration is a product of the transposed matrix with the
+ * distribution, its blocks of ANALYTICS_BLOCK_STATES states shared between
+ * the threads.
+ * @param matrix
+ * @param restart_ids the states a walk restarts from, one chosen uniformly.
+ * a state may appear more than once, if there are none a walk restarts
+ * from any state uniformly.
+ * @param num_restarts the length of restart_ids
+ * @param damping in (0, 1]
+ * @param threads the number of threads to multiply with
+ * @param rank out parameter, num_states probabilities
+ * @param report out parameter
+ * @return true on success, false in case of allocation error.
+ */
+bool stationary_distribution (const MarkovMatrix *matrix,
+                              const uint32_t *restart_ids,
+                              uint32_t num_restarts, double damping,
+                              int threads, double *rank,
+                              StationaryReport *report);
+
+/**
+ * Compute the entropy in bits of the distribution of the successors of
+ * every state.
+ * @param matrix
+ * @param entropy out parameter, num_states entropies, 0 for the last
+ * states and the states without successors
+ */
+void state_entropies (const MarkovMatrix *matrix, double *entropy);
+
+/**
+ * Compute the entropy rate in bits per step of the walk of
+ * stationary_distribution: the entropy of every state weighted by its
+ * stationary probability, where a state the walk restarts from contributes
+ * the entropy of the restart states.
+ * @param matrix
+ * @param rank the stationary distribution
+ * @param entropy the entropies of state_entropies
+ * @param restart_ids as given to stationary_distribution
+ * @param num_restarts
+ * @return the entropy rate, or -1 in case of allocation error.
+ */
+double entropy_rate (const MarkovMatrix *matrix, const double *rank,
+                     const double *entropy, const uint32_t *restart_ids,
+                     uint32_t num_restarts);
+
+/**
+ * Find the states of highest stationary probability, ties broken by the
+ * lower id.
+ * @param rank the stationary distribution
+ * @param num_states
+ * @param count the number of states to find
+ * @param top out parameter, the ids of the states in decreasing order of
+ * probability
+ * @return the number of states found, the smaller of count and num_states.
+ */
+uint32_t top_ranked_states (const double *rank, uint32_t num_states,
+                            uint32_t count, uint32_t *top);
+
+#endif //_MARKOV_ANALYTICS_H_
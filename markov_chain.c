@@ -1,23 +1,173 @@
+#define _POSIX_C_SOURCE 200809L
 #include "markov_chain.h"
+#include <string.h> // For memcpy()
+#include <time.h> // For clock_gettime()
+#include <limits.h> // For INT_MAX
+#define INDEX_INITIAL_CAPACITY 64
+#define INDEX_LOAD_NUMERATOR 3 // the index grows beyond 3/4 load factor
+#define INDEX_LOAD_DENOMINATOR 4
+#define STATES_INITIAL_CAPACITY 64
+#define IDS_INITIAL_CAPACITY 64
+#define PRUNED_STATE UINT32_MAX // the new id of a state removed by pruning
 Node *enter_empty_database (MarkovChain *markov_chain, void *data_ptr);
+/**
+ * insert a database node to the hash index of the chain, which must have
+ * room for it (see index_reserve). does nothing if the chain has no index.
+ * @param markov_chain
+ * @param node a node that was already added to the database
+ */
+static void index_insert (MarkovChain *markov_chain, Node *node);
+/**
+ * grow the hash index of the chain so it holds size nodes within its load
+ * factor. does nothing if the chain has no index.
+ * @param markov_chain
+ * @param size the number of nodes the index must have room for
+ * @return true on success, false in case of allocation error (the index is
+ * left as it was).
+ */
+static bool index_reserve (MarkovChain *markov_chain, size_t size);
+/**
+ * rebuild the hash index of the chain with the given capacity.
+ * @param markov_chain
+ * @param new_capacity power of 2 bigger than the database size
+ * @return true on success, false in case of allocation error.
+ */
+static bool index_resize (MarkovChain *markov_chain, size_t new_capacity);
+/**
+ * find the position of second_node in the frequencies list of first_node.
+ * @param markov_chain the chain counting the scanned successors
+ * @param first_node
+ * @param second_node
+ * @return the position in frequencies_list, or -1 if not a successor.
+ */
+static int find_successor (MarkovChain *markov_chain, MarkovNode *first_node,
+                           MarkovNode *second_node);
+/**
+ * make room in the successor index of the node for size successors, so
+ * they can be indexed without allocating. builds the index from the
+ * current successors when size passes SUCCESSOR_INDEX_THRESHOLD, and
+ * rebuilds it bigger when size passes 1/2 load factor.
+ * @param node
+ * @param size the number of successors the index must hold
+ * @param arena
+ * @return true on success, false in case of allocation error, in which case
+ * the node is not changed.
+ */
+static bool successor_index_reserve (MarkovNode *node, int size,
+                                     Arena *arena);
+/**
+ * index the last entry of the frequencies list of the node in its successor
+ * index, if it has one. room for it must have been reserved with
+ * successor_index_reserve.
+ * @param node
+ */
+static void successor_index_insert (MarkovNode *node);
+/**
+ * allocate a new MarkovNode for data_ptr and a Node wrapping it from the
+ * arena of the chain, and add them to the end of the (existing) database.
+ * @param markov_chain
+ * @param data_ptr
+ * @return the new database node, NULL in case of allocation error.
+ */
+static Node *append_to_database (MarkovChain *markov_chain, void *data_ptr);
+/**
+ * move the frequencies list of the node to an array with room for at least
+ * capacity successors, if it has less.
+ * @param node
+ * @param capacity
+ * @param markov_chain the chain whose arena the list is allocated from
+ * @return true on success, false in case of allocation error.
+ */
+static bool reserve_successors (MarkovNode *node, int capacity,
+                                MarkovChain *markov_chain);
+/**
+ * append a state id to a growable array of ids.
+ * @param ids the array, reallocated when full
+ * @param size the number of ids in the array
+ * @param capacity the allocated length of the array
+ * @param id the id to append
+ * @return true on success, false in case of allocation error.
+ */
+static bool push_state_id (uint32_t **ids, uint32_t *size, uint32_t *capacity,
+                           uint32_t id);
+/**
+ * give the sampler of the node back to the arena of the chain, if it has
+ * one.
+ * @param node
+ * @param markov_chain
+ */
+static void release_sampler (MarkovNode *node, MarkovChain *markov_chain);
+/**
+ * build the alias table of the successors of the node.
+ * @param node a node with successors
+ * @param sampler the thresholds followed by the aliases, 2 * successors
+ * @return true on success, false in case of allocation error.
+ */
+static bool build_node_alias_table (MarkovNode *node, uint32_t *sampler);
+/**
+ * the bytes the structures of a chain take, without the arena blocks that
+ * hold them.
+ * @param memory the bytes measured by measure_markov_chain
+ */
+static size_t memory_in_use (const MarkovMemory *memory);
+/**
+ * remove from the frequencies list of the node the transitions rarer than
+ * min_frequency and the ones to removed states, and renumber the rest.
+ * @param node a state that is kept
+ * @param min_frequency
+ * @param new_ids the new id of every state by its old id, PRUNED_STATE if
+ * it is removed
+ * @return the number of transitions removed
+ */
+static size_t compact_successors (MarkovNode *node, int min_frequency,
+                                  const uint32_t *new_ids);
+/**
+ * move the frequencies list of the node to an array of its exact length
+ * and rebuild its successor index. a node whose array can't be moved keeps
+ * the longer one.
+ * @param node
+ * @param arena the arena of the chain
+ * @return true on success, false if the successor index failed to be
+ * allocated (the node is left without one).
+ */
+static bool shrink_successors (MarkovNode *node, Arena *arena);
+/**
+ * keep in an array of state ids only the ones that are not removed, with
+ * their new ids.
+ * @param ids
+ * @param size the number of ids, updated
+ * @param new_ids the new id of every state by its old id
+ */
+static void renumber_state_ids (uint32_t *ids, uint32_t *size,
+                                const uint32_t *new_ids);
 // see all documentation in the header file
 //*********************initializers***************************//
-MarkovNode *create_markov_node (void *data_ptr, copy_func_ptr copy_func)
+MarkovNode *create_markov_node (MarkovChain *markov_chain, void *data_ptr)
 {
-  MarkovNode *new_node = (MarkovNode *) malloc (sizeof (MarkovNode));
-  if (new_node == NULL || data_ptr == NULL)
+  if (data_ptr == NULL)
+  {
+    return NULL;
+  }
+  MarkovNode *new_node = arena_alloc (markov_chain->arena,
+                                      sizeof (MarkovNode));
+  if (new_node == NULL)
   {
     return NULL; // error: failed to allocate memory
   }
-  void *dup = copy_func (data_ptr);
+  void *dup = markov_chain->copy_func (data_ptr);
   if (dup == NULL)
   {
-    free (new_node);
+    arena_release (markov_chain->arena, new_node, sizeof (MarkovNode));
     return NULL;
   }
   new_node->data = dup;
   new_node->frequencies_list = NULL;
   new_node->current_successive_nodes = 0;
+  new_node->successors_capacity = 0;
+  new_node->total_occurrences = 0;
+  new_node->sampler = NULL;
+  new_node->successor_index = NULL;
+  new_node->successor_index_capacity = 0;
   return new_node;
 }
 LinkedList *create_linked_list (Node *first, Node *last, int size)
@@ -51,22 +201,144 @@ Node *add_to_database (MarkovChain *markov_chain, void *data_ptr)
   //checks if the element is already in the database.
   if (check == NULL)
   {
-    MarkovNode *new_markov_node = create_markov_node (data_ptr,
-                                                      markov_chain->copy_func);
-    if (new_markov_node == NULL)
+    return append_to_database (markov_chain, data_ptr);
+  }
+  return check;
+
+}
+bool add_states_to_database (MarkovChain *markov_chain, void *const *data,
+                             uint32_t count)
+{
+  if (markov_chain->database == NULL)
+  {
+    markov_chain->database = create_linked_list (NULL, NULL, 0);
+    if (markov_chain->database == NULL)
     {
-      return NULL;
+      return false;
     }
-    int add_try = add (markov_chain->database, new_markov_node);
-    if (add_try == 1)
+  }
+  size_t size = (size_t) markov_chain->database->size + count;
+  if (size > INT_MAX)
+  {
+    return false;
+  }
+  // with room made for all the states, append_to_database never grows the
+  // states array or the index
+  if (size > markov_chain->states_capacity)
+  {
+    MarkovNode **new_states = realloc (markov_chain->states,
+                                       size * sizeof (MarkovNode *));
+    if (new_states == NULL)
     {
-      free_markov_node (new_markov_node, markov_chain);
-      free_database (&markov_chain);
+      return false;
     }
-    return markov_chain->database->last;
+    markov_chain->states = new_states;
+    markov_chain->states_capacity = (uint32_t) size;
   }
-  return check;
-
+  if (!index_reserve (markov_chain, size))
+  {
+    return false;
+  }
+  for (uint32_t i = 0; i < count; i++)
+  {
+    if (append_to_database (markov_chain, data[i]) == NULL)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+bool add_edges_to_database (MarkovChain *markov_chain,
+                            const MarkovEdge *edges, size_t count)
+{
+  uint32_t size = 0;
+  if (markov_chain->database != NULL)
+  {
+    size = (uint32_t) markov_chain->database->size;
+  }
+  for (size_t i = 0; i < count; i++)
+  {
+    if (edges[i].from >= size || edges[i].to >= size || edges[i].weight == 0)
+    {
+      return false;
+    }
+  }
+  if (count == 0)
+  {
+    return true;
+  }
+  int *degrees = calloc (size, sizeof (int));
+  long long *totals = calloc (size, sizeof (long long));
+  if (degrees == NULL || totals == NULL)
+  {
+    free (degrees);
+    free (totals);
+    return false;
+  }
+  // the frequency of a transition is at most the total of its state, so
+  // bounding the totals keeps every count of the state an int
+  for (uint32_t id = 0; id < size; id++)
+  {
+    totals[id] = markov_chain->states[id]->total_occurrences;
+  }
+  for (size_t i = 0; i < count; i++)
+  {
+    degrees[edges[i].from]++;
+    totals[edges[i].from] += edges[i].weight;
+    if (totals[edges[i].from] > INT_MAX)
+    {
+      free (degrees);
+      free (totals);
+      return false;
+    }
+  }
+  free (totals);
+  for (uint32_t id = 0; id < size; id++)
+  {
+    MarkovNode *node = markov_chain->states[id];
+    if (degrees[id] > 0
+        && !reserve_successors (node, node->current_successive_nodes
+                                      + degrees[id], markov_chain))
+    {
+      free (degrees);
+      return false;
+    }
+  }
+  free (degrees);
+  for (size_t i = 0; i < count; i++)
+  {
+    if (!add_transition_count (markov_chain->states[edges[i].from],
+                               markov_chain->states[edges[i].to],
+                               (int) edges[i].weight, markov_chain))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+static bool reserve_successors (MarkovNode *node, int capacity,
+                                MarkovChain *markov_chain)
+{
+  if (capacity <= node->successors_capacity)
+  {
+    return true;
+  }
+  MarkovNodeFrequency *new_frequency_list = arena_alloc
+      (markov_chain->arena, capacity * sizeof (MarkovNodeFrequency));
+  if (new_frequency_list == NULL)
+  {
+    return false;
+  }
+  if (node->current_successive_nodes > 0)
+  {
+    memcpy (new_frequency_list, node->frequencies_list,
+            node->current_successive_nodes * sizeof (MarkovNodeFrequency));
+  }
+  arena_release (markov_chain->arena, node->frequencies_list,
+                 node->successors_capacity * sizeof (MarkovNodeFrequency));
+  node->frequencies_list = new_frequency_list;
+  node->successors_capacity = capacity;
+  return true;
 }
 Node *enter_empty_database (MarkovChain *markov_chain, void *data_ptr)
 {
@@ -76,34 +348,95 @@ Node *enter_empty_database (MarkovChain *markov_chain, void *data_ptr)
     return NULL;
   }
   markov_chain->database = list;
-  MarkovNode *new_markov_node = create_markov_node (data_ptr,
-                                                    markov_chain->copy_func);
+  return append_to_database (markov_chain, data_ptr);
+}
+static Node *append_to_database (MarkovChain *markov_chain, void *data_ptr)
+{
+  Node *new_node = arena_alloc (markov_chain->arena, sizeof (Node));
+  if (new_node == NULL)
+  {
+    return NULL;
+  }
+  MarkovNode *new_markov_node = create_markov_node (markov_chain, data_ptr);
   if (new_markov_node == NULL)
   {
-    free (list);
+    arena_release (markov_chain->arena, new_node, sizeof (Node));
     return NULL;
   }
-  int add_try = add (list, new_markov_node);
-  if (add_try == 1)
+  if (markov_chain->states_capacity == (uint32_t) markov_chain->database->size)
+  {
+    uint32_t new_capacity = markov_chain->states_capacity * 2;
+    if (new_capacity == 0)
+    {
+      new_capacity = STATES_INITIAL_CAPACITY;
+    }
+    MarkovNode **new_states = realloc (markov_chain->states,
+                                       new_capacity * sizeof (MarkovNode *));
+    if (new_states == NULL)
+    {
+      free_markov_node (new_markov_node, markov_chain);
+      arena_release (markov_chain->arena, new_node, sizeof (Node));
+      return NULL;
+    }
+    markov_chain->states = new_states;
+    markov_chain->states_capacity = new_capacity;
+  }
+  new_markov_node->id = (uint32_t) markov_chain->database->size;
+  // everything that can fail is done before the node is linked, so a
+  // failure leaves the database, the states and the index as they were
+  size_t size = (size_t) markov_chain->database->size + 1;
+  if (!index_reserve (markov_chain, size)
+      || (!markov_chain->is_last (new_markov_node->data)
+          && !push_state_id (&markov_chain->start_candidates,
+                             &markov_chain->num_start_candidates,
+                             &markov_chain->start_candidates_capacity,
+                             new_markov_node->id)))
   {
-
     free_markov_node (new_markov_node, markov_chain);
-    free_database (&markov_chain);
+    arena_release (markov_chain->arena, new_node, sizeof (Node));
+    return NULL;
   }
-  return markov_chain->database->first;
-
+  markov_chain->states[new_markov_node->id] = new_markov_node;
+  append_node (markov_chain->database, new_node, new_markov_node);
+  index_insert (markov_chain, new_node);
+  return new_node;
 }
 Node *get_node_from_database (MarkovChain *markov_chain, void *data_ptr)
 {
+  MARKOV_STAT (markov_chain, lookups, 1);
   if (markov_chain->database == NULL || markov_chain->database->first == NULL)
   {
     return NULL;
   }
+  if (markov_chain->index != NULL)
+  {
+    // probe the hash index from the home slot of the hash until an empty
+    // slot is found.
+    size_t hash = markov_chain->hash_func (data_ptr);
+    size_t mask = markov_chain->index_capacity - 1;
+    for (size_t i = hash & mask; markov_chain->index[i].node != NULL;
+         i = (i + 1) & mask)
+    {
+      MARKOV_STAT (markov_chain, lookup_probes, 1);
+      Node *candidate = markov_chain->index[i].node;
+      if (markov_chain->index[i].hash != hash)
+      {
+        continue;
+      }
+      MARKOV_STAT (markov_chain, comparisons, 1);
+      if (markov_chain->comp_func (candidate->data->data, data_ptr) == 0)
+      {
+        return candidate;
+      }
+    }
+    return NULL;
+  }
   Node *current = markov_chain->database->first;
   // searching for a node contain the same word, if ones exist return it.
   while (current != NULL)
   {
-
+    MARKOV_STAT (markov_chain, lookup_probes, 1);
+    MARKOV_STAT (markov_chain, comparisons, 1);
     if (markov_chain->comp_func (current->data->data, data_ptr) == 0)
     {
       return current;
@@ -127,21 +460,166 @@ copy_func, free_func_ptr free_func, cmp_func_ptr cmp_func, is_last_func_ptr
   new_chain->copy_func = copy_func;
   new_chain->comp_func = cmp_func;
   new_chain->is_last = is_last;
+  new_chain->hash_func = NULL;
+  new_chain->format_func = NULL;
+  new_chain->size_func = NULL;
+  new_chain->index = NULL;
+  new_chain->index_capacity = 0;
+  new_chain->states = NULL;
+  new_chain->states_capacity = 0;
+  new_chain->start_candidates = NULL;
+  new_chain->num_start_candidates = 0;
+  new_chain->start_candidates_capacity = 0;
+  new_chain->sentence_starts = NULL;
+  new_chain->num_sentence_starts = 0;
+  new_chain->sentence_starts_capacity = 0;
+  new_chain->weighted_starts = false;
+  new_chain->sampler_kind = SAMPLER_ALIAS;
+  memset (&new_chain->stats, 0, sizeof (MarkovStats));
+  new_chain->arena = arena_create (ARENA_DEFAULT_BLOCK_SIZE);
+  if (new_chain->arena == NULL)
+  {
+    free (new_chain);
+    return NULL;
+  }
   return new_chain;
 }
+bool set_hash_func (MarkovChain *markov_chain, hash_func_ptr hash_func)
+{
+  free (markov_chain->index);
+  markov_chain->index = NULL;
+  markov_chain->index_capacity = 0;
+  markov_chain->hash_func = hash_func;
+  if (hash_func == NULL)
+  {
+    return true;
+  }
+  size_t size = 0;
+  if (markov_chain->database != NULL)
+  {
+    size = markov_chain->database->size;
+  }
+  size_t capacity = INDEX_INITIAL_CAPACITY;
+  while (size * INDEX_LOAD_DENOMINATOR >= capacity * INDEX_LOAD_NUMERATOR)
+  {
+    capacity *= 2;
+  }
+  if (!index_resize (markov_chain, capacity))
+  {
+    markov_chain->hash_func = NULL;
+    return false;
+  }
+  return true;
+}
+static bool push_state_id (uint32_t **ids, uint32_t *size, uint32_t *capacity,
+                           uint32_t id)
+{
+  if (*size == *capacity)
+  {
+    uint32_t new_capacity = (*capacity == 0) ? IDS_INITIAL_CAPACITY
+                                             : *capacity * 2;
+    uint32_t *new_ids = realloc (*ids, new_capacity * sizeof (uint32_t));
+    if (new_ids == NULL)
+    {
+      return false;
+    }
+    *ids = new_ids;
+    *capacity = new_capacity;
+  }
+  (*ids)[(*size)++] = id;
+  return true;
+}
+bool add_sentence_start (MarkovChain *markov_chain, MarkovNode *markov_node)
+{
+  if (markov_chain->is_last (markov_node->data))
+  {
+    return true;
+  }
+  return push_state_id (&markov_chain->sentence_starts,
+                        &markov_chain->num_sentence_starts,
+                        &markov_chain->sentence_starts_capacity,
+                        markov_node->id);
+}
+MarkovNode *get_state_by_id (const MarkovChain *markov_chain, uint32_t id)
+{
+  return markov_chain->states[id];
+}
+static bool index_resize (MarkovChain *markov_chain, size_t new_capacity)
+{
+  DatabaseIndexSlot *new_index = calloc (new_capacity,
+                                         sizeof (DatabaseIndexSlot));
+  if (new_index == NULL)
+  {
+    return false;
+  }
+  size_t mask = new_capacity - 1;
+  if (markov_chain->database != NULL)
+  {
+    // the hashes are recomputed from the database so this function can
+    // also build the index for the first time.
+    for (Node *current = markov_chain->database->first; current != NULL;
+         current = current->next)
+    {
+      size_t hash = markov_chain->hash_func (current->data->data);
+      size_t i = hash & mask;
+      while (new_index[i].node != NULL)
+      {
+        i = (i + 1) & mask;
+      }
+      new_index[i].hash = hash;
+      new_index[i].node = current;
+    }
+  }
+  free (markov_chain->index);
+  markov_chain->index = new_index;
+  markov_chain->index_capacity = new_capacity;
+  return true;
+}
+static bool index_reserve (MarkovChain *markov_chain, size_t size)
+{
+  if (markov_chain->index == NULL)
+  {
+    return true;
+  }
+  size_t capacity = markov_chain->index_capacity;
+  while (size * INDEX_LOAD_DENOMINATOR > capacity * INDEX_LOAD_NUMERATOR)
+  {
+    capacity *= 2;
+  }
+  return capacity == markov_chain->index_capacity
+         || index_resize (markov_chain, capacity);
+}
+static void index_insert (MarkovChain *markov_chain, Node *node)
+{
+  if (markov_chain->index == NULL)
+  {
+    return;
+  }
+  size_t hash = markov_chain->hash_func (node->data->data);
+  size_t mask = markov_chain->index_capacity - 1;
+  size_t i = hash & mask;
+  while (markov_chain->index[i].node != NULL)
+  {
+    i = (i + 1) & mask;
+  }
+  markov_chain->index[i].hash = hash;
+  markov_chain->index[i].node = node;
+}
 //*********************add to freq list and helpers ***************//
 MarkovNodeFrequency *create_frequency_array (MarkovNode *first_node,
-                                             MarkovNode *second_node)
+                                             MarkovNode *second_node,
+                                             MarkovChain *markov_chain)
 {
-  MarkovNodeFrequency *new_frequency_array = malloc
-      (sizeof (MarkovNodeFrequency));
+  MarkovNodeFrequency *new_frequency_array = arena_alloc
+      (markov_chain->arena, sizeof (MarkovNodeFrequency));
   if (new_frequency_array == NULL)
   {
     return NULL;
   }
   first_node->frequencies_list = new_frequency_array;
-  first_node->frequencies_list[first_node->current_successive_nodes].next =
-      second_node;
+  first_node->successors_capacity = 1;
+  first_node->frequencies_list[first_node->current_successive_nodes].next_id =
+      second_node->id;
   first_node->frequencies_list[first_node->current_successive_nodes].frequency
       = 1;
   first_node->current_successive_nodes++;
@@ -149,74 +627,644 @@ MarkovNodeFrequency *create_frequency_array (MarkovNode *first_node,
 
 }
 MarkovNodeFrequency *expand_frequency_array (MarkovNode *first_node,
-                                             MarkovNode *second_node)
+                                             MarkovNode *second_node,
+                                             MarkovChain *markov_chain)
 {
-  MarkovNodeFrequency *new_frequency_list = realloc (first_node->
-      frequencies_list, (first_node->current_successive_nodes + 1)
-                        * sizeof (MarkovNodeFrequency));
-  if (new_frequency_list == NULL)
+  if (first_node->current_successive_nodes
+      == first_node->successors_capacity)
   {
-    return NULL;
+    // the array is full, move it to one twice as big and give the old one
+    // back to the arena
+    MARKOV_STAT (markov_chain, successor_reallocs, 1);
+    int new_capacity = first_node->successors_capacity * 2;
+    MarkovNodeFrequency *new_frequency_list = arena_alloc
+        (markov_chain->arena, new_capacity * sizeof (MarkovNodeFrequency));
+    if (new_frequency_list == NULL)
+    {
+      return NULL;
+    }
+    memcpy (new_frequency_list, first_node->frequencies_list,
+            first_node->current_successive_nodes
+            * sizeof (MarkovNodeFrequency));
+    arena_release (markov_chain->arena, first_node->frequencies_list,
+                   first_node->successors_capacity
+                   * sizeof (MarkovNodeFrequency));
+    first_node->frequencies_list = new_frequency_list;
+    first_node->successors_capacity = new_capacity;
   }
   // Add second_node to the end of the frequency list and set its frequency
   // to 1
-  first_node->frequencies_list = new_frequency_list;
-  first_node->frequencies_list[first_node->current_successive_nodes].next =
-      second_node;
+  first_node->frequencies_list[first_node->current_successive_nodes].next_id =
+      second_node->id;
   first_node->frequencies_list[first_node->current_successive_nodes].frequency
       = 1;
   first_node->current_successive_nodes++;
-  return new_frequency_list;
+  return first_node->frequencies_list;
 }
 bool add_node_to_frequencies_list (MarkovNode *first_node, MarkovNode
 *second_node, MarkovChain *markov_chain)
+{
+  return add_transition_count (first_node, second_node, 1, markov_chain);
+}
+bool add_transition_count (MarkovNode *first_node, MarkovNode *second_node,
+                           int count, MarkovChain *markov_chain)
 {
   if (!first_node || !second_node)
   {
     return false;
   }
+  MARKOV_STAT (markov_chain, transitions, 1);
+  // the sampler of a frozen node no longer matches its frequencies
+  release_sampler (first_node, markov_chain);
   if (first_node->frequencies_list == NULL)
   {
     MarkovNodeFrequency *new_frequency_array = create_frequency_array
-        (first_node, second_node);
+        (first_node, second_node, markov_chain);
     if (new_frequency_array == NULL)
     {
       return false;
     }
+    new_frequency_array[0].frequency = count;
+    first_node->total_occurrences += count;
     return true;
 
   }
   // Check if second_node is already in the frequency list of first_node
-  for (int i = 0; i < first_node->current_successive_nodes; i++)
+  int position = find_successor (markov_chain, first_node, second_node);
+  if (position != -1)
   {
-    if (!markov_chain->comp_func (first_node->frequencies_list[i].next->data,
-                                  second_node->data))
-    {
-      // If so, increment its frequency and return success
-      first_node->frequencies_list[i].frequency++;
-      return true;
-    }
+    // If so, increment its frequency and return success
+    first_node->frequencies_list[position].frequency += count;
+    first_node->total_occurrences += count;
+    return true;
+  }
+  // If second_node is not in the frequency list, allocate new memory for it.
+  // the index is grown first, so a failure leaves no successor unindexed
+  if (!successor_index_reserve (first_node,
+                                first_node->current_successive_nodes + 1,
+                                markov_chain->arena))
+  {
+    return false;
   }
-  // If second_node is not in the frequency list, allocate new memory for it
   MarkovNodeFrequency *new_frequency_list = expand_frequency_array
-      (first_node, second_node);
+      (first_node, second_node, markov_chain);
   if (new_frequency_list == NULL)
   {
     return false;
   }
-
+  new_frequency_list[first_node->current_successive_nodes - 1].frequency
+      = count;
+  first_node->total_occurrences += count;
+  // the states in the database are unique, so successors are compared by
+  // identity and the comp_func of the chain is not needed.
+  successor_index_insert (first_node);
   return true;
 
 }
+/**
+ * hash a state id, the ids are dense so they are mixed to spread them over
+ * the whole index.
+ */
+static size_t hash_successor (uint32_t id)
+{
+  unsigned long long key = id;
+  key ^= key >> 16;
+  key *= 0x45d9f3bULL;
+  key ^= key >> 16;
+  return (size_t) key;
+}
+static int find_successor (MarkovChain *markov_chain, MarkovNode *first_node,
+                           MarkovNode *second_node)
+{
+  (void) markov_chain;// used only by the stats
+  if (first_node->successor_index == NULL)
+  {
+    for (int i = 0; i < first_node->current_successive_nodes; i++)
+    {
+      MARKOV_STAT (markov_chain, successor_probes, 1);
+      if (first_node->frequencies_list[i].next_id == second_node->id)
+      {
+        return i;
+      }
+    }
+    return -1;
+  }
+  size_t mask = (size_t) first_node->successor_index_capacity - 1;
+  for (size_t i = hash_successor (second_node->id) & mask;
+       first_node->successor_index[i] != -1; i = (i + 1) & mask)
+  {
+    MARKOV_STAT (markov_chain, successor_probes, 1);
+    int position = first_node->successor_index[i];
+    if (first_node->frequencies_list[position].next_id == second_node->id)
+    {
+      return position;
+    }
+  }
+  return -1;
+}
+/**
+ * put a position of the frequencies list of a node in its successor index.
+ */
+static void successor_index_place (MarkovNode *node, int position)
+{
+  size_t mask = (size_t) node->successor_index_capacity - 1;
+  size_t i = hash_successor (node->frequencies_list[position].next_id)
+             & mask;
+  while (node->successor_index[i] != -1)
+  {
+    i = (i + 1) & mask;
+  }
+  node->successor_index[i] = position;
+}
+static bool successor_index_reserve (MarkovNode *node, int size,
+                                     Arena *arena)
+{
+  if (size <= SUCCESSOR_INDEX_THRESHOLD
+      || (node->successor_index != NULL
+          && size * 2 <= node->successor_index_capacity))
+  {
+    return true;
+  }
+  // (re)build the index from all the current successors of the node
+  int capacity = SUCCESSOR_INDEX_THRESHOLD * 4;
+  while (size * 2 > capacity)
+  {
+    capacity *= 2;
+  }
+  int *new_index = arena_alloc (arena, capacity * sizeof (int));
+  if (new_index == NULL)
+  {
+    return false;
+  }
+  for (int i = 0; i < capacity; i++)
+  {
+    new_index[i] = -1;
+  }
+  arena_release (arena, node->successor_index,
+                 node->successor_index_capacity * sizeof (int));
+  node->successor_index = new_index;
+  node->successor_index_capacity = capacity;
+  for (int position = 0; position < node->current_successive_nodes;
+       position++)
+  {
+    successor_index_place (node, position);
+  }
+  return true;
+}
+static void successor_index_insert (MarkovNode *node)
+{
+  if (node->successor_index != NULL)
+  {
+    successor_index_place (node, node->current_successive_nodes - 1);
+  }
+}
+//*********************freezing**************************************//
+/**
+ * the number of uint32_t in the sampler of a node of the given kind.
+ */
+static size_t sampler_length (const MarkovNode *node, SamplerKind kind)
+{
+  size_t successors = (size_t) node->current_successive_nodes;
+  return (kind == SAMPLER_ALIAS) ? 2 * successors : successors;
+}
+static void release_sampler (MarkovNode *node, MarkovChain *markov_chain)
+{
+  if (node->sampler == NULL)
+  {
+    return;
+  }
+  arena_release (markov_chain->arena, node->sampler,
+                 sampler_length (node, markov_chain->sampler_kind)
+                 * sizeof (uint32_t));
+  node->sampler = NULL;
+}
+bool build_alias_table (const uint32_t *weights, uint32_t size,
+                        uint32_t *threshold, uint32_t *alias)
+{
+  unsigned long long total = 0;
+  for (uint32_t i = 0; i < size; i++)
+  {
+    total += weights[i];
+  }
+  // scaled[i] is the weight of outcome i out of size * total, every column
+  // holds exactly total of it. small and large share one array of indices,
+  // the small ones growing from the start and the large ones from the end.
+  unsigned long long *scaled = malloc (size * sizeof (unsigned long long));
+  uint32_t *work = malloc (size * sizeof (uint32_t));
+  if (scaled == NULL || work == NULL)
+  {
+    free (scaled);
+    free (work);
+    return false;
+  }
+  uint32_t small = 0, large = size;
+  for (uint32_t i = 0; i < size; i++)
+  {
+    scaled[i] = (unsigned long long) weights[i] * size;
+    if (scaled[i] < total)
+    {
+      work[small++] = i;
+    }
+    else
+    {
+      work[--large] = i;
+    }
+  }
+  while (small > 0 && large < size)
+  {
+    uint32_t less = work[--small];
+    uint32_t more = work[large++];
+    threshold[less] = (uint32_t) scaled[less];
+    alias[less] = more;
+    // the rest of the column of less is filled from more
+    scaled[more] -= total - scaled[less];
+    if (scaled[more] < total)
+    {
+      work[small++] = more;
+    }
+    else
+    {
+      work[--large] = more;
+    }
+  }
+  // what is left fills a whole column
+  for (uint32_t i = 0; i < small; i++)
+  {
+    threshold[work[i]] = (uint32_t) total;
+    alias[work[i]] = work[i];
+  }
+  for (uint32_t i = large; i < size; i++)
+  {
+    threshold[work[i]] = (uint32_t) total;
+    alias[work[i]] = work[i];
+  }
+  free (scaled);
+  free (work);
+  return true;
+}
+static bool build_node_alias_table (MarkovNode *node, uint32_t *sampler)
+{
+  uint32_t size = (uint32_t) node->current_successive_nodes;
+  uint32_t *weights = malloc (size * sizeof (uint32_t));
+  if (weights == NULL)
+  {
+    return false;
+  }
+  for (uint32_t i = 0; i < size; i++)
+  {
+    weights[i] = (uint32_t) node->frequencies_list[i].frequency;
+  }
+  bool success = build_alias_table (weights, size, sampler, sampler + size);
+  free (weights);
+  return success;
+}
+uint32_t sample_alias_table (const uint32_t *threshold, const uint32_t *alias,
+                             uint32_t size, uint32_t total, Rng *rng)
+{
+  uint32_t column = rng_bounded (rng, size);
+  if (rng_bounded (rng, total) < threshold[column])
+  {
+    return column;
+  }
+  return alias[column];
+}
+uint32_t sample_cumulative (const uint32_t *cumulative, uint32_t size,
+                            Rng *rng)
+{
+  uint32_t random_number = rng_bounded (rng, cumulative[size - 1]);
+  // binary search for the first cumulative frequency above random_number
+  uint32_t low = 0, high = size - 1;
+  while (low < high)
+  {
+    uint32_t middle = low + (high - low) / 2;
+    if (cumulative[middle] > random_number)
+    {
+      high = middle;
+    }
+    else
+    {
+      low = middle + 1;
+    }
+  }
+  return low;
+}
+bool freeze_markov_chain (MarkovChain *markov_chain, SamplerKind kind)
+{
+  if (markov_chain->database == NULL)
+  {
+    return true;
+  }
+  // samplers of the previous kind are dropped before the kind changes
+  for (uint32_t id = 0; id < (uint32_t) markov_chain->database->size; id++)
+  {
+    release_sampler (markov_chain->states[id], markov_chain);
+  }
+  markov_chain->sampler_kind = kind;
+  for (uint32_t id = 0; id < (uint32_t) markov_chain->database->size; id++)
+  {
+    MarkovNode *node = markov_chain->states[id];
+    if (node->current_successive_nodes == 0)
+    {
+      continue;
+    }
+    uint32_t *sampler = arena_alloc (markov_chain->arena,
+                                     sampler_length (node, kind)
+                                     * sizeof (uint32_t));
+    if (sampler == NULL)
+    {
+      return false;
+    }
+    if (kind == SAMPLER_ALIAS)
+    {
+      if (!build_node_alias_table (node, sampler))
+      {
+        arena_release (markov_chain->arena, sampler,
+                       sampler_length (node, kind) * sizeof (uint32_t));
+        return false;
+      }
+    }
+    else
+    {
+      uint32_t cumulative = 0;
+      for (int i = 0; i < node->current_successive_nodes; i++)
+      {
+        cumulative += (uint32_t) node->frequencies_list[i].frequency;
+        sampler[i] = cumulative;
+      }
+    }
+    node->sampler = sampler;
+  }
+  return true;
+}
+//*********************pruning**************************************//
+static size_t memory_in_use (const MarkovMemory *memory)
+{
+  return memory->nodes_bytes + memory->markov_nodes_bytes
+         + memory->frequencies_used_bytes + memory->frequencies_slack_bytes
+         + memory->samplers_bytes + memory->successor_index_bytes
+         + memory->payload_bytes + memory->tables_bytes;
+}
+static size_t compact_successors (MarkovNode *node, int min_frequency,
+                                  const uint32_t *new_ids)
+{
+  int kept = 0;
+  for (int i = 0; i < node->current_successive_nodes; i++)
+  {
+    MarkovNodeFrequency successor = node->frequencies_list[i];
+    if (successor.frequency < min_frequency
+        || new_ids[successor.next_id] == PRUNED_STATE)
+    {
+      node->total_occurrences -= successor.frequency;
+      continue;
+    }
+    successor.next_id = new_ids[successor.next_id];
+    node->frequencies_list[kept++] = successor;
+  }
+  size_t removed = (size_t) (node->current_successive_nodes - kept);
+  node->current_successive_nodes = kept;
+  return removed;
+}
+static bool shrink_successors (MarkovNode *node, Arena *arena)
+{
+  int size = node->current_successive_nodes;
+  MarkovNodeFrequency *exact = NULL;
+  if (size > 0 && size < node->successors_capacity)
+  {
+    exact = arena_alloc (arena, size * sizeof (MarkovNodeFrequency));
+  }
+  if (size < node->successors_capacity && (size == 0 || exact != NULL))
+  {
+    if (size > 0)
+    {
+      memcpy (exact, node->frequencies_list,
+              size * sizeof (MarkovNodeFrequency));
+    }
+    arena_release (arena, node->frequencies_list,
+                   node->successors_capacity * sizeof (MarkovNodeFrequency));
+    node->frequencies_list = exact;
+    node->successors_capacity = size;
+  }
+  // the positions in the list changed, so the index is built again
+  arena_release (arena, node->successor_index,
+                 node->successor_index_capacity * sizeof (int));
+  node->successor_index = NULL;
+  node->successor_index_capacity = 0;
+  return successor_index_reserve (node, size, arena);
+}
+static void renumber_state_ids (uint32_t *ids, uint32_t *size,
+                                const uint32_t *new_ids)
+{
+  uint32_t kept = 0;
+  for (uint32_t i = 0; i < *size; i++)
+  {
+    if (new_ids[ids[i]] != PRUNED_STATE)
+    {
+      ids[kept++] = new_ids[ids[i]];
+    }
+  }
+  *size = kept;
+}
+bool prune_markov_chain (MarkovChain *markov_chain, int min_frequency,
+                         MarkovPruneReport *report)
+{
+  memset (report, 0, sizeof (MarkovPruneReport));
+  MarkovMemory memory;
+  measure_markov_chain (markov_chain, &memory);
+  report->bytes_before = memory_in_use (&memory);
+  report->bytes_after = report->bytes_before;
+  if (markov_chain->database == NULL || markov_chain->database->size == 0)
+  {
+    return true;
+  }
+  uint32_t size = (uint32_t) markov_chain->database->size;
+  MarkovNode **states = markov_chain->states;
+  // the predecessors of every state, as offsets into one array of ids
+  uint32_t *new_ids = malloc (size * sizeof (uint32_t));
+  uint32_t *live_successors = malloc (size * sizeof (uint32_t));
+  uint32_t *queue = malloc (size * sizeof (uint32_t));
+  size_t *offsets = calloc ((size_t) size + 1, sizeof (size_t));
+  uint32_t *predecessors = malloc ((memory.transitions + 1)
+                                   * sizeof (uint32_t));
+  if (new_ids == NULL || live_successors == NULL || queue == NULL
+      || offsets == NULL || predecessors == NULL)
+  {
+    free (new_ids);
+    free (live_successors);
+    free (queue);
+    free (offsets);
+    free (predecessors);
+    return false;
+  }
+  // the rare transitions go first, the states are all kept until now
+  for (uint32_t id = 0; id < size; id++)
+  {
+    new_ids[id] = id;
+  }
+  for (uint32_t id = 0; id < size; id++)
+  {
+    release_sampler (states[id], markov_chain);
+    report->transitions_removed += compact_successors (states[id],
+                                                       min_frequency,
+                                                       new_ids);
+    for (int i = 0; i < states[id]->current_successive_nodes; i++)
+    {
+      offsets[states[id]->frequencies_list[i].next_id + 1]++;
+    }
+  }
+  for (uint32_t id = 0; id < size; id++)
+  {
+    offsets[id + 1] += offsets[id];
+  }
+  // a state that is not last and has no successors is a dead end, and so
+  // are its predecessors once all their successors are dead ends.
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  for (uint32_t id = 0; id < size; id++)
+  {
+    MarkovNode *node = states[id];
+    live_successors[id] = (uint32_t) node->current_successive_nodes;
+    for (int i = 0; i < node->current_successive_nodes; i++)
+    {
+      uint32_t next_id = node->frequencies_list[i].next_id;
+      predecessors[offsets[next_id]++] = id;
+    }
+    if (live_successors[id] == 0 && !markov_chain->is_last (node->data))
+    {
+      new_ids[id] = PRUNED_STATE;
+      queue[tail++] = id;
+    }
+  }
+  // filling the predecessors moved every offset to the start of the next
+  // state, move them back
+  for (uint32_t id = size; id > 0; id--)
+  {
+    offsets[id] = offsets[id - 1];
+  }
+  offsets[0] = 0;
+  while (head < tail)
+  {
+    uint32_t dead = queue[head++];
+    for (size_t i = offsets[dead]; i < offsets[dead + 1]; i++)
+    {
+      uint32_t id = predecessors[i];
+      if (new_ids[id] != PRUNED_STATE && --live_successors[id] == 0
+          && !markov_chain->is_last (states[id]->data))
+      {
+        new_ids[id] = PRUNED_STATE;
+        queue[tail++] = id;
+      }
+    }
+  }
+  // a walk starts from the sentence starts when they are weighted and from
+  // any state that is not last otherwise, and the rest is reachable only
+  // through them. the ids of the reached states are marked by id + 1 until
+  // they are renumbered.
+  head = 0;
+  tail = 0;
+  bool weighted = markov_chain->weighted_starts
+                  && markov_chain->num_sentence_starts > 0;
+  uint32_t *starts = weighted ? markov_chain->sentence_starts
+                              : markov_chain->start_candidates;
+  uint32_t num_starts = weighted ? markov_chain->num_sentence_starts
+                                 : markov_chain->num_start_candidates;
+  for (uint32_t i = 0; i < num_starts; i++)
+  {
+    uint32_t id = starts[i];
+    if (new_ids[id] == id)
+    {
+      new_ids[id] = id + 1;
+      queue[tail++] = id;
+    }
+  }
+  while (head < tail)
+  {
+    MarkovNode *node = states[queue[head++]];
+    for (int i = 0; i < node->current_successive_nodes; i++)
+    {
+      uint32_t id = node->frequencies_list[i].next_id;
+      if (new_ids[id] == id)
+      {
+        new_ids[id] = id + 1;
+        queue[tail++] = id;
+      }
+    }
+  }
+  free (live_successors);
+  free (queue);
+  free (offsets);
+  free (predecessors);
+  // the reached states are renumbered in database order and the others are
+  // unlinked from the database and freed
+  uint32_t kept = 0;
+  Node *previous = NULL;
+  Node *current = markov_chain->database->first;
+  while (current != NULL)
+  {
+    Node *next = current->next;
+    uint32_t id = current->data->id;
+    if (new_ids[id] == id + 1)
+    {
+      new_ids[id] = kept++;
+      previous = current;
+    }
+    else
+    {
+      new_ids[id] = PRUNED_STATE;
+      if (previous == NULL)
+      {
+        markov_chain->database->first = next;
+      }
+      else
+      {
+        previous->next = next;
+      }
+      report->states_removed++;
+      report->transitions_removed += (size_t) current->data
+          ->current_successive_nodes;
+      free_markov_node (current->data, markov_chain);
+      free_node (current, markov_chain);
+    }
+    current = next;
+  }
+  markov_chain->database->last = previous;
+  markov_chain->database->size = (int) kept;
+  for (Node *node = markov_chain->database->first; node != NULL;
+       node = node->next)
+  {
+    MarkovNode *markov_node = node->data;
+    report->transitions_removed += compact_successors (markov_node, 0,
+                                                       new_ids);
+    markov_node->id = new_ids[markov_node->id];
+    states[markov_node->id] = markov_node;
+    // a node left without a successor index keeps working by scanning its
+    // list
+    shrink_successors (markov_node, markov_chain->arena);
+  }
+  renumber_state_ids (markov_chain->start_candidates,
+                      &markov_chain->num_start_candidates, new_ids);
+  renumber_state_ids (markov_chain->sentence_starts,
+                      &markov_chain->num_sentence_starts, new_ids);
+  free (new_ids);
+  bool indexed = markov_chain->hash_func == NULL
+                 || set_hash_func (markov_chain, markov_chain->hash_func);
+  measure_markov_chain (markov_chain, &memory);
+  report->bytes_after = memory_in_use (&memory);
+  return indexed;
+}
 //**********************free functions**********************************//
 void free_markov_node (MarkovNode *markov_node, MarkovChain *ptr_chain)
 {
-  free (markov_node->frequencies_list);
+  release_sampler (markov_node, ptr_chain);
+  arena_release (ptr_chain->arena, markov_node->frequencies_list,
+                 markov_node->successors_capacity
+                 * sizeof (MarkovNodeFrequency));
   markov_node->frequencies_list = NULL;
+  arena_release (ptr_chain->arena, markov_node->successor_index,
+                 markov_node->successor_index_capacity * sizeof (int));
+  markov_node->successor_index = NULL;
   ptr_chain->free_data ((markov_node->data));
   markov_node->data = NULL;
-  free (markov_node);
-  markov_node = NULL;
+  arena_release (ptr_chain->arena, markov_node, sizeof (MarkovNode));
 }
 void free_database (MarkovChain **markov_chain)
 {
@@ -225,95 +1273,101 @@ void free_database (MarkovChain **markov_chain)
   {
     return;
   }
+  free ((*markov_chain)->index);
+  (*markov_chain)->index = NULL;
+  free ((*markov_chain)->states);
+  (*markov_chain)->states = NULL;
+  free ((*markov_chain)->start_candidates);
+  (*markov_chain)->start_candidates = NULL;
+  free ((*markov_chain)->sentence_starts);
+  (*markov_chain)->sentence_starts = NULL;
   LinkedList *database = (*markov_chain)->database;
-  // if database is null just free the chain.
-  if (database == NULL)
+  if (database != NULL)
   {
-    free (*markov_chain);
-    *markov_chain = NULL;
-    return;
-  }
-  Node *current = database->first;
-  // for each node in the database we free the frequency list of the
-  // markovnode of the node first. Then we free the markovnode in the data
-  // field of the node itself, and finally we free the node. then moving to
-  // the next node.
-  while (current != NULL)
-  {
-    MarkovNode *markov_node = current->data;
-    free_markov_node (markov_node, *markov_chain);
-    Node *next = current->next;
-    free_node (current);
-    current = next;
+    // the nodes, MarkovNodes and frequency arrays all live in the arena of
+    // the chain, so only the data copies are freed one by one.
+    for (Node *current = database->first; current != NULL;
+         current = current->next)
+    {
+      (*markov_chain)->free_data (current->data->data);
+    }
+    free (database);
+    (*markov_chain)->database = NULL;
   }
-  free ((*markov_chain)->database);
-  (*markov_chain)->database = NULL;
+  arena_free ((*markov_chain)->arena);
+  (*markov_chain)->arena = NULL;
   free (*markov_chain);
   *markov_chain = NULL;
 }
-void free_node (Node *current)
+void free_node (Node *current, MarkovChain *ptr_chain)
 {
-  free (current);
-  current = NULL;
+  arena_release (ptr_chain->arena, current, sizeof (Node));
 }
 //***********random chain generators*****************************//
-MarkovNode *get_first_random_node (MarkovChain *markov_chain)
+MarkovNode *get_first_random_node (MarkovChain *markov_chain, Rng *rng)
 {
   // checks if the pointer or the data inside is valid
-  if ((markov_chain == NULL) || (markov_chain->database == NULL) ||
-      (markov_chain->database->first == NULL) || (
-          (markov_chain->database->first->data == NULL)))
+  if ((markov_chain == NULL) || (markov_chain->database == NULL))
   {
     return NULL;
   }
-  Node *current = markov_chain->database->first;
-
-  while (true)
+  // the candidates are never last, so a draw is never retried
+  MARKOV_STAT (markov_chain, first_node_draws, 1);
+  if (markov_chain->weighted_starts && markov_chain->num_sentence_starts > 0)
   {
-    current = markov_chain->database->first;
-    int i = get_random_number (markov_chain->database->size);
-    for (int j = 0; j < i; j++)
-    {
-      current = current->next;
-    }
-    if (current == NULL)
-    {
-      return NULL;
-    }
-    if (!(markov_chain->is_last (current->data->data)))
-    {
-      break;
-    }
-
+    int i = get_random_number (rng,
+                               (int) markov_chain->num_sentence_starts);
+    return markov_chain->states[markov_chain->sentence_starts[i]];
   }
-
-  return current->data;
+  if (markov_chain->num_start_candidates == 0)
+  {
+    return NULL;
+  }
+  int i = get_random_number (rng, (int) markov_chain->num_start_candidates);
+  return markov_chain->states[markov_chain->start_candidates[i]];
 }
-MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr)
+MarkovNode *get_next_random_node (MarkovChain *markov_chain,
+                                  MarkovNode *state_struct_ptr, Rng *rng)
 {
   // Check if the state_struct_ptr or its frequencies_list is NULL
   if (state_struct_ptr == NULL || state_struct_ptr->frequencies_list == NULL)
   {
     return NULL;
   }
-  int total_occurrences = 0;
-  for (int i = 0; i < state_struct_ptr->current_successive_nodes; i++)
+  MARKOV_STAT (markov_chain, next_node_draws, 1);
+  const MarkovNodeFrequency *successors = state_struct_ptr->frequencies_list;
+  int total_occurrences = state_struct_ptr->total_occurrences;
+  uint32_t *sampler = state_struct_ptr->sampler;
+  if (sampler != NULL)
   {
-    total_occurrences += state_struct_ptr->frequencies_list[i].frequency;
+    uint32_t size = (uint32_t) state_struct_ptr->current_successive_nodes;
+    uint32_t chosen;
+    if (markov_chain->sampler_kind == SAMPLER_ALIAS)
+    {
+      chosen = sample_alias_table (sampler, sampler + size, size,
+                                   (uint32_t) total_occurrences, rng);
+    }
+    else
+    {
+      chosen = sample_cumulative (sampler, size, rng);
+    }
+    return markov_chain->states[successors[chosen].next_id];
   }
 
   // Generate a random number within the range of total_occurrences
-  int random_number = get_random_number (total_occurrences);
+  int random_number = get_random_number (rng, total_occurrences);
 
   // Iterate through the frequencies_list to find the word corresponding
   // to the random_number
   int cumulative_occurrences = 0;
   for (int i = 0; i < state_struct_ptr->current_successive_nodes; i++)
   {
+    MARKOV_STAT (markov_chain, next_node_scans, 1);
     cumulative_occurrences += state_struct_ptr->frequencies_list[i].frequency;
     if (random_number < cumulative_occurrences)
     {
-      return state_struct_ptr->frequencies_list[i].next;
+      return markov_chain->states[state_struct_ptr->frequencies_list[i]
+          .next_id];
     }
   }
 
@@ -321,7 +1375,7 @@ MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr)
   return NULL;
 }
 void generate_tweet (MarkovChain *markov_chain, MarkovNode *
-first_node, int max_length)
+first_node, int max_length, Rng *rng)
 {
   // checks if the pointer or the data inside is valid
   if ((markov_chain == NULL) || (markov_chain->database == NULL) ||
@@ -333,23 +1387,178 @@ first_node, int max_length)
   }
   if (first_node == NULL)
   {
-    first_node = get_first_random_node (markov_chain);
+    first_node = get_first_random_node (markov_chain, rng);
+    if (first_node == NULL)
+    {
+      return;
+    }
   }
+  MARKOV_STAT (markov_chain, walks, 1);
   MarkovNode *current = first_node;
   while ((max_length > 1) && (current->current_successive_nodes > 0) && (!
       (markov_chain->is_last
           (current->data))))
   {
     markov_chain->print_func (current->data);
-    current = get_next_random_node (current);
+    MARKOV_STAT (markov_chain, walk_steps, 1);
+    current = get_next_random_node (markov_chain, current, rng);
 
     max_length--;
   }
   markov_chain->print_func (current->data);
+  MARKOV_STAT (markov_chain, walk_steps, 1);
 
 }
-int get_random_number (int max_number)
+double markov_stats_clock (void)
 {
-
-  return rand () % max_number;
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec + (double) now.tv_nsec / 1e9;
+}
+void print_markov_stats (const MarkovStats *stats, FILE *stream)
+{
+  static const char *const phase_names[MARKOV_PHASES] = {
+      "train", "compile", "generate"
+  };
+  for (int phase = 0; phase < MARKOV_PHASES; phase++)
+  {
+    fprintf (stream, "%-9s %10.3f ms\n", phase_names[phase],
+             stats->phase_seconds[phase] * 1000.0);
+  }
+#ifdef MARKOV_STATS
+  // the averages are written as a ratio of two counters, 0 if none was seen
+#define STATS_RATIO(a, b) ((b) == 0 ? 0.0 : (double) (a) / (double) (b))
+  fprintf (stream, "lookups              %12llu (%.2f probes, %.2f "
+                   "comparisons each)\n",
+           (unsigned long long) stats->lookups,
+           STATS_RATIO (stats->lookup_probes, stats->lookups),
+           STATS_RATIO (stats->comparisons, stats->lookups));
+  fprintf (stream, "transitions          %12llu (%.2f successors scanned "
+                   "each)\n",
+           (unsigned long long) stats->transitions,
+           STATS_RATIO (stats->successor_probes, stats->transitions));
+  fprintf (stream, "successor reallocs   %12llu\n",
+           (unsigned long long) stats->successor_reallocs);
+  fprintf (stream, "first node draws     %12llu (0 retries)\n",
+           (unsigned long long) stats->first_node_draws);
+  fprintf (stream, "next node draws      %12llu (%.2f successors scanned "
+                   "each)\n",
+           (unsigned long long) stats->next_node_draws,
+           STATS_RATIO (stats->next_node_scans, stats->next_node_draws));
+  fprintf (stream, "walks                %12llu (%.2f steps each)\n",
+           (unsigned long long) stats->walks,
+           STATS_RATIO (stats->walk_steps, stats->walks));
+#undef STATS_RATIO
+#else
+  fprintf (stream, "counters compiled out, build with make STATS=1\n");
+#endif
+}
+void measure_markov_chain (const MarkovChain *markov_chain,
+                           MarkovMemory *memory)
+{
+  memset (memory, 0, sizeof (MarkovMemory));
+  memory->tables_bytes = markov_chain->index_capacity
+                         * sizeof (DatabaseIndexSlot)
+                         + markov_chain->states_capacity
+                           * sizeof (MarkovNode *)
+                         + (markov_chain->start_candidates_capacity
+                            + markov_chain->sentence_starts_capacity)
+                           * sizeof (uint32_t);
+  for (const ArenaBlock *block = markov_chain->arena->blocks; block != NULL;
+       block = block->next)
+  {
+    memory->arena_bytes += sizeof (ArenaBlock) + block->size;
+  }
+  if (markov_chain->database == NULL)
+  {
+    return;
+  }
+  memory->tables_bytes += sizeof (LinkedList);
+  for (const Node *current = markov_chain->database->first; current != NULL;
+       current = current->next)
+  {
+    const MarkovNode *node = current->data;
+    size_t successors = (size_t) node->current_successive_nodes;
+    memory->states++;
+    memory->transitions += successors;
+    memory->nodes_bytes += sizeof (Node);
+    memory->markov_nodes_bytes += sizeof (MarkovNode);
+    memory->frequencies_used_bytes += successors
+                                      * sizeof (MarkovNodeFrequency);
+    memory->frequencies_slack_bytes += ((size_t) node->successors_capacity
+                                        - successors)
+                                       * sizeof (MarkovNodeFrequency);
+    if (node->sampler != NULL)
+    {
+      memory->samplers_bytes += sampler_length (node,
+                                                markov_chain->sampler_kind)
+                                * sizeof (uint32_t);
+    }
+    memory->successor_index_bytes += (size_t) node->successor_index_capacity
+                                     * sizeof (int);
+    if (markov_chain->size_func != NULL)
+    {
+      memory->payload_bytes += markov_chain->size_func (node->data);
+    }
+    int bucket = 0;
+    while (successors > 0 && bucket < MEMORY_SUCCESSOR_BUCKETS - 1)
+    {
+      successors >>= 1;
+      bucket++;
+    }
+    memory->successors_histogram[bucket]++;
+  }
+}
+void print_markov_memory (const MarkovMemory *memory, FILE *stream)
+{
+  size_t frequencies = memory->frequencies_used_bytes
+                       + memory->frequencies_slack_bytes;
+  fprintf (stream, "states               %12zu\n", memory->states);
+  fprintf (stream, "transitions          %12zu\n", memory->transitions);
+  fprintf (stream, "nodes                %12zu bytes\n", memory->nodes_bytes);
+  fprintf (stream, "markov nodes         %12zu bytes\n",
+           memory->markov_nodes_bytes);
+  fprintf (stream, "frequencies          %12zu bytes (%zu used, %zu slack, "
+                   "%.1f%% slack)\n", frequencies,
+           memory->frequencies_used_bytes, memory->frequencies_slack_bytes,
+           (frequencies == 0) ? 0.0 : 100.0
+                                      * (double) memory->frequencies_slack_bytes
+                                      / (double) frequencies);
+  fprintf (stream, "samplers             %12zu bytes\n",
+           memory->samplers_bytes);
+  fprintf (stream, "successor indexes    %12zu bytes\n",
+           memory->successor_index_bytes);
+  fprintf (stream, "payloads             %12zu bytes\n",
+           memory->payload_bytes);
+  fprintf (stream, "tables               %12zu bytes\n", memory->tables_bytes);
+  fprintf (stream, "arena reserved       %12zu bytes\n", memory->arena_bytes);
+  fprintf (stream, "successors per state:\n");
+  fprintf (stream, "  %10s %12zu\n", "0", memory->successors_histogram[0]);
+  for (int bucket = 1; bucket < MEMORY_SUCCESSOR_BUCKETS; bucket++)
+  {
+    if (memory->successors_histogram[bucket] == 0)
+    {
+      continue;
+    }
+    char range[32];
+    size_t low = (size_t) 1 << (bucket - 1);
+    if (bucket == MEMORY_SUCCESSOR_BUCKETS - 1)
+    {
+      snprintf (range, sizeof (range), "%zu+", low);
+    }
+    else if (low == 1)
+    {
+      snprintf (range, sizeof (range), "1");
+    }
+    else
+    {
+      snprintf (range, sizeof (range), "%zu-%zu", low, 2 * low - 1);
+    }
+    fprintf (stream, "  %10s %12zu\n", range,
+             memory->successors_histogram[bucket]);
+  }
+}
+int get_random_number (Rng *rng, int max_number)
+{
+  return (int) rng_bounded (rng, (uint32_t) max_number);
 }
\ No newline at end of file
@@ -2,13 +2,35 @@
 #define _MARKOV_CHAIN_H
 
 #include "linked_list.h"
+#include "arena.h"
+#include "rng.h"
+#include "byte_buffer.h"
 #include <stdio.h>  // For printf(), sscanf()
 #include <stdlib.h> // For exit(), malloc()
 #include <stdbool.h> // for bool
+#include <stdint.h> // for uint32_t
+
+// a node with up to this number of successors is scanned linearly, above
+// it the successors are hashed.
+#define SUCCESSOR_INDEX_THRESHOLD 8
 
 #define ALLOCATION_ERROR_MASSAGE "Allocation failure: Failed to allocate "\
             "new memory\n"
 
+// the counters of MarkovStats are updated only when built with
+// -DMARKOV_STATS (make STATS=1), else they cost nothing
+#ifdef MARKOV_STATS
+#define MARKOV_STAT(markov_chain, counter, amount) \
+  ((markov_chain)->stats.counter += (amount))
+#else
+#define MARKOV_STAT(markov_chain, counter, amount) ((void) 0)
+#endif
+
+// the buckets of the successors histogram of MarkovMemory: bucket 0 counts
+// the states without successors, bucket k the states with 2^(k-1) to 2^k - 1
+// successors, and the last bucket all the states with more.
+#define MEMORY_SUCCESSOR_BUCKETS 16
+
 
 
 /***************************/
@@ -40,23 +62,127 @@ typedef void *(*copy_func_ptr) (const void *);
 // last item in a collection
 typedef bool (*is_last_func_ptr) (const void *);
 
+// Define a typedef for a function pointer that takes a const void pointer
+// and returns a hash value of the data it points to. Two items that are
+// equal according to the comp_func of the chain must have the same hash.
+typedef size_t (*hash_func_ptr) (const void *);
+
+// Define a typedef for a function pointer that takes a const void pointer
+// and appends it to a byte buffer the way print_func prints it
+// The function returns false if the buffer failed to grow
+typedef bool (*format_func_ptr) (const void *, ByteBuffer *);
+
+// Define a typedef for a function pointer that takes a const void pointer
+// and returns the number of bytes of the data it points to
+// The data is expected to be those bytes with no pointers inside, so it
+// can be written to a file and used from it as is
+typedef size_t (*size_func_ptr) (const void *);
+
 
 /***************************/
 
 
 
+/**
+ * the ways a frozen chain can sample the successor of a state.
+ */
+typedef enum SamplerKind
+{
+    SAMPLER_ALIAS,// Walker/Vose alias table, O(1) per sample
+    SAMPLER_CUMULATIVE// cumulative frequencies, O(log successors) per sample
+} SamplerKind;
+
+/**
+ * the phases of a run whose wall time is kept in MarkovStats.
+ */
+typedef enum MarkovPhase
+{
+    MARKOV_PHASE_TRAIN,// filling the database
+    MARKOV_PHASE_COMPILE,// freezing or compiling the chain
+    MARKOV_PHASE_GENERATE,// generating the walks
+    MARKOV_PHASES
+} MarkovPhase;
+
 /***************************/
 /*        STRUCTS          */
 /***************************/
+/**
+ * what a chain did, to see where the time of a run goes. the counters are
+ * updated only when built with MARKOV_STATS, the phase times are set by the
+ * program running the chain.
+ */
+typedef struct MarkovStats
+{
+    uint64_t lookups;// get_node_from_database calls
+    uint64_t lookup_probes;// index slots or list nodes visited by lookups
+    uint64_t comparisons;// comp_func calls by lookups
+    uint64_t transitions;// transitions added to frequencies lists
+    uint64_t successor_probes;// successors scanned to find a transition
+    uint64_t successor_reallocs;// frequencies lists moved to a bigger array
+    uint64_t first_node_draws;// get_first_random_node calls
+    uint64_t next_node_draws;// get_next_random_node calls
+    uint64_t next_node_scans;// successors scanned by unfrozen draws
+    uint64_t walks;// walks generated
+    uint64_t walk_steps;// states in the generated walks
+    double phase_seconds[MARKOV_PHASES];// wall time of every phase
+} MarkovStats;
+
+/**
+ * the bytes a chain takes, by the structure they are spent on.
+ */
+typedef struct MarkovMemory
+{
+    size_t states;// the number of states in the database
+    size_t transitions;// the number of distinct transitions
+    size_t nodes_bytes;// the linked list Nodes of the database
+    size_t markov_nodes_bytes;// the MarkovNodes
+    size_t frequencies_used_bytes;// the used part of the frequency arrays
+    size_t frequencies_slack_bytes;// allocated but unused frequency slots
+    size_t samplers_bytes;// the samplers built by freeze_markov_chain
+    size_t successor_index_bytes;// the successor indexes of the states
+    size_t payload_bytes;// the data of the states, by the size_func of the
+    // chain, 0 if it has none
+    size_t tables_bytes;// the database list, hash index, states array and
+    // start lists of the chain
+    size_t arena_bytes;// the blocks reserved by the arena of the chain, all
+    // the structures above except the payload and tables live in them
+    size_t successors_histogram[MEMORY_SUCCESSOR_BUCKETS];// the number of
+    // states by their number of successors
+} MarkovMemory;
+
+/**
+ * what prune_markov_chain removed from a chain.
+ */
+typedef struct MarkovPruneReport
+{
+    size_t transitions_removed;// the successors dropped from the lists
+    size_t states_removed;// the states dropped from the database
+    size_t bytes_before;// the bytes the structures of the chain took before
+    // the pruning, as accounted by measure_markov_chain
+    size_t bytes_after;// and after it
+} MarkovPruneReport;
+
 /**
  * this struct represent a node in the markov chain.
  */
 typedef struct MarkovNode
 {
     void *data;// the actual data
+    uint32_t id;// the dense id of the state in the chain, states are
+    // numbered from 0 in the order they were added to the database.
     struct MarkovNodeFrequency *frequencies_list;//a dynamic array to all
     // successor data possible after the current data.
     int current_successive_nodes;
+    int successors_capacity;// the allocated length of frequencies_list
+    int total_occurrences;// the sum of the frequencies in frequencies_list
+    uint32_t *sampler;// built by freeze_markov_chain, NULL if not frozen or
+    // if the node changed since. for SAMPLER_ALIAS holds the thresholds
+    // followed by the aliases of the columns, for SAMPLER_CUMULATIVE the
+    // cumulative frequencies.
+    int *successor_index;// open addressing hash table from a successor
+    // MarkovNode to its position in frequencies_list. built only when the
+    // node has more than SUCCESSOR_INDEX_THRESHOLD successors, NULL before.
+    int successor_index_capacity;// always a power of 2
 } MarkovNode;
 
 typedef struct MarkovNodeFrequency
@@ -65,12 +191,36 @@ typedef struct MarkovNodeFrequency
  * to the data.
  */
 {
-    MarkovNode *next; // the MarkovNode of the successor node.
+    uint32_t next_id; // the id of the MarkovNode of the successor node,
+    // resolved through the states array of the chain.
     int frequency;// the frequency of the successor node after the current
     // node
 } MarkovNodeFrequency;
 
-/* DO NOT ADD or CHANGE variable names in this struct */
+/**
+ * a weighted transition between two states given by their ids, to load a
+ * chain from an edge list.
+ */
+typedef struct MarkovEdge
+{
+    uint32_t from;// the id of the state the transition leaves
+    uint32_t to;// the id of the state the transition leads to
+    uint32_t weight;// the number of times the transition was seen
+} MarkovEdge;
+
+/**
+ * represent a slot in the open addressing hash index of the database.
+ */
+typedef struct DatabaseIndexSlot
+{
+    size_t hash;// the hash of the state stored in node
+    Node *node;// the database node of the state, NULL if the slot is empty
+} DatabaseIndexSlot;
+
+/* the fields from database to is_last are the original interface of the
+ * chain, do not change their names. the fields after them hold the index,
+ * the states by id, the start lists, the arena and the stats of the chain,
+ * and are managed by the functions of this file. */
 typedef struct MarkovChain
 {
     LinkedList *database;
@@ -101,21 +251,79 @@ typedef struct MarkovChain
     //      - true if it's the last state.
     //      - false otherwise.
     is_last_func_ptr is_last;
+
+    // optional pointer to a function that gets a pointer of generic data
+    // type and returns its hash. when set, the database is indexed by an
+    // open addressing hash table alongside the linked list.
+    hash_func_ptr hash_func;
+
+    // the hash index of the database, NULL if hash_func is not set.
+    // index_capacity is always a power of 2.
+    DatabaseIndexSlot *index;
+    size_t index_capacity;
+
+    // optional pointer to a func that receives data from a generic type and
+    // appends it to a byte buffer, copied to the chains compiled from it.
+    format_func_ptr format_func;
+
+    // optional pointer to a func that gets a pointer of generic data type
+    // and returns the number of bytes it takes, used to account the memory
+    // of the chain. the copies made by copy_func are not counted without it.
+    size_func_ptr size_func;
+
+    // the MarkovNodes of the database by their id, so transitions can
+    // refer to states by a 32 bit id. its length is database->size.
+    MarkovNode **states;
+    uint32_t states_capacity;
+
+    // the ids of the states that are not last, in the order they were
+    // added. a walk starts from one of them chosen uniformly.
+    uint32_t *start_candidates;
+    uint32_t num_start_candidates;
+    uint32_t start_candidates_capacity;
+
+    // the id of the first state of every sentence added with
+    // add_sentence_start, so a state appears once per sentence it opened.
+    // when weighted_starts is set a walk starts from one of them chosen
+    // uniformly, i.e. states are weighted by how often they open a sentence.
+    uint32_t *sentence_starts;
+    uint32_t num_sentence_starts;
+    uint32_t sentence_starts_capacity;
+    bool weighted_starts;
+
+    // the kind of the samplers built by the last freeze_markov_chain
+    SamplerKind sampler_kind;
+
+    // the arena the database nodes, MarkovNodes and frequency arrays are
+    // allocated from. freed as a whole by free_database.
+    Arena *arena;
+
+    // the counters and phase times of the chain, for --stats
+    MarkovStats stats;
 } MarkovChain;
 //********************random chain generators*************//
 /**
- * Get one random state from the given markov_chain's database.
+ * Get one random state that is not last from the given markov_chain's
+ * database in O(1). if weighted_starts is set and sentence starts were
+ * added, states are weighted by the number of sentences they opened,
+ * otherwise they are chosen uniformly.
  * @param markov_chain
- * @return
+ * @param rng the generator to draw from
+ * @return the chosen state, NULL if all the states are last
  */
-MarkovNode *get_first_random_node (MarkovChain *markov_chain);
+MarkovNode *get_first_random_node (MarkovChain *markov_chain, Rng *rng);
 
 /**
- * Choose randomly the next state, depend on it's occurrence frequency.
+ * Choose randomly the next state, depend on it's occurrence frequency. uses
+ * the sampler of the state if the chain is frozen, otherwise scans its
+ * frequencies list.
+ * @param markov_chain the chain the state belongs to
  * @param state_struct_ptr MarkovNode to choose from
+ * @param rng the generator to draw from
  * @return MarkovNode of the chosen state
  */
-MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr);
+MarkovNode *get_next_random_node (MarkovChain *markov_chain,
+                                  MarkovNode *state_struct_ptr, Rng *rng);
 
 /**
  * Receive markov_chain, generate and print random sentence out of it. The
@@ -124,15 +332,51 @@ MarkovNode *get_next_random_node (MarkovNode *state_struct_ptr);
  * @param first_node markov_node to start with, if NULL- choose a random
  * markov_node
  * @param  max_length maximum length of chain to generate
+ * @param rng the generator to draw from
  */
 void generate_tweet (MarkovChain *markov_chain, MarkovNode *
-first_node, int max_length);
+first_node, int max_length, Rng *rng);
 /**
- * Get random number between 0 and max_number [0,max_number)
- * @param max_number
+ * Get random number between 0 and max_number [0,max_number), every number
+ * equally likely.
+ * @param rng the generator to draw from
+ * @param max_number a positive bound
  * @return Random number
  */
-int get_random_number (int max_number);
+int get_random_number (Rng *rng, int max_number);
+
+/**
+ * Build the alias table of a discrete distribution: column i is chosen
+ * uniformly, then it gives outcome i with probability threshold[i]/total
+ * and alias[i] otherwise. built with integers only, so the distribution is
+ * exact.
+ * @param weights the positive weights of the outcomes
+ * @param size the number of outcomes
+ * @param threshold out parameter, size thresholds
+ * @param alias out parameter, size aliases
+ * @return true on success, false in case of allocation error.
+ */
+bool build_alias_table (const uint32_t *weights, uint32_t size,
+                        uint32_t *threshold, uint32_t *alias);
+/**
+ * Sample an outcome from an alias table in O(1).
+ * @param threshold,alias the table built by build_alias_table
+ * @param size the number of outcomes
+ * @param total the sum of the weights the table was built from
+ * @param rng the generator to draw from
+ * @return the index of the chosen outcome
+ */
+uint32_t sample_alias_table (const uint32_t *threshold, const uint32_t *alias,
+                             uint32_t size, uint32_t total, Rng *rng);
+/**
+ * Sample an outcome from cumulative weights in O(log size).
+ * @param cumulative the cumulative sums of the weights of the outcomes
+ * @param size the number of outcomes
+ * @param rng the generator to draw from
+ * @return the index of the chosen outcome
+ */
+uint32_t sample_cumulative (const uint32_t *cumulative, uint32_t size,
+                            Rng *rng);
 
 //****************adders-getters**************************//
 /**
@@ -153,6 +397,35 @@ Node *get_node_from_database (MarkovChain *markov_chain, void *data_ptr);
  * @return node wrapping given data_ptr in given chain's database
  */
 Node *add_to_database (MarkovChain *markov_chain, void *data_ptr);
+/**
+ * Add many new states to the end of the database at once, without looking
+ * any of them up: the states array and the hash index are grown once for
+ * all of them. the states get the next ids in the order of data.
+ * @param markov_chain the chain to add to
+ * @param data the states to add, copied with copy_func. none of them may
+ * be in the database already, and they must be distinct.
+ * @param count the number of states
+ * @return true on success, false in case of allocation error (the states
+ * added before the error stay in the database).
+ */
+bool add_states_to_database (MarkovChain *markov_chain, void *const *data,
+                             uint32_t count);
+/**
+ * Add a list of transitions between states of the chain at once. the
+ * successors of every state are counted first, so its frequencies list is
+ * grown once to fit all of them. a transition that is already in the
+ * chain, or appears more than once in edges, adds up its weights.
+ * @param markov_chain
+ * @param edges the transitions, their ids must be states of the chain and
+ * their weights positive. the weights leaving a state, with those it has
+ * already, must sum to at most INT_MAX.
+ * @param count the number of transitions
+ * @return true on success, false if an edge is invalid or a sum is too big
+ * (the chain is not changed then) or in case of allocation error (the
+ * edges added before the error stay in the chain).
+ */
+bool add_edges_to_database (MarkovChain *markov_chain,
+                            const MarkovEdge *edges, size_t count);
 /**
 * creates new Linked list struct. The function assume the data fields are
     * valid/
@@ -165,15 +438,16 @@ Node *add_to_database (MarkovChain *markov_chain, void *data_ptr);
 */
 LinkedList *create_linked_list (Node *first, Node *last, int size);
 /**
- * This function gets a pointer to a copy function and use it to create a new
- * markov node with a the data in the data_ptr
+ * This function uses the copy function of the chain to create a new
+ * markov node with a copy of the data in the data_ptr
+ * @param markov_chain the chain whose arena the node is allocated from
  * @param data_ptr
- * @param copy_func
- * @return MarkovNode pointer if success(dynamically allocated),NULL if fails.
- * @attention:this function allocates and use memory need to be freed by
- * caller.
+ * @return MarkovNode pointer if success(allocated from the arena of the
+ * chain),NULL if fails.
+ * @attention:the node is freed with free_markov_node or with the whole
+ * chain.
  */
-MarkovNode *create_markov_node (void *data_ptr, copy_func_ptr copy_func);
+MarkovNode *create_markov_node (MarkovChain *markov_chain, void *data_ptr);
 /**
  * Creates a new MarkovChain with the specified function pointers.
  *
@@ -197,30 +471,114 @@ MarkovNode *create_markov_node (void *data_ptr, copy_func_ptr copy_func);
 MarkovChain *create_markov_chain (print_func_ptr print_func, copy_func_ptr
 copy_func, free_func_ptr free_func, cmp_func_ptr cmp_func, is_last_func_ptr
                                   is_last);
+/**
+ * Set the hash function of the chain and index its database by it, so
+ * get_node_from_database and add_to_database run in O(1) expected time
+ * instead of scanning the whole linked list.
+ * @param markov_chain
+ * @param hash_func a function that hashes the generic data type of the
+ * chain. must be consistent with the comp_func of the chain.
+ * @return true if the index was built successfully, false in case of
+ * allocation error (the chain keeps working without an index).
+ */
+bool set_hash_func (MarkovChain *markov_chain, hash_func_ptr hash_func);
+/**
+ * Freeze a trained chain: build a sampler for every state so
+ * get_next_random_node chooses the next state in O(1) (SAMPLER_ALIAS) or
+ * O(log successors) (SAMPLER_CUMULATIVE) with the same distribution.
+ * adding transitions to a frozen state drops its sampler, so the chain
+ * stays correct if it is trained further and can be frozen again.
+ * @param markov_chain
+ * @param kind the kind of sampler to build
+ * @return true on success, false in case of allocation error (states
+ * without a sampler keep working through the frequencies scan).
+ */
+bool freeze_markov_chain (MarkovChain *markov_chain, SamplerKind kind);
+/**
+ * Get the time of a monotonic clock, to measure the phases of MarkovStats.
+ * @return the time in seconds from some fixed point.
+ */
+double markov_stats_clock (void);
+/**
+ * Print a report of the stats of a chain.
+ * @param stats
+ * @param stream where to print the report
+ */
+void print_markov_stats (const MarkovStats *stats, FILE *stream);
+/**
+ * Walk a chain and account the memory it takes.
+ * @param markov_chain
+ * @param memory out parameter, the bytes the chain takes
+ */
+void measure_markov_chain (const MarkovChain *markov_chain,
+                           MarkovMemory *memory);
+/**
+ * Print a report of the memory a chain takes.
+ * @param memory the bytes measured by measure_markov_chain
+ * @param stream where to print the report
+ */
+void print_markov_memory (const MarkovMemory *memory, FILE *stream);
+/**
+ * Prune a trained chain: remove the transitions seen less than
+ * min_frequency times, then the states that are not last but have no
+ * successors left, again and again while removing them leaves more such
+ * states, and then the states a walk can't reach from its start states.
+ * the remaining states are renumbered in database order, their frequencies
+ * lists are compacted to their exact length, the removed states are freed
+ * with free_markov_node and the hash index, start states and successor
+ * indexes are rebuilt. the samplers are dropped, freeze the chain again
+ * after pruning it.
+ * @param markov_chain
+ * @param min_frequency the least frequency a transition is kept with
+ * @param report out parameter, what was removed and the memory reclaimed
+ * @return true on success, false in case of allocation error (the chain is
+ * not changed then, or only lost its hash index).
+ */
+bool prune_markov_chain (MarkovChain *markov_chain, int min_frequency,
+                         MarkovPruneReport *report);
+/**
+ * Record that a sentence of the training data started with the given state,
+ * for weighted start selection. last states are ignored since a walk never
+ * starts from them.
+ * @param markov_chain
+ * @param markov_node a state of the chain
+ * @return true on success, false in case of allocation error.
+ */
+bool add_sentence_start (MarkovChain *markov_chain, MarkovNode *markov_node);
+/**
+ * Get a state of the chain by its id.
+ * @param markov_chain
+ * @param id the id of the state, smaller than the database size
+ * @return the MarkovNode of the state
+ */
+MarkovNode *get_state_by_id (const MarkovChain *markov_chain, uint32_t id);
 //****************free func************************//
 /**
- * free a Markov Node and all the content inside it.
+ * free a Markov Node and all the content inside it. the memory is given back
+ * to the arena of the chain for reuse.
  * @param markov_node
+ * @param ptr_chain the chain the node belongs to
  */
 void free_markov_node (MarkovNode *markov_node, MarkovChain *ptr_chain);
 /**
- * Free markov_chain and all of it's content from memory
- * @param markov_chain markov_chain to free
- */
-/**
- * Free markov_chain and all of it's content from memory
+ * Free markov_chain and all of it's content from memory. the data copies
+ * are freed with free_data and the rest is released with the arena of the
+ * chain, block by block.
  * @param markov_chain markov_chain to free
  */
 void free_database (MarkovChain **markov_chain);
 /**
- * free a node from a linked list
+ * free a node of the database of the chain.
  * @param current
+ * @param ptr_chain the chain the node belongs to
  */
-void free_node (Node *current);
+void free_node (Node *current, MarkovChain *ptr_chain);
 //*********************add to freq list and helpers ***************//
 /**
  * Add the second markov_node to the counter list of the first markov_node.
- * If already in list, update it's counter value.
+ * If already in list, update it's counter value. Successors are compared by
+ * identity since the states in the database are unique, so the update is
+ * O(1) expected for any number of successors.
  * @param first_node
  * @param second_node
  * @param markov_chain
@@ -230,21 +588,41 @@ void free_node (Node *current);
 bool add_node_to_frequencies_list (MarkovNode *first_node, MarkovNode
 *second_node, MarkovChain *markov_chain);
 /**
- * Create a new dynamic array of Markov Node Frequency structs.
+ * Add the second markov_node to the counter list of the first markov_node
+ * count times at once, the same as count calls to
+ * add_node_to_frequencies_list.
+ * @param first_node
+ * @param second_node
+ * @param count the number of times the transition was seen, positive
+ * @param markov_chain
+ * @return success/failure: true if the process was successful, false if in
+ * case of allocation error, in which case the successors and counts of
+ * first_node are not changed.
+ */
+bool add_transition_count (MarkovNode *first_node, MarkovNode *second_node,
+                           int count, MarkovChain *markov_chain);
+/**
+ * Create a new dynamic array of Markov Node Frequency structs from the arena
+ * of the chain.
  * @param first_node,second_node
+ * @param markov_chain
  * @return A pointer to the new allocated array if allocation succeed and
  * NULL if allocation failed.
  */
 MarkovNodeFrequency *create_frequency_array (MarkovNode *first_node,
-                                             MarkovNode *second_node);
+                                             MarkovNode *second_node,
+                                             MarkovChain *markov_chain);
 /**
- * Expand an existing array of  Markov Node Frequency structs by allocating
- * more memory.
+ * Append newNode to an existing array of Markov Node Frequency structs. when
+ * the array is full it is moved to one twice as big, so appending is
+ * amortized O(1).
  * @param first_node
  * @param newNode
+ * @param markov_chain
  * @return NULL if reallocation failed and the pointer to the new array if
  * allocation succeed.
  */
 MarkovNodeFrequency *expand_frequency_array (MarkovNode *first_node,
-                                             MarkovNode *newNode);
+                                             MarkovNode *newNode,
+                                             MarkovChain *markov_chain);
 #endif /* MARKOV_CHAIN_H */
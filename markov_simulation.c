@@ -0,0 +1,219 @@
+#include "markov_simulation.h"
+#include <string.h> // For memset()
+#include <pthread.h>
+
+/**
+ * the blocks of walks one thread simulates.
+ */
+typedef struct SimulationShard
+{
+    const CompiledChain *compiled;
+    uint32_t start;
+    uint64_t walks;// the number of walks of all the shards
+    uint64_t seed;
+    uint64_t first_block;// the shard simulates blocks first_block,
+    // first_block + stride, ...
+    uint64_t stride;
+    SimulationResult result;// the counts of the blocks of the shard
+} SimulationShard;
+
+/**
+ * allocate the zeroed counts of a result.
+ * @param result
+ * @param num_states
+ * @param max_steps
+ * @return true on success, false in case of allocation error.
+ */
+static bool init_simulation_result (SimulationResult *result,
+                                    uint32_t num_states, int max_steps);
+/**
+ * simulate one block of walks.
+ * @param shard the shard the block belongs to, counted into its result
+ * @param block the number of the block
+ */
+static void simulate_block (SimulationShard *shard, uint64_t block);
+/**
+ * simulate the blocks of a shard. the start routine of the simulating
+ * threads.
+ * @param arg the SimulationShard to simulate
+ * @return NULL
+ */
+static void *simulate_shard (void *arg);
+
+// see all documentation in the header file
+static bool init_simulation_result (SimulationResult *result,
+                                    uint32_t num_states, int max_steps)
+{
+  memset (result, 0, sizeof (SimulationResult));
+  result->max_steps = max_steps;
+  result->num_states = num_states;
+  result->lengths = calloc ((size_t) max_steps + 1, sizeof (uint64_t));
+  result->visits = calloc ((size_t) num_states + 1, sizeof (uint64_t));
+  if (result->lengths == NULL || result->visits == NULL)
+  {
+    free_simulation_result (result);
+    return false;
+  }
+  return true;
+}
+static void simulate_block (SimulationShard *shard, uint64_t block)
+{
+  const CompiledChain *compiled = shard->compiled;
+  SimulationResult *result = &shard->result;
+  Rng rng;
+  rng_seed_stream (&rng, shard->seed, block);
+  uint64_t first_walk = block * SIMULATION_BLOCK_WALKS;
+  uint64_t block_walks = shard->walks - first_walk;
+  if (block_walks > SIMULATION_BLOCK_WALKS)
+  {
+    block_walks = SIMULATION_BLOCK_WALKS;
+  }
+  // the walks in flight, lanes [0, active) are in use
+  uint32_t position[SIMULATION_LANES];
+  int steps[SIMULATION_LANES];
+  uint64_t started = 0;
+  int active = 0;
+  while (active < SIMULATION_LANES && started < block_walks)
+  {
+    position[active] = shard->start;
+    steps[active++] = 0;
+    started++;
+    result->visits[shard->start]++;
+  }
+  while (active > 0)
+  {
+    int lane = 0;
+    while (lane < active)
+    {
+      uint32_t state = position[lane];
+      bool ended = compiled->terminal[state]
+                   || compiled->row_offsets[state + 1]
+                      == compiled->row_offsets[state];
+      if (!ended && steps[lane] < result->max_steps)
+      {
+        state = compiled_next_random_state (compiled, state, &rng);
+        position[lane] = state;
+        steps[lane]++;
+        result->visits[state]++;
+        lane++;
+        continue;
+      }
+      if (ended)
+      {
+        result->finished++;
+        result->finished_steps += (uint64_t) steps[lane];
+        result->lengths[steps[lane]]++;
+      }
+      result->walks++;
+      if (started < block_walks)
+      {
+        // the lane starts the next walk of the block
+        position[lane] = shard->start;
+        steps[lane] = 0;
+        started++;
+        result->visits[shard->start]++;
+        lane++;
+      }
+      else
+      {
+        // the last walk in flight takes the place of the ended one
+        active--;
+        position[lane] = position[active];
+        steps[lane] = steps[active];
+      }
+    }
+  }
+}
+static void *simulate_shard (void *arg)
+{
+  SimulationShard *shard = (SimulationShard *) arg;
+  uint64_t blocks = (shard->walks + SIMULATION_BLOCK_WALKS - 1)
+                    / SIMULATION_BLOCK_WALKS;
+  for (uint64_t block = shard->first_block; block < blocks;
+       block += shard->stride)
+  {
+    simulate_block (shard, block);
+  }
+  return NULL;
+}
+bool simulate_walks (const CompiledChain *compiled, uint32_t start,
+                     uint64_t walks, int max_steps, uint64_t seed,
+                     int threads, SimulationResult *result)
+{
+  if (!init_simulation_result (result, compiled->num_states, max_steps))
+  {
+    return false;
+  }
+  SimulationShard *shards = malloc (threads * sizeof (SimulationShard));
+  pthread_t *workers = malloc (threads * sizeof (pthread_t));
+  bool *started = calloc (threads, sizeof (bool));
+  bool failed = shards == NULL || workers == NULL || started == NULL;
+  int initialized = 0;
+  for (; !failed && initialized < threads; initialized++)
+  {
+    SimulationShard *shard = &shards[initialized];
+    *shard = (SimulationShard) {compiled, start, walks, seed,
+                                (uint64_t) initialized, (uint64_t) threads,
+                                {0, 0, 0, 0, NULL, 0, NULL}};
+    failed = !init_simulation_result (&shard->result, compiled->num_states,
+                                      max_steps);
+  }
+  if (failed)
+  {
+    // the shard that failed has nothing to free
+    for (int t = 0; shards != NULL && t < initialized - 1; t++)
+    {
+      free_simulation_result (&shards[t].result);
+    }
+    free (shards);
+    free (workers);
+    free (started);
+    free_simulation_result (result);
+    return false;
+  }
+  // the calling thread simulates shard 0, and any shard whose thread could
+  // not be started
+  for (int t = 1; t < threads; t++)
+  {
+    started[t] = pthread_create (&workers[t], NULL, simulate_shard,
+                                 &shards[t]) == 0;
+  }
+  for (int t = 0; t < threads; t++)
+  {
+    if (!started[t])
+    {
+      simulate_shard (&shards[t]);
+    }
+  }
+  for (int t = 0; t < threads; t++)
+  {
+    if (started[t])
+    {
+      pthread_join (workers[t], NULL);
+    }
+    const SimulationResult *counts = &shards[t].result;
+    result->walks += counts->walks;
+    result->finished += counts->finished;
+    result->finished_steps += counts->finished_steps;
+    for (int steps = 0; steps <= max_steps; steps++)
+    {
+      result->lengths[steps] += counts->lengths[steps];
+    }
+    for (uint32_t state = 0; state < compiled->num_states; state++)
+    {
+      result->visits[state] += counts->visits[state];
+    }
+    free_simulation_result (&shards[t].result);
+  }
+  free (shards);
+  free (workers);
+  free (started);
+  return true;
+}
+void free_simulation_result (SimulationResult *result)
+{
+  free (result->lengths);
+  result->lengths = NULL;
+  free (result->visits);
+  result->visits = NULL;
+}
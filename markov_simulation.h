@@ -0,0 +1,55 @@
+#ifndef _MARKOV_SIMULATION_H_
+#define _MARKOV_SIMULATION_H_
+#include "compiled_chain.h"
+
+// the number of walks a block of the simulation advances in lockstep
+#define SIMULATION_LANES 64
+// the number of walks in a block, every block draws from its own stream of
+// the seed
+#define SIMULATION_BLOCK_WALKS 4096
+
+/**
+ * the counts a simulation of many walks collected.
+ */
+typedef struct SimulationResult
+{
+    uint64_t walks;// the number of walks simulated
+    uint64_t finished;// the walks that reached a state they end in within
+    // max_steps steps
+    uint64_t finished_steps;// the sum of the steps of the finished walks
+    int max_steps;// the longest walk, longer ones are cut
+    uint64_t *lengths;// max_steps + 1 counts, lengths[t] walks finished
+    // after exactly t steps
+    uint32_t num_states;
+    uint64_t *visits;// num_states counts of the times a walk was at every
+    // state, the first and last states of the walks included
+} SimulationResult;
+
+/**
+ * Simulate many random walks of a compiled chain from one state without
+ * generating any output. the walks are split into blocks of
+ * SIMULATION_BLOCK_WALKS, block b draws from stream b of the seed and its
+ * walks are advanced SIMULATION_LANES at a time, their positions and step
+ * counts kept in flat arrays. the blocks are shared between the threads,
+ * each counting into its own result, so the result is the same for any
+ * number of threads.
+ * @param compiled
+ * @param start the id of the state every walk starts from
+ * @param walks the number of walks
+ * @param max_steps the longest walk to follow
+ * @param seed
+ * @param threads the number of threads to simulate with
+ * @param result out parameter, freed with free_simulation_result
+ * @return true on success, false in case of allocation error.
+ */
+bool simulate_walks (const CompiledChain *compiled, uint32_t start,
+                     uint64_t walks, int max_steps, uint64_t seed,
+                     int threads, SimulationResult *result);
+
+/**
+ * Free the counts of a simulation.
+ * @param result
+ */
+void free_simulation_result (SimulationResult *result);
+
+#endif //_MARKOV_SIMULATION_H_
@@ -0,0 +1,907 @@
+#define _POSIX_C_SOURCE 200809L
+#include "markov_chain.h"
+#include "compiled_chain.h"
+#include "string_pool.h"
+#include "corpus_reader.h"
+#include "partial_chain.h"
+#include "markov_analysis.h"
+#include <string.h>
+#include <math.h> // For fabs()
+#include <unistd.h> // For close(), unlink()
+#include <limits.h> // For INT_MAX
+
+#define MAX_LEN_TWEET 20
+#define TEST_TWEETS 2000
+#define TEST_SEED 7
+#define TRAIN_THREADS 4
+#define ALIAS_SAMPLES 1000000
+// the largest difference allowed between the frequency a successor was
+// drawn with and its weight, about 10 standard deviations of the frequency
+#define ALIAS_TOLERANCE 0.005
+#define MODEL_TEMPLATE "/tmp/markov_test_XXXXXX"
+// the number of states of the line test_absorption walks
+#define LINE_STATES 100000
+// the least frequency test_pruning keeps a transition with
+#define PRUNE_FREQUENCY 2
+
+/**
+ * a test and its name.
+ */
+typedef struct TestCase
+{
+    const char *name;
+    bool (*run) (const char *corpus_path);// returns true if the test passed
+} TestCase;
+
+/**
+ * the chain a serial reading fills, and the word before the current one.
+ */
+typedef struct SerialContext
+{
+    MarkovChain *markov_chain;
+    Node *prev;
+    bool failed;
+} SerialContext;
+
+/**
+ * the pool of the words of the chains under test.
+ */
+static StringPool *word_pool = NULL;
+
+/**
+ * check that reading a corpus on several threads builds the chain reading
+ * it word by word builds: both generate the same tweets.
+ * @param corpus_path
+ * @return true if the test passed, false else.
+ */
+static bool test_sharded_training (const char *corpus_path);
+/**
+ * check that a chain loaded from a model file generates the same tweets as
+ * the chain it was saved from.
+ * @param corpus_path
+ * @return true if the test passed, false else.
+ */
+static bool test_model_round_trip (const char *corpus_path);
+/**
+ * check that a model file cut short at any section, or one with a byte
+ * too many, is not loaded.
+ * @param corpus_path
+ * @return true if the test passed, false else.
+ */
+static bool test_truncated_model (const char *corpus_path);
+/**
+ * check that the alias tables draw every successor of a state with the
+ * probability of its frequency.
+ * @param corpus_path not used, the test builds its own chain
+ * @return true if the test passed, false else.
+ */
+static bool test_alias_sampling (const char *corpus_path);
+/**
+ * check that add_edges_to_database adds up the weights of repeated
+ * transitions, and rejects weights whose sum overflows an int without
+ * changing the chain.
+ * @param corpus_path not used, the test builds its own chain
+ * @return true if the test passed, false else.
+ */
+static bool test_bulk_edges (const char *corpus_path);
+/**
+ * check the expected steps to absorption of a small chain with a cycle,
+ * and that a long line without cycles is solved in two sweeps.
+ * @param corpus_path not used, the test builds its own matrices
+ * @return true if the test passed, false else.
+ */
+static bool test_absorption (const char *corpus_path);
+/**
+ * check that the packed rows of a compiled chain decode to the successors
+ * and weights of its unpacked rows, with weights of every width, and that
+ * a packed row draws its successors with the probability of their weights.
+ * @param corpus_path
+ * @return true if the test passed, false else.
+ */
+static bool test_packed_chain (const char *corpus_path);
+/**
+ * check the invariants of a pruned chain: dense ids in database order, no
+ * rare transitions, exact frequencies lists, no dead ends, every state
+ * reachable from a sentence start, a working hash index, and a report that
+ * accounts for everything removed.
+ * @param corpus_path
+ * @return true if the test passed, false else.
+ */
+static bool test_pruning (const char *corpus_path);
+/**
+ * train a chain on a corpus word by word, like the tweets generator without
+ * --train-threads.
+ * @param corpus_path
+ * @return the chain, NULL if the corpus could not be read or in case of
+ * allocation error.
+ */
+static MarkovChain *train_serial (const char *corpus_path);
+/**
+ * train a chain on a corpus split into shards, like the tweets generator
+ * with --train-threads.
+ * @param corpus_path
+ * @param threads the number of shards
+ * @return the chain, NULL if the corpus could not be read or in case of
+ * allocation error.
+ */
+static MarkovChain *train_sharded (const char *corpus_path, int threads);
+/**
+ * train a chain on a corpus and compile it with alias tables.
+ * @param corpus_path
+ * @return the compiled chain, NULL in case of error.
+ */
+static CompiledChain *compile_corpus (const char *corpus_path);
+/**
+ * add the next word of the corpus to the chain of a SerialContext. a
+ * token_func of read_corpus.
+ */
+static bool add_word (const char *token, size_t length, void *context);
+/**
+ * generate TEST_TWEETS tweets from a compiled chain, one line each, tweet i
+ * drawn from stream i of TEST_SEED.
+ * @param compiled
+ * @param text out parameter, appended to
+ * @return true on success, false in case of allocation error.
+ */
+static bool generate_text (const CompiledChain *compiled, ByteBuffer *text);
+/**
+ * check that two texts are byte identical.
+ */
+static bool same_text (const ByteBuffer *text1, const ByteBuffer *text2);
+/**
+ * save a compiled chain to a new temporary model file.
+ * @param compiled
+ * @param path out parameter, filled from MODEL_TEMPLATE
+ * @return true on success, false if the file could not be written.
+ */
+static bool save_temporary_model (const CompiledChain *compiled,
+                                  char *path);
+/**
+ * write the first length bytes of a model to a file and try to load it.
+ * @param bytes the model
+ * @param length
+ * @param path the file to overwrite
+ * @return true if the file was loaded, false else.
+ */
+static bool loads_prefix (const char *bytes, size_t length,
+                          const char *path);
+/**
+ * decode the packed rows of a chain by the format documented in
+ * CompiledChain and compare them with the rows of the same chain unpacked.
+ * @param reference the chain unpacked
+ * @param packed the chain packed by pack_compiled_chain
+ * @return true if every row holds the same successors with the same
+ * weights, false else.
+ */
+static bool packed_rows_match (const CompiledChain *reference,
+                               const CompiledChain *packed);
+/**
+ * check the invariants test_pruning describes.
+ * @param markov_chain a pruned chain with weighted starts
+ * @param min_frequency the least frequency it was pruned with
+ * @return true if they hold, false else.
+ */
+static bool pruned_chain_valid (MarkovChain *markov_chain,
+                                int min_frequency);
+/**
+ * count the transitions of a chain.
+ */
+static size_t count_transitions (const MarkovChain *markov_chain);
+/**
+ * the functions of a chain of words, the same as the ones of the tweets
+ * generator.
+ */
+static void print_func (const void *data);
+static bool format_func (const void *data, ByteBuffer *text);
+static bool is_last (const void *data);
+static int comp_func (const void *data1, const void *data2);
+static void *copy_func (const void *source);
+static void free_func (void *pointer);
+static size_t size_func (const void *data);
+static size_t hash_func (const void *data);
+/**
+ * create an empty chain of words.
+ * @return the chain, NULL in case of allocation error.
+ */
+static MarkovChain *create_word_chain (void);
+
+int main (int argc, char *argv[])
+{
+  if (argc != 2)
+  {
+    printf ("USAGE:./markov_test text_corpus_path\n");
+    return EXIT_FAILURE;
+  }
+  word_pool = string_pool_create ();
+  if (word_pool == NULL)
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    return EXIT_FAILURE;
+  }
+  const TestCase tests[] = {
+      {"sharded training", test_sharded_training},
+      {"model round trip", test_model_round_trip},
+      {"truncated model", test_truncated_model},
+      {"alias sampling", test_alias_sampling},
+      {"bulk edges", test_bulk_edges},
+      {"absorption", test_absorption},
+      {"packed chain", test_packed_chain},
+      {"pruning", test_pruning},
+  };
+  int failures = 0;
+  for (size_t i = 0; i < sizeof (tests) / sizeof (tests[0]); i++)
+  {
+    bool passed = tests[i].run (argv[1]);
+    printf ("%s: %s\n", passed ? "PASS" : "FAIL", tests[i].name);
+    failures += !passed;
+  }
+  string_pool_free (word_pool);
+  return failures == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+static bool test_sharded_training (const char *corpus_path)
+{
+  MarkovChain *serial = train_serial (corpus_path);
+  MarkovChain *sharded = train_sharded (corpus_path, TRAIN_THREADS);
+  CompiledChain *compiled_serial = NULL;
+  CompiledChain *compiled_sharded = NULL;
+  if (serial != NULL && sharded != NULL)
+  {
+    compiled_serial = compile_markov_chain (serial, SAMPLER_ALIAS);
+    compiled_sharded = compile_markov_chain (sharded, SAMPLER_ALIAS);
+  }
+  ByteBuffer text_serial, text_sharded;
+  byte_buffer_init (&text_serial);
+  byte_buffer_init (&text_sharded);
+  bool passed = compiled_serial != NULL && compiled_sharded != NULL
+                && compiled_serial->num_states
+                   == compiled_sharded->num_states
+                && compiled_serial->num_edges == compiled_sharded->num_edges
+                && generate_text (compiled_serial, &text_serial)
+                && generate_text (compiled_sharded, &text_sharded)
+                && same_text (&text_serial, &text_sharded);
+  byte_buffer_free (&text_serial);
+  byte_buffer_free (&text_sharded);
+  free_compiled_chain (&compiled_serial);
+  free_compiled_chain (&compiled_sharded);
+  free_database (&serial);
+  free_database (&sharded);
+  return passed;
+}
+static bool test_model_round_trip (const char *corpus_path)
+{
+  CompiledChain *compiled = compile_corpus (corpus_path);
+  char path[] = MODEL_TEMPLATE;
+  bool saved = compiled != NULL && save_temporary_model (compiled, path);
+  CompiledChain *loaded = NULL;
+  if (saved)
+  {
+    loaded = load_compiled_chain (path, SAMPLER_ALIAS, format_func);
+    unlink (path);
+  }
+  ByteBuffer text_compiled, text_loaded;
+  byte_buffer_init (&text_compiled);
+  byte_buffer_init (&text_loaded);
+  bool passed = loaded != NULL
+                && generate_text (compiled, &text_compiled)
+                && generate_text (loaded, &text_loaded)
+                && same_text (&text_compiled, &text_loaded);
+  byte_buffer_free (&text_compiled);
+  byte_buffer_free (&text_loaded);
+  free_compiled_chain (&compiled);
+  free_compiled_chain (&loaded);
+  return passed;
+}
+static bool test_truncated_model (const char *corpus_path)
+{
+  CompiledChain *compiled = compile_corpus (corpus_path);
+  char path[] = MODEL_TEMPLATE;
+  bool saved = compiled != NULL && save_temporary_model (compiled, path);
+  free_compiled_chain (&compiled);
+  if (!saved)
+  {
+    return false;
+  }
+  FILE *fp = fopen (path, "rb");
+  char *bytes = NULL;
+  long length = -1;
+  if (fp != NULL && fseek (fp, 0, SEEK_END) == 0)
+  {
+    length = ftell (fp);
+    rewind (fp);
+    // one more byte for the model with a byte too many
+    bytes = calloc (length + 1, 1);
+  }
+  bool passed = bytes != NULL
+                && fread (bytes, 1, length, fp) == (size_t) length
+                && loads_prefix (bytes, length, path);
+  if (fp != NULL)
+  {
+    fclose (fp);
+  }
+  // every cut of the first kilobyte goes through the header and the first
+  // sections, the rest are spread over the file up to its last byte
+  for (long cut = 0; passed && cut < length; cut = (cut < 1024) ? cut + 1
+                                                 : cut + length / 64)
+  {
+    passed = !loads_prefix (bytes, cut, path);
+  }
+  passed = passed && !loads_prefix (bytes, length - 1, path)
+           && !loads_prefix (bytes, length + 1, path);
+  free (bytes);
+  unlink (path);
+  return passed;
+}
+static bool test_alias_sampling (const char *corpus_path)
+{
+  (void) corpus_path;
+  // "w" is followed by successor i with frequency weights[i]
+  const char *successors[] = {"a", "b.", "c", "d.", "e"};
+  const int weights[] = {1, 2, 3, 4, 90};
+  const int num_successors = sizeof (weights) / sizeof (weights[0]);
+  MarkovChain *markov_chain = create_word_chain ();
+  Node *from = NULL;
+  bool failed = markov_chain == NULL
+                || (from = add_to_database (markov_chain, "w")) == NULL
+                || !add_sentence_start (markov_chain, from->data);
+  int total = 0;
+  for (int i = 0; i < num_successors && !failed; i++)
+  {
+    Node *to = add_to_database (markov_chain, (void *) successors[i]);
+    failed = to == NULL;
+    for (int j = 0; j < weights[i] && !failed; j++)
+    {
+      failed = !add_node_to_frequencies_list (from->data, to->data,
+                                              markov_chain);
+    }
+    total += weights[i];
+  }
+  CompiledChain *compiled = NULL;
+  if (!failed)
+  {
+    compiled = compile_markov_chain (markov_chain, SAMPLER_ALIAS);
+  }
+  long counts[sizeof (weights) / sizeof (weights[0])] = {0};
+  bool passed = compiled != NULL;
+  Rng rng;
+  rng_seed (&rng, TEST_SEED);
+  for (long i = 0; i < ALIAS_SAMPLES && passed; i++)
+  {
+    uint32_t next = compiled_next_random_state (compiled, from->data->id,
+                                                &rng);
+    // the successors were added right after "w", so their ids follow it
+    passed = next > from->data->id
+             && next <= from->data->id + (uint32_t) num_successors;
+    if (passed)
+    {
+      counts[next - from->data->id - 1]++;
+    }
+  }
+  for (int i = 0; i < num_successors && passed; i++)
+  {
+    double frequency = (double) counts[i] / ALIAS_SAMPLES;
+    passed = fabs (frequency - (double) weights[i] / total)
+             <= ALIAS_TOLERANCE;
+  }
+  free_compiled_chain (&compiled);
+  free_database (&markov_chain);
+  return passed;
+}
+static bool test_bulk_edges (const char *corpus_path)
+{
+  (void) corpus_path;
+  char *words[] = {"a", "b", "c."};
+  const MarkovEdge edges[] = {{0, 1, 2}, {0, 2, 3}, {1, 2, 1}, {0, 1, 4}};
+  const MarkovEdge overflowing[] = {{1, 0, INT_MAX}, {1, 2, INT_MAX}};
+  MarkovChain *markov_chain = create_word_chain ();
+  bool passed = markov_chain != NULL
+                && add_states_to_database (markov_chain,
+                                           (void *const *) words, 3)
+                && add_edges_to_database (markov_chain, edges, 4);
+  MarkovNode *first = passed ? markov_chain->states[0] : NULL;
+  MarkovNode *second = passed ? markov_chain->states[1] : NULL;
+  // 0 -> 1 was given twice, so its weights are added up
+  passed = passed && first->current_successive_nodes == 2
+           && first->frequencies_list[0].next_id == 1
+           && first->frequencies_list[0].frequency == 6
+           && first->frequencies_list[1].next_id == 2
+           && first->frequencies_list[1].frequency == 3
+           && first->total_occurrences == 9
+           && second->total_occurrences == 1;
+  // 1 already has a weight of 1, so even one INT_MAX is too much for it
+  passed = passed
+           && !add_edges_to_database (markov_chain, overflowing, 2)
+           && !add_edges_to_database (markov_chain, overflowing, 1)
+           && second->current_successive_nodes == 1
+           && second->frequencies_list[0].frequency == 1
+           && second->total_occurrences == 1;
+  free_database (&markov_chain);
+  return passed;
+}
+static bool test_absorption (const char *corpus_path)
+{
+  (void) corpus_path;
+  // 0 -> 1, 1 -> 0 or 2 evenly, 2 is last: t0 = 1 + t1, t1 = 1 + t0 / 2
+  uint32_t cycle_offsets[] = {0, 1, 3, 3};
+  uint32_t cycle_columns[] = {1, 0, 2};
+  double cycle_probabilities[] = {1, 0.5, 0.5};
+  uint8_t cycle_absorbing[] = {0, 0, 1};
+  MarkovMatrix cycle = {3, cycle_offsets, cycle_columns,
+                        cycle_probabilities, cycle_absorbing};
+  double cycle_expected[3];
+  int sweeps = expected_steps_to_absorption (&cycle, cycle_expected);
+  bool passed = sweeps > 0 && fabs (cycle_expected[0] - 4) < 1e-9
+                && fabs (cycle_expected[1] - 3) < 1e-9
+                && cycle_expected[2] == 0;
+  // i -> i + 1, the last state is last
+  MarkovMatrix line = {LINE_STATES, NULL, NULL, NULL, NULL};
+  line.row_offsets = malloc ((LINE_STATES + 1) * sizeof (uint32_t));
+  line.columns = malloc (LINE_STATES * sizeof (uint32_t));
+  line.probabilities = malloc (LINE_STATES * sizeof (double));
+  line.absorbing = calloc (LINE_STATES, sizeof (uint8_t));
+  double *line_expected = malloc (LINE_STATES * sizeof (double));
+  passed = passed && line.row_offsets != NULL && line.columns != NULL
+           && line.probabilities != NULL && line.absorbing != NULL
+           && line_expected != NULL;
+  if (passed)
+  {
+    for (uint32_t id = 0; id + 1 < LINE_STATES; id++)
+    {
+      line.row_offsets[id] = id;
+      line.columns[id] = id + 1;
+      line.probabilities[id] = 1;
+    }
+    line.row_offsets[LINE_STATES - 1] = LINE_STATES - 1;
+    line.row_offsets[LINE_STATES] = LINE_STATES - 1;
+    line.absorbing[LINE_STATES - 1] = 1;
+    passed = expected_steps_to_absorption (&line, line_expected) == 2
+             && line_expected[0] == LINE_STATES - 1;
+  }
+  free_markov_matrix (&line);
+  free (line_expected);
+  return passed;
+}
+static bool test_packed_chain (const char *corpus_path)
+{
+  CompiledChain *reference = compile_corpus (corpus_path);
+  CompiledChain *packed = compile_corpus (corpus_path);
+  bool passed = reference != NULL && packed != NULL
+                && pack_compiled_chain (packed)
+                && packed_rows_match (reference, packed);
+  free_compiled_chain (&reference);
+  free_compiled_chain (&packed);
+  // the rows of "a", "c" and "b" need 32, 16 and 8 bit weights
+  char *words[] = {"a", "b", "c", "d."};
+  const MarkovEdge edges[] = {{0, 1, 1}, {0, 2, 300}, {0, 3, 70000},
+                              {1, 3, 5}, {2, 3, 300}};
+  const int num_edges = sizeof (edges) / sizeof (edges[0]);
+  MarkovChain *markov_chain = create_word_chain ();
+  passed = passed && markov_chain != NULL
+           && add_states_to_database (markov_chain, (void *const *) words, 4)
+           && add_edges_to_database (markov_chain, edges, num_edges);
+  if (passed)
+  {
+    reference = compile_markov_chain (markov_chain, SAMPLER_ALIAS);
+    packed = compile_markov_chain (markov_chain, SAMPLER_ALIAS);
+  }
+  passed = passed && reference != NULL && packed != NULL
+           && pack_compiled_chain (packed)
+           && packed_rows_match (reference, packed);
+  long counts[4] = {0};
+  Rng rng;
+  rng_seed (&rng, TEST_SEED);
+  for (long i = 0; i < ALIAS_SAMPLES && passed; i++)
+  {
+    uint32_t next = compiled_next_random_state (packed, 0, &rng);
+    passed = next >= 1 && next <= 3;
+    if (passed)
+    {
+      counts[next]++;
+    }
+  }
+  double total = 1 + 300 + 70000;
+  passed = passed
+           && fabs ((double) counts[1] / ALIAS_SAMPLES - 1 / total)
+              <= ALIAS_TOLERANCE
+           && fabs ((double) counts[2] / ALIAS_SAMPLES - 300 / total)
+              <= ALIAS_TOLERANCE
+           && fabs ((double) counts[3] / ALIAS_SAMPLES - 70000 / total)
+              <= ALIAS_TOLERANCE;
+  free_compiled_chain (&reference);
+  free_compiled_chain (&packed);
+  free_database (&markov_chain);
+  return passed;
+}
+static bool test_pruning (const char *corpus_path)
+{
+  MarkovChain *markov_chain = train_serial (corpus_path);
+  if (markov_chain == NULL)
+  {
+    return false;
+  }
+  // with weighted starts a state can be unreachable from every start
+  markov_chain->weighted_starts = true;
+  size_t states_before = (size_t) markov_chain->database->size;
+  size_t transitions_before = count_transitions (markov_chain);
+  MarkovPruneReport report;
+  bool passed = prune_markov_chain (markov_chain, PRUNE_FREQUENCY, &report)
+                && report.states_removed > 0
+                && report.transitions_removed > 0
+                && report.bytes_after < report.bytes_before
+                && report.states_removed
+                   + (size_t) markov_chain->database->size == states_before
+                && report.transitions_removed
+                   + count_transitions (markov_chain) == transitions_before
+                && pruned_chain_valid (markov_chain, PRUNE_FREQUENCY);
+  free_database (&markov_chain);
+  return passed;
+}
+static MarkovChain *train_serial (const char *corpus_path)
+{
+  FILE *fp = fopen (corpus_path, "r");
+  MarkovChain *markov_chain = create_word_chain ();
+  SerialContext context = {markov_chain, NULL, false};
+  bool failed = fp == NULL || markov_chain == NULL
+                || read_corpus (fp, add_word, &context) == 1
+                || context.failed;
+  if (fp != NULL)
+  {
+    fclose (fp);
+  }
+  if (failed)
+  {
+    free_database (&markov_chain);
+  }
+  return markov_chain;
+}
+static MarkovChain *train_sharded (const char *corpus_path, int threads)
+{
+  FILE *fp = fopen (corpus_path, "r");
+  MarkovChain *markov_chain = create_word_chain ();
+  PartialChain partials[TRAIN_THREADS];
+  void *contexts[TRAIN_THREADS];
+  bool failed = fp == NULL || markov_chain == NULL
+                || threads > TRAIN_THREADS;
+  int initialized = 0;
+  for (; initialized < threads && !failed; initialized++)
+  {
+    failed = !partial_chain_init (&partials[initialized], is_last);
+    contexts[initialized] = &partials[initialized];
+  }
+  if (!failed)
+  {
+    failed = read_corpus_shards (fp, threads, partial_chain_add_word,
+                                 contexts) == 1;
+  }
+  for (int i = 0; i < initialized; i++)
+  {
+    failed = failed || partials[i].failed;
+  }
+  if (!failed)
+  {
+    failed = !merge_partial_chains (markov_chain, partials, threads);
+  }
+  for (int i = 0; i < initialized; i++)
+  {
+    partial_chain_free (&partials[i]);
+  }
+  if (fp != NULL)
+  {
+    fclose (fp);
+  }
+  if (failed)
+  {
+    free_database (&markov_chain);
+  }
+  return markov_chain;
+}
+static CompiledChain *compile_corpus (const char *corpus_path)
+{
+  MarkovChain *markov_chain = train_serial (corpus_path);
+  if (markov_chain == NULL)
+  {
+    return NULL;
+  }
+  // the words are kept by word_pool, so the compiled chain outlives the
+  // chain
+  CompiledChain *compiled = compile_markov_chain (markov_chain,
+                                                  SAMPLER_ALIAS);
+  free_database (&markov_chain);
+  return compiled;
+}
+static bool add_word (const char *token, size_t length, void *context)
+{
+  SerialContext *serial = (SerialContext *) context;
+  uint32_t id = string_pool_intern (word_pool, token, length);
+  Node *current = NULL;
+  if (id != STRING_POOL_NO_ID)
+  {
+    current = add_to_database (serial->markov_chain,
+                               (void *) string_pool_get (word_pool, id));
+  }
+  Node *prev = serial->prev;
+  if (current == NULL)
+  {
+    serial->failed = true;
+  }
+  else if (prev == NULL || is_last (prev->data->data))
+  {
+    // the first word of the text and every word after a last word open a
+    // sentence
+    serial->failed = !add_sentence_start (serial->markov_chain,
+                                          current->data);
+  }
+  else
+  {
+    serial->failed = !add_node_to_frequencies_list (prev->data,
+                                                    current->data,
+                                                    serial->markov_chain);
+  }
+  serial->prev = current;
+  return !serial->failed;
+}
+static bool generate_text (const CompiledChain *compiled, ByteBuffer *text)
+{
+  uint32_t states[MAX_LEN_TWEET];
+  for (int i = 0; i < TEST_TWEETS; i++)
+  {
+    Rng rng;
+    rng_seed_stream (&rng, TEST_SEED, (uint64_t) i);
+    int length = compiled_walk (compiled, COMPILED_RANDOM_START,
+                                MAX_LEN_TWEET, &rng, states);
+    if (!format_compiled_walk (compiled, states, length, text)
+        || !byte_buffer_append (text, "\n", 1))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+static bool same_text (const ByteBuffer *text1, const ByteBuffer *text2)
+{
+  return text1->length == text2->length
+         && memcmp (text1->bytes, text2->bytes, text1->length) == 0;
+}
+static bool save_temporary_model (const CompiledChain *compiled,
+                                  char *path)
+{
+  int fd = mkstemp (path);
+  if (fd == -1)
+  {
+    return false;
+  }
+  close (fd);
+  if (!save_compiled_chain (compiled, size_func, path))
+  {
+    unlink (path);
+    return false;
+  }
+  return true;
+}
+static bool loads_prefix (const char *bytes, size_t length,
+                          const char *path)
+{
+  FILE *fp = fopen (path, "wb");
+  if (fp == NULL)
+  {
+    return false;
+  }
+  bool written = fwrite (bytes, 1, length, fp) == length;
+  if (fclose (fp) != 0 || !written)
+  {
+    return false;
+  }
+  CompiledChain *loaded = load_compiled_chain (path, SAMPLER_ALIAS,
+                                               format_func);
+  bool loads = loaded != NULL;
+  free_compiled_chain (&loaded);
+  return loads;
+}
+static bool packed_rows_match (const CompiledChain *reference,
+                               const CompiledChain *packed)
+{
+  if (packed->packed == NULL || packed->num_states != reference->num_states)
+  {
+    return false;
+  }
+  for (uint32_t state = 0; state < reference->num_states; state++)
+  {
+    uint32_t begin = reference->row_offsets[state];
+    uint32_t size = reference->row_offsets[state + 1] - begin;
+    const uint8_t *bytes = packed->packed + packed->packed_offsets[state];
+    const uint8_t *end = packed->packed + packed->packed_offsets[state + 1];
+    if (size == 0)
+    {
+      if (bytes != end)
+      {
+        return false;
+      }
+      continue;
+    }
+    int width = *bytes++;
+    uint32_t id = 0;
+    uint64_t total = 0;
+    for (uint32_t i = 0; i < size; i++)
+    {
+      uint32_t delta = 0;
+      int shift = 0;
+      while (*bytes & 0x80)
+      {
+        delta |= (uint32_t) (*bytes++ & 0x7f) << shift;
+        shift += 7;
+      }
+      delta |= (uint32_t) *bytes++ << shift;
+      // the ids increase, so every successor is decoded once
+      id = (i == 0) ? delta : id + delta + 1;
+      uint32_t weight = 0;
+      for (int byte = 0; byte < (1 << width); byte++)
+      {
+        weight |= (uint32_t) *bytes++ << (8 * byte);
+      }
+      uint32_t j = 0;
+      while (j < size && reference->successor_ids[begin + j] != id)
+      {
+        j++;
+      }
+      if (j == size || reference->weights[begin + j] != weight)
+      {
+        return false;
+      }
+      total += weight;
+    }
+    if (bytes != end || total != reference->row_totals[state])
+    {
+      return false;
+    }
+  }
+  return true;
+}
+static bool pruned_chain_valid (MarkovChain *markov_chain,
+                                int min_frequency)
+{
+  uint32_t size = (uint32_t) markov_chain->database->size;
+  uint8_t *reached = calloc ((size_t) size + 1, sizeof (uint8_t));
+  uint32_t *queue = malloc (((size_t) size + 1) * sizeof (uint32_t));
+  bool valid = reached != NULL && queue != NULL;
+  uint32_t id = 0;
+  for (Node *current = markov_chain->database->first;
+       current != NULL && valid; current = current->next, id++)
+  {
+    MarkovNode *node = current->data;
+    Node *found = get_node_from_database (markov_chain, node->data);
+    valid = node->id == id && markov_chain->states[id] == node
+            && found != NULL && found->data == node
+            && node->successors_capacity == node->current_successive_nodes
+            && (node->current_successive_nodes > 0
+                || markov_chain->is_last (node->data));
+    long long total = 0;
+    for (int i = 0; i < node->current_successive_nodes && valid; i++)
+    {
+      valid = node->frequencies_list[i].frequency >= min_frequency
+              && node->frequencies_list[i].next_id < size;
+      total += node->frequencies_list[i].frequency;
+    }
+    valid = valid && total == node->total_occurrences;
+  }
+  valid = valid && id == size;
+  uint32_t head = 0;
+  uint32_t tail = 0;
+  for (uint32_t i = 0; i < markov_chain->num_sentence_starts && valid; i++)
+  {
+    uint32_t start = markov_chain->sentence_starts[i];
+    valid = start < size;
+    if (valid && !reached[start])
+    {
+      reached[start] = 1;
+      queue[tail++] = start;
+    }
+  }
+  while (head < tail)
+  {
+    const MarkovNode *node = markov_chain->states[queue[head++]];
+    for (int i = 0; i < node->current_successive_nodes; i++)
+    {
+      uint32_t next_id = node->frequencies_list[i].next_id;
+      if (!reached[next_id])
+      {
+        reached[next_id] = 1;
+        queue[tail++] = next_id;
+      }
+    }
+  }
+  valid = valid && tail == size;
+  // the successor indexes were rebuilt: counting a transition again finds
+  // it instead of adding it twice
+  for (uint32_t i = 0; i < size && valid; i++)
+  {
+    MarkovNode *node = markov_chain->states[i];
+    if (node->current_successive_nodes <= SUCCESSOR_INDEX_THRESHOLD)
+    {
+      continue;
+    }
+    int successors = node->current_successive_nodes;
+    int position = successors - 1;
+    int frequency = node->frequencies_list[position].frequency;
+    MarkovNode *next = markov_chain->states[node->frequencies_list[position]
+        .next_id];
+    valid = add_node_to_frequencies_list (node, next, markov_chain)
+            && node->current_successive_nodes == successors
+            && node->frequencies_list[position].frequency == frequency + 1;
+  }
+  free (reached);
+  free (queue);
+  return valid;
+}
+static size_t count_transitions (const MarkovChain *markov_chain)
+{
+  size_t transitions = 0;
+  for (const Node *current = markov_chain->database->first; current != NULL;
+       current = current->next)
+  {
+    transitions += (size_t) current->data->current_successive_nodes;
+  }
+  return transitions;
+}
+
+//***************markov chain functions***************//
+static void print_func (const void *data)
+{
+  printf ("%s", (const char *) data);
+  if (!is_last (data))
+  {
+    printf (" ");
+  }
+}
+static bool format_func (const void *data, ByteBuffer *text)
+{
+  const char *str = (const char *) data;
+  return byte_buffer_append_string (text, str)
+         && (is_last (str) || byte_buffer_append (text, " ", 1));
+}
+static bool is_last (const void *data)
+{
+  const char *str = (const char *) data;
+  return str[strlen (str) - 1] == '.';
+}
+static int comp_func (const void *data1, const void *data2)
+{
+  return strcmp ((const char *) data1, (const char *) data2);
+}
+static void *copy_func (const void *source)
+{
+  const char *str = (const char *) source;
+  uint32_t id = string_pool_intern (word_pool, str, strlen (str));
+  if (id == STRING_POOL_NO_ID)
+  {
+    return NULL;
+  }
+  return (void *) string_pool_get (word_pool, id);
+}
+static void free_func (void *pointer)
+{
+  (void) pointer;
+}
+static size_t size_func (const void *data)
+{
+  return strlen ((const char *) data) + 1;
+}
+static size_t hash_func (const void *data)
+{
+  const char *str = (const char *) data;
+  return string_pool_hash (str, strlen (str));
+}
+static MarkovChain *create_word_chain (void)
+{
+  MarkovChain *markov_chain = create_markov_chain (print_func, copy_func,
+                                                   free_func, comp_func,
+                                                   is_last);
+  if (markov_chain != NULL && !set_hash_func (markov_chain, hash_func))
+  {
+    free_database (&markov_chain);
+    return NULL;
+  }
+  if (markov_chain != NULL)
+  {
+    markov_chain->format_func = format_func;
+  }
+  return markov_chain;
+}
@@ -0,0 +1,227 @@
+#include "partial_chain.h"
+#include <string.h> // For memset()
+
+#define EDGES_INITIAL_CAPACITY 1024
+#define OPENERS_INITIAL_CAPACITY 256
+
+/**
+ * hash a transition by the ids of its words.
+ */
+static size_t hash_edge (uint32_t from, uint32_t to)
+{
+  unsigned long long key = ((unsigned long long) from << 32) | to;
+  key ^= key >> 33;
+  key *= 0xff51afd7ed558ccdULL;
+  key ^= key >> 33;
+  return (size_t) key;
+}
+/**
+ * count a transition of the shard, adding it to the end of the edges if it
+ * is new.
+ * @param partial
+ * @param from
+ * @param to
+ * @return true on success, false in case of allocation error.
+ */
+static bool count_edge (PartialChain *partial, uint32_t from, uint32_t to);
+/**
+ * double the capacity of the edge index and reinsert all the edges.
+ * @param partial
+ * @return true on success, false in case of allocation error.
+ */
+static bool grow_edge_index (PartialChain *partial);
+/**
+ * push a word to the openers of the shard.
+ * @param partial
+ * @param id
+ * @return true on success, false in case of allocation error.
+ */
+static bool push_opener (PartialChain *partial, uint32_t id);
+
+// see all documentation in the header file
+bool partial_chain_init (PartialChain *partial, is_last_func_ptr is_last)
+{
+  memset (partial, 0, sizeof (PartialChain));
+  partial->is_last = is_last;
+  partial->first_word = STRING_POOL_NO_ID;
+  partial->last_word = STRING_POOL_NO_ID;
+  partial->words = string_pool_create ();
+  return partial->words != NULL;
+}
+bool partial_chain_add_word (const char *token, size_t length,
+                             void *context)
+{
+  PartialChain *partial = (PartialChain *) context;
+  uint32_t id = string_pool_intern (partial->words, token, length);
+  if (id == STRING_POOL_NO_ID)
+  {
+    partial->failed = true;
+    return false;
+  }
+  if (partial->last_word == STRING_POOL_NO_ID)
+  {
+    partial->first_word = id;
+  }
+  else if (partial->is_last (string_pool_get (partial->words,
+                                              partial->last_word)))
+  {
+    partial->failed = !push_opener (partial, id);
+  }
+  else
+  {
+    partial->failed = !count_edge (partial, partial->last_word, id);
+  }
+  partial->last_word = id;
+  return !partial->failed;
+}
+bool merge_partial_chains (MarkovChain *markov_chain,
+                           const PartialChain *partials, int count)
+{
+  MarkovNode *prev = NULL;
+  for (int i = 0; i < count; i++)
+  {
+    const PartialChain *partial = &partials[i];
+    MarkovNode **states = malloc ((partial->words->size + 1)
+                                  * sizeof (MarkovNode *));
+    if (states == NULL)
+    {
+      return false;
+    }
+    // the words of the shard that are new to the chain are added in the
+    // order they were first seen
+    for (uint32_t id = 0; id < partial->words->size; id++)
+    {
+      Node *node = add_to_database
+          (markov_chain, (char *) string_pool_get (partial->words, id));
+      if (node == NULL)
+      {
+        free (states);
+        return false;
+      }
+      states[id] = node->data;
+    }
+    bool success = true;
+    if (partial->first_word != STRING_POOL_NO_ID)
+    {
+      MarkovNode *first = states[partial->first_word];
+      if (prev == NULL || markov_chain->is_last (prev->data))
+      {
+        success = add_sentence_start (markov_chain, first);
+      }
+      else
+      {
+        success = add_transition_count (prev, first, 1, markov_chain);
+      }
+      prev = states[partial->last_word];
+    }
+    for (uint32_t e = 0; success && e < partial->num_edges; e++)
+    {
+      const PartialEdge *edge = &partial->edges[e];
+      success = add_transition_count (states[edge->from], states[edge->to],
+                                      edge->count, markov_chain);
+    }
+    for (uint32_t o = 0; success && o < partial->num_openers; o++)
+    {
+      success = add_sentence_start (markov_chain,
+                                    states[partial->openers[o]]);
+    }
+    free (states);
+    if (!success)
+    {
+      return false;
+    }
+  }
+  return true;
+}
+void partial_chain_free (PartialChain *partial)
+{
+  if (partial->words != NULL)
+  {
+    string_pool_free (partial->words);
+  }
+  free (partial->edges);
+  free (partial->edge_index);
+  free (partial->openers);
+  memset (partial, 0, sizeof (PartialChain));
+}
+static bool count_edge (PartialChain *partial, uint32_t from, uint32_t to)
+{
+  if ((size_t) (partial->num_edges + 1) * 4 > partial->edge_index_capacity * 3
+      && !grow_edge_index (partial))
+  {
+    return false;
+  }
+  size_t mask = partial->edge_index_capacity - 1;
+  size_t i = hash_edge (from, to) & mask;
+  for (; partial->edge_index[i] != 0; i = (i + 1) & mask)
+  {
+    PartialEdge *edge = &partial->edges[partial->edge_index[i] - 1];
+    if (edge->from == from && edge->to == to)
+    {
+      edge->count++;
+      return true;
+    }
+  }
+  if (partial->num_edges == partial->edges_capacity)
+  {
+    uint32_t new_capacity = (partial->edges_capacity == 0)
+                            ? EDGES_INITIAL_CAPACITY
+                            : partial->edges_capacity * 2;
+    PartialEdge *new_edges = realloc (partial->edges,
+                                      new_capacity * sizeof (PartialEdge));
+    if (new_edges == NULL)
+    {
+      return false;
+    }
+    partial->edges = new_edges;
+    partial->edges_capacity = new_capacity;
+  }
+  partial->edges[partial->num_edges] = (PartialEdge) {from, to, 1};
+  partial->num_edges++;
+  partial->edge_index[i] = partial->num_edges;
+  return true;
+}
+static bool grow_edge_index (PartialChain *partial)
+{
+  size_t new_capacity = (partial->edge_index_capacity == 0)
+                        ? EDGES_INITIAL_CAPACITY * 2
+                        : partial->edge_index_capacity * 2;
+  uint32_t *new_index = calloc (new_capacity, sizeof (uint32_t));
+  if (new_index == NULL)
+  {
+    return false;
+  }
+  size_t mask = new_capacity - 1;
+  for (uint32_t e = 0; e < partial->num_edges; e++)
+  {
+    size_t i = hash_edge (partial->edges[e].from, partial->edges[e].to) & mask;
+    while (new_index[i] != 0)
+    {
+      i = (i + 1) & mask;
+    }
+    new_index[i] = e + 1;
+  }
+  free (partial->edge_index);
+  partial->edge_index = new_index;
+  partial->edge_index_capacity = new_capacity;
+  return true;
+}
+static bool push_opener (PartialChain *partial, uint32_t id)
+{
+  if (partial->num_openers == partial->openers_capacity)
+  {
+    uint32_t new_capacity = (partial->openers_capacity == 0)
+                            ? OPENERS_INITIAL_CAPACITY
+                            : partial->openers_capacity * 2;
+    uint32_t *new_openers = realloc (partial->openers,
+                                     new_capacity * sizeof (uint32_t));
+    if (new_openers == NULL)
+    {
+      return false;
+    }
+    partial->openers = new_openers;
+    partial->openers_capacity = new_capacity;
+  }
+  partial->openers[partial->num_openers++] = id;
+  return true;
+}
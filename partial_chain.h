@@ -0,0 +1,86 @@
+#ifndef _PARTIAL_CHAIN_H_
+#define _PARTIAL_CHAIN_H_
+#include "markov_chain.h"
+#include "string_pool.h"
+
+/**
+ * a transition between two words of a shard and the number of times it was
+ * seen in the shard.
+ */
+typedef struct PartialEdge
+{
+    uint32_t from;// local id of the first word
+    uint32_t to;// local id of the second word
+    int count;
+} PartialEdge;
+
+/**
+ * the transitions counted from one shard of a corpus, with words numbered
+ * locally, so shards can be counted on separate threads and merged into a
+ * chain in order. everything is kept in the order it was first seen in the
+ * shard, which is what makes the merged chain the same as one filled word
+ * by word.
+ */
+typedef struct PartialChain
+{
+    StringPool *words;// the local vocabulary, a local id is the place of
+    // the word in the order of first occurrence in the shard
+    is_last_func_ptr is_last;
+    PartialEdge *edges;// the transitions in order of first occurrence,
+    // except those from a last word
+    uint32_t num_edges;
+    uint32_t edges_capacity;
+    uint32_t *edge_index;// open addressing hash table of edge + 1, 0 if
+    // empty
+    size_t edge_index_capacity;// always a power of 2
+    uint32_t *openers;// the local id of every word that opens a sentence
+    // after the first word of the shard, once per occurrence
+    uint32_t num_openers;
+    uint32_t openers_capacity;
+    uint32_t first_word;// STRING_POOL_NO_ID if the shard has no words.
+    // whether it opens a sentence depends on the word before the shard
+    uint32_t last_word;// STRING_POOL_NO_ID if the shard has no words
+    bool failed;// set in case of allocation error
+} PartialChain;
+
+/**
+ * Initialize an empty partial chain.
+ * @param partial
+ * @param is_last the is_last func of the chain it will be merged into,
+ * receiving a '\0' terminated word
+ * @return true on success, false in case of allocation error, in which case
+ * partial must still be freed with partial_chain_free.
+ */
+bool partial_chain_init (PartialChain *partial, is_last_func_ptr is_last);
+
+/**
+ * Count the next word of the shard. a token_func of read_corpus.
+ * @param token the word, not '\0' terminated
+ * @param length
+ * @param context the PartialChain of the shard
+ * @return true to read the next word, false in case of allocation error.
+ */
+bool partial_chain_add_word (const char *token, size_t length,
+                             void *context);
+
+/**
+ * Add the words, transitions and sentence starts of consecutive shards to a
+ * chain, as if the words of all the shards were added one by one in order:
+ * the states, their transitions and the sentence starts of the chain end
+ * up in the same order and with the same counts. the transition from the
+ * last word of a shard to the first word of the next one is added too.
+ * @param markov_chain a chain with no states yet, whose data are strings
+ * @param partials the shards in the order of the corpus
+ * @param count the number of shards
+ * @return true on success, false in case of allocation error.
+ */
+bool merge_partial_chains (MarkovChain *markov_chain,
+                           const PartialChain *partials, int count);
+
+/**
+ * Free the memory of a partial chain.
+ * @param partial
+ */
+void partial_chain_free (PartialChain *partial);
+
+#endif //_PARTIAL_CHAIN_H_
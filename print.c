@@ -22,7 +22,8 @@ void printMarkovChain (MarkovChain *chain)
     for (int i = 0; i < node->current_successive_nodes; i++)
     {
       MarkovNodeFrequency *freq = &(node->frequencies_list[i]);
-      printf ("%s (%d), ", (char*)freq->next->data, freq->frequency);
+      printf ("%s (%d), ", (char*)chain->states[freq->next_id]->data,
+              freq->frequency);
     }
     printf ("\n");
     list = list->next;
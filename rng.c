@@ -0,0 +1,90 @@
+#include "rng.h"
+
+#define SPLITMIX_INCREMENT 0x9e3779b97f4a7c15ULL
+
+/**
+ * the splitmix64 generator, used to expand seeds to a full xoshiro state.
+ * @param x the state of the splitmix generator, advanced by the call
+ * @return the next output
+ */
+static uint64_t splitmix64 (uint64_t *x)
+{
+  uint64_t z = (*x += SPLITMIX_INCREMENT);
+  z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+  z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+  return z ^ (z >> 31);
+}
+static uint64_t rotate_left (uint64_t x, int k)
+{
+  return (x << k) | (x >> (64 - k));
+}
+void rng_seed (Rng *rng, uint64_t seed)
+{
+  for (int i = 0; i < 4; i++)
+  {
+    rng->state[i] = splitmix64 (&seed);
+  }
+}
+void rng_seed_stream (Rng *rng, uint64_t seed, uint64_t stream)
+{
+  // the stream number goes through splitmix once more so neighbouring
+  // streams start from unrelated states
+  uint64_t mixed = stream;
+  rng_seed (rng, seed ^ splitmix64 (&mixed));
+}
+uint64_t rng_next (Rng *rng)
+{
+  uint64_t *s = rng->state;
+  uint64_t result = rotate_left (s[1] * 5, 7) * 9;
+  uint64_t t = s[1] << 17;
+  s[2] ^= s[0];
+  s[3] ^= s[1];
+  s[1] ^= s[2];
+  s[0] ^= s[3];
+  s[2] ^= t;
+  s[3] = rotate_left (s[3], 45);
+  return result;
+}
+void rng_jump (Rng *rng)
+{
+  static const uint64_t jump[] = {0x180ec6d33cfd0abaULL,
+                                  0xd5a61266f0c9392cULL,
+                                  0xa9582618e03fc9aaULL,
+                                  0x39abdc4529b1661cULL};
+  uint64_t s[4] = {0, 0, 0, 0};
+  for (int i = 0; i < 4; i++)
+  {
+    for (int b = 0; b < 64; b++)
+    {
+      if (jump[i] & ((uint64_t) 1 << b))
+      {
+        for (int j = 0; j < 4; j++)
+        {
+          s[j] ^= rng->state[j];
+        }
+      }
+      rng_next (rng);
+    }
+  }
+  for (int j = 0; j < 4; j++)
+  {
+    rng->state[j] = s[j];
+  }
+}
+uint32_t rng_bounded (Rng *rng, uint32_t bound)
+{
+  // Lemire's multiply and shift: the high half of random * bound is
+  // uniform in [0,bound) once the few biased low halves are rejected
+  uint64_t product = (rng_next (rng) >> 32) * (uint64_t) bound;
+  uint32_t low = (uint32_t) product;
+  if (low < bound)
+  {
+    uint32_t threshold = (uint32_t) (-bound) % bound;
+    while (low < threshold)
+    {
+      product = (rng_next (rng) >> 32) * (uint64_t) bound;
+      low = (uint32_t) product;
+    }
+  }
+  return (uint32_t) (product >> 32);
+}
@@ -0,0 +1,56 @@
+#ifndef _RNG_H_
+#define _RNG_H_
+#include <stdint.h> // For uint64_t, uint32_t
+
+/**
+ * the state of a xoshiro256** pseudo random generator. every walk of a
+ * chain draws from an explicit Rng, so independent generators can run on
+ * different threads or requests and each one is reproducible from its
+ * seed.
+ */
+typedef struct Rng
+{
+    uint64_t state[4];
+} Rng;
+
+/**
+ * Seed a generator. the same seed always gives the same sequence.
+ * @param rng
+ * @param seed
+ */
+void rng_seed (Rng *rng, uint64_t seed);
+
+/**
+ * Seed a generator to stream number stream of a seed. the streams of one
+ * seed are independent of each other, so work item i can draw from stream
+ * i and get the same numbers whichever thread runs it.
+ * @param rng
+ * @param seed
+ * @param stream
+ */
+void rng_seed_stream (Rng *rng, uint64_t seed, uint64_t stream);
+
+/**
+ * Advance the generator by 2^128 steps. jumping a copy of a generator k
+ * times gives k non overlapping sub sequences, one per thread.
+ * @param rng
+ */
+void rng_jump (Rng *rng);
+
+/**
+ * Get the next 64 random bits of the generator.
+ * @param rng
+ * @return the random bits
+ */
+uint64_t rng_next (Rng *rng);
+
+/**
+ * Get a uniform random number in [0,bound) without the modulo bias of
+ * rand() % bound.
+ * @param rng
+ * @param bound a positive bound
+ * @return the random number
+ */
+uint32_t rng_bounded (Rng *rng, uint32_t bound);
+
+#endif //_RNG_H_
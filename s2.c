@@ -268,13 +268,14 @@ static int fill_database (MarkovChain *markov_chain)
   return EXIT_SUCCESS;
 }
 
-static void print_walks (MarkovChain *markov_chain, int walks_to_create)
+static void print_walks (MarkovChain *markov_chain, int walks_to_create,
+                         Rng *rng)
 {
   for (int i = 1; i <= walks_to_create; i++)
   {
     MarkovNode *first_cell = markov_chain->database->first->data;
     fprintf (stdout, "Random Walk %d: ", i);
-    generate_tweet (markov_chain, first_cell, MAX_GENERATION_LENGTH);
+    generate_tweet (markov_chain, first_cell, MAX_GENERATION_LENGTH, rng);
   }
 }
 
@@ -310,8 +311,9 @@ int main (int argc, char *argv[])
     return EXIT_FAILURE;
   }
   // Printing random walks
-  srand (seed);
-  print_walks (markov_chain, walks_to_create);
+  Rng rng;
+  rng_seed (&rng, seed);
+  print_walks (markov_chain, walks_to_create, &rng);
   free_database (&markov_chain);
   return EXIT_SUCCESS;
 }
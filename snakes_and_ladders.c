@@ -1,5 +1,7 @@
 #include <string.h> // For strlen(), strcmp(), strcpy()
 #include "markov_chain.h"
+#include "markov_analysis.h"
+#include "markov_simulation.h"
 
 #define MAX(X, Y) (((X) < (Y)) ? (Y) : (X))
 
@@ -9,9 +11,13 @@
 
 #define DICE_MAX 6
 #define NUM_OF_TRANSITIONS 20
+#define MAX_BOARD_SIZE 100000000
+#define MAX_DICE_FACES 1000
 
 #define NUMBER_OF_ARGUNEBTS 3
+#define ANALYSIS_ARGUMENTS 1
 #define INT_BASE 10
+#define DEFAULT_HORIZON 200
 /**
  * represents the transitions by ladders and snakes in the game
  * each tuple (x,y) represents a ladder from x to if x<y or a snake otherwise
@@ -50,6 +56,22 @@ typedef struct Cell
     //both ladder_to and snake_to should be -1 if the Cell doesn't have them
 } Cell;
 
+/**
+ * the board of a game: its cells and the number of faces of the dice.
+ */
+typedef struct Board
+{
+    int size;// the number of cells, reaching the last one ends the game
+    int dice_faces;
+    Cell *cells;// cell number i is cells[i - 1]
+} Board;
+
+/**
+ * the number of cells of the board being played, the last cell is the
+ * one a game ends in.
+ */
+static int board_size = BOARD_SIZE;
+
 /** Error handler **/
 static int handle_error (char *error_msg, MarkovChain **database)
 {
@@ -60,8 +82,91 @@ static int handle_error (char *error_msg, MarkovChain **database)
   }
   return EXIT_FAILURE;
 }
+/**
+ * the flags of the program.
+ */
+typedef struct Options
+{
+    bool stats;// --stats: print where the time of the run went to stderr
+    bool memory;// --memory: print the memory the chain takes to stderr
+    bool analyze;// --analyze: print the exact expected game length and the
+    // distribution of the game lengths
+    int horizon;// --horizon N: the longest game length in the distribution
+    // and the longest game simulated
+    unsigned long long simulate;// --simulate N: the number of games to
+    // simulate, 0 to simulate none
+    int threads;// --threads N: the number of threads to simulate with
+    const char *board_path;// --board file: the board to play, NULL to play
+    // the built in one
+} Options;
+/**
+ * separate the flags of the program from its positional arguments. argv
+ * is rearranged so the positional arguments follow the program name.
+ * @param argc
+ * @param argv
+ * @param options out parameter, the flags that were given
+ * @return the number of the program name and positional arguments, or -1
+ * if an unknown flag was given.
+ */
+static int parse_options (int argc, char *argv[], Options *options)
+{
+  *options = (Options) {false, false, false, DEFAULT_HORIZON, 0, 1, NULL};
+  int positional = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp (argv[i], "--", 2) != 0)
+    {
+      argv[positional++] = argv[i];
+    }
+    else if (strcmp (argv[i], "--stats") == 0)
+    {
+      options->stats = true;
+    }
+    else if (strcmp (argv[i], "--memory") == 0)
+    {
+      options->memory = true;
+    }
+    else if (strcmp (argv[i], "--analyze") == 0)
+    {
+      options->analyze = true;
+    }
+    else if (strcmp (argv[i], "--simulate") == 0 && i + 1 < argc)
+    {
+      options->simulate = strtoull (argv[++i], NULL, INT_BASE);
+    }
+    else if (strcmp (argv[i], "--threads") == 0 && i + 1 < argc)
+    {
+      options->threads = (int) strtol (argv[++i], NULL, INT_BASE);
+      if (options->threads < 1)
+      {
+        printf ("Error: the number of threads must be positive\n");
+        return -1;
+      }
+    }
+    else if (strcmp (argv[i], "--board") == 0 && i + 1 < argc)
+    {
+      options->board_path = argv[++i];
+    }
+    else if (strcmp (argv[i], "--horizon") == 0 && i + 1 < argc)
+    {
+      options->horizon = (int) strtol (argv[++i], NULL, INT_BASE);
+      if (options->horizon < 1)
+      {
+        printf ("Error: the horizon must be positive\n");
+        return -1;
+      }
+    }
+    else
+    {
+      printf ("Error: unknown option %s\n", argv[i]);
+      return -1;
+    }
+  }
+  return positional;
+}
 //==============generator==============//
-static void paths_generator (MarkovChain *markov_chain, int number_of_paths)
+static void paths_generator (MarkovChain *markov_chain, int number_of_paths,
+                             Rng *rng)
 {
   int i = 1;
   while (number_of_paths >= i)
@@ -69,11 +174,150 @@ static void paths_generator (MarkovChain *markov_chain, int number_of_paths)
     MarkovNode *first_cell = markov_chain->database->first->data;
     printf ("Random Walk %d: ", i);
     generate_tweet (markov_chain, first_cell,
-                    MAX_GENERATION_LENGTH);
+                    MAX_GENERATION_LENGTH, rng);
     printf ("\n");
     i++;
   }
 }
+/**
+ * print the expected number of steps of a game from the first cell and the
+ * probability that it takes every number of steps up to the horizon,
+ * computed exactly from the transition matrix of the chain.
+ * @param markov_chain
+ * @param horizon
+ * @return EXIT_SUCCESS or EXIT_FAILURE in case of allocation error.
+ */
+static int analyze_game (const MarkovChain *markov_chain, int horizon)
+{
+  double start = markov_stats_clock ();
+  MarkovMatrix matrix;
+  if (!build_markov_matrix (markov_chain, &matrix))
+  {
+    return EXIT_FAILURE;
+  }
+  double *expected = malloc ((matrix.num_states + 1) * sizeof (double));
+  double *lengths = malloc (((size_t) horizon + 1) * sizeof (double));
+  if (expected == NULL || lengths == NULL)
+  {
+    free (expected);
+    free (lengths);
+    free_markov_matrix (&matrix);
+    return EXIT_FAILURE;
+  }
+  uint32_t first_cell = markov_chain->database->first->data->id;
+  int sweeps = expected_steps_to_absorption (&matrix, expected);
+  double unfinished = absorption_time_distribution (&matrix, first_cell,
+                                                    horizon, lengths);
+  double elapsed = markov_stats_clock () - start;
+  free_markov_matrix (&matrix);
+  if (unfinished < 0 || sweeps == ANALYSIS_ALLOCATION_ERROR)
+  {
+    free (expected);
+    free (lengths);
+    return EXIT_FAILURE;
+  }
+  if (sweeps == -1)
+  {
+    printf ("Expected steps from cell 1: some games never end\n");
+  }
+  else
+  {
+    printf ("Expected steps from cell 1: %.9f (%d Gauss-Seidel sweeps)\n",
+            expected[first_cell], sweeps);
+  }
+  printf ("Steps  Probability  Cumulative\n");
+  double cumulative = 0;
+  for (int steps = 0; steps <= horizon; steps++)
+  {
+    if (lengths[steps] == 0)
+    {
+      continue;
+    }
+    cumulative += lengths[steps];
+    printf ("%5d  %.9f  %.9f\n", steps, lengths[steps], cumulative);
+  }
+  printf ("Not finished after %d steps: %.3e\n", horizon, unfinished);
+  printf ("Analyzed in %.3f ms\n", elapsed * 1000.0);
+  free (expected);
+  free (lengths);
+  return EXIT_SUCCESS;
+}
+/**
+ * simulate games from the first cell and print the distribution of their
+ * lengths, the visits to every cell and how often every snake and ladder
+ * is hit.
+ * @param markov_chain a frozen chain
+ * @param options the number of games, threads and the longest game
+ * @param seed
+ * @return EXIT_SUCCESS or EXIT_FAILURE in case of allocation error.
+ */
+static int simulate_games (const MarkovChain *markov_chain,
+                           const Options *options, size_t seed)
+{
+  double start = markov_stats_clock ();
+  CompiledChain *compiled = compile_markov_chain (markov_chain,
+                                                  SAMPLER_ALIAS);
+  if (compiled == NULL)
+  {
+    return EXIT_FAILURE;
+  }
+  uint32_t first_cell = markov_chain->database->first->data->id;
+  SimulationResult result;
+  if (!simulate_walks (compiled, first_cell, options->simulate,
+                       options->horizon, seed, options->threads, &result))
+  {
+    free_compiled_chain (&compiled);
+    return EXIT_FAILURE;
+  }
+  double elapsed = markov_stats_clock () - start;
+  double games = (double) result.walks;
+  printf ("Simulated %llu games in %.3f ms on %d threads\n",
+          (unsigned long long) result.walks, elapsed * 1000.0,
+          options->threads);
+  if (result.finished > 0)
+  {
+    printf ("Mean steps of the finished games: %.6f\n",
+            (double) result.finished_steps / (double) result.finished);
+  }
+  printf ("Steps  Frequency  Cumulative\n");
+  uint64_t cumulative = 0;
+  for (int steps = 0; steps <= result.max_steps; steps++)
+  {
+    if (result.lengths[steps] == 0)
+    {
+      continue;
+    }
+    cumulative += result.lengths[steps];
+    printf ("%5d  %.9f  %.9f\n", steps,
+            (double) result.lengths[steps] / games,
+            (double) cumulative / games);
+  }
+  printf ("Not finished after %d steps: %.3e\n", result.max_steps,
+          (double) (result.walks - result.finished) / games);
+  printf ("Visits per game:\n");
+  for (uint32_t id = 0; id < compiled->num_states; id++)
+  {
+    const Cell *cell = compiled->state_data[id];
+    double visits = (double) result.visits[id] / games;
+    if (cell->snake_to != EMPTY)
+    {
+      printf ("[%d] %.6f, snake to %d\n", cell->number, visits,
+              cell->snake_to);
+    }
+    else if (cell->ladder_to != EMPTY)
+    {
+      printf ("[%d] %.6f, ladder to %d\n", cell->number, visits,
+              cell->ladder_to);
+    }
+    else
+    {
+      printf ("[%d] %.6f\n", cell->number, visits);
+    }
+  }
+  free_simulation_result (&result);
+  free_compiled_chain (&compiled);
+  return EXIT_SUCCESS;
+}
 //===========struct funcs============//
 /**
  * this function frees the memory of the cell
@@ -85,17 +329,32 @@ static void free_func (void *pointer)
 }
 /**
  * return true if we its last cell and false else.
- * cell defined to be last if its number field is 100
+ * cell defined to be last if its number field is board_size
  */
 static bool is_last (const void *data)
 {
-  return (((Cell *) data)->number == BOARD_SIZE);
+  return (((Cell *) data)->number == board_size);
 }
 static int comp_func (const void *data1, const void *data2)
 {
   return (((Cell *) data1)->number - ((Cell *) data2)->number);
 
 }
+/**
+ * the number of bytes of a cell.
+ */
+static size_t size_func (const void *data)
+{
+  (void) data;
+  return sizeof (Cell);
+}
+/**
+ * hash a cell by its number, cells numbers are unique in the board.
+ */
+static size_t hash_func (const void *data)
+{
+  return (size_t) ((Cell *) data)->number;
+}
 /**
  * This function creates a copy of a cell using 'memcpy'.
  * @param source - a source cell to be copied.
@@ -117,7 +376,7 @@ static void print_func (const void *data)
   Cell *cell = (Cell *) data;
 
   printf ("[%d]", cell->number);
-  if (cell->number != BOARD_SIZE)
+  if (cell->number != board_size)
   {
     if (cell->snake_to != EMPTY)
     {
@@ -132,21 +391,25 @@ static void print_func (const void *data)
 }
 
 //=====================================//
-static int create_board (Cell *cells[BOARD_SIZE])
+/**
+ * fills a board with the cells of the built in game: BOARD_SIZE cells,
+ * DICE_MAX faces and the snakes and ladders of transitions.
+ * @param board out parameter, its cells are freed by the caller
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int create_board (Board *board)
 {
+  board->size = BOARD_SIZE;
+  board->dice_faces = DICE_MAX;
+  board->cells = malloc (BOARD_SIZE * sizeof (Cell));
+  if (board->cells == NULL)
+  {
+    handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
+    return EXIT_FAILURE;
+  }
   for (int i = 0; i < BOARD_SIZE; i++)
   {
-    cells[i] = malloc (sizeof (Cell));
-    if (cells[i] == NULL)
-    {
-      for (int j = 0; j < i; j++)
-      {
-        free (cells[j]);
-      }
-      handle_error (ALLOCATION_ERROR_MASSAGE, NULL);
-      return EXIT_FAILURE;
-    }
-    *(cells[i]) = (Cell) {i + 1, EMPTY, EMPTY};
+    board->cells[i] = (Cell) {i + 1, EMPTY, EMPTY};
   }
 
   for (int i = 0; i < NUM_OF_TRANSITIONS; i++)
@@ -155,83 +418,154 @@ static int create_board (Cell *cells[BOARD_SIZE])
     int to = transitions[i][1];
     if (from < to)
     {
-      cells[from - 1]->ladder_to = to;
+      board->cells[from - 1].ladder_to = to;
     }
     else
     {
-      cells[from - 1]->snake_to = to;
+      board->cells[from - 1].snake_to = to;
     }
   }
   return EXIT_SUCCESS;
 }
-
 /**
- * fills database
- * @param markov_chain
- * @return EXIT_SUCCESS or EXIT_FAILURE
+ * read a board from a file: the number of cells and the number of faces of
+ * the dice, then a pair of cells "from to" for every snake (to < from) and
+ * ladder (to > from). the numbers are separated by white space.
+ * @param path
+ * @param board out parameter, its cells are freed by the caller
+ * @return EXIT_SUCCESS or EXIT_FAILURE if the file can't be read or the
+ * board is invalid.
  */
-static int fill_database (MarkovChain *markov_chain)
+static int read_board (const char *path, Board *board)
 {
-  Cell *cells[BOARD_SIZE];
-  if (create_board (cells) == EXIT_FAILURE)
+  board->cells = NULL;
+  FILE *fp = fopen (path, "r");
+  if (fp == NULL)
+  {
+    printf ("Error: failed to open the board file or path is invalid\n");
+    return EXIT_FAILURE;
+  }
+  // the ids of the states are 32 bit and a cell has up to dice_faces
+  // successors
+  if (fscanf (fp, "%d %d", &board->size, &board->dice_faces) != 2
+      || board->size < 2 || board->size > MAX_BOARD_SIZE
+      || board->dice_faces < 1 || board->dice_faces > MAX_DICE_FACES)
   {
+    printf ("Error: invalid board size or dice faces\n");
+    fclose (fp);
     return EXIT_FAILURE;
   }
-  MarkovNode *from_node = NULL, *to_node = NULL;
-  size_t index_to;
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+  board->cells = malloc ((size_t) board->size * sizeof (Cell));
+  if (board->cells == NULL)
   {
-    add_to_database (markov_chain, cells[i]);
+    printf (ALLOCATION_ERROR_MASSAGE);
+    fclose (fp);
+    return EXIT_FAILURE;
   }
-
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+  for (int i = 0; i < board->size; i++)
   {
-    from_node = get_node_from_database (markov_chain, cells[i])->data;
-
-    if (cells[i]->snake_to != EMPTY || cells[i]->ladder_to != EMPTY)
+    board->cells[i] = (Cell) {i + 1, EMPTY, EMPTY};
+  }
+  int from, to, read;
+  while ((read = fscanf (fp, "%d %d", &from, &to)) == 2)
+  {
+    // the last cell ends the game, and a cell has one snake or ladder
+    if (from < 1 || from >= board->size || to < 1 || to > board->size
+        || from == to || board->cells[from - 1].snake_to != EMPTY
+        || board->cells[from - 1].ladder_to != EMPTY)
     {
-      index_to = MAX(cells[i]->snake_to, cells[i]->ladder_to) - 1;
-      to_node = get_node_from_database (markov_chain, cells[index_to])
-          ->data;
-      add_node_to_frequencies_list (from_node, to_node,
-                                    markov_chain);
+      break;
+    }
+    if (from < to)
+    {
+      board->cells[from - 1].ladder_to = to;
     }
     else
     {
-      for (int j = 1; j <= DICE_MAX; j++)
-      {
-        index_to = ((Cell *) (from_node->data))->number + j - 1;
-        if (index_to >= BOARD_SIZE)
-        {
-          break;
-        }
-        to_node = get_node_from_database (markov_chain, cells[index_to])
-            ->data;
-        add_node_to_frequencies_list (from_node, to_node,
-                                      markov_chain);
-      }
+      board->cells[from - 1].snake_to = to;
     }
   }
-  // free temp arr
-  for (size_t i = 0; i < BOARD_SIZE; i++)
+  fclose (fp);
+  if (read != EOF)
   {
-    free (cells[i]);
+    printf ("Error: invalid snake or ladder in the board file\n");
+    free (board->cells);
+    board->cells = NULL;
+    return EXIT_FAILURE;
   }
   return EXIT_SUCCESS;
 }
 
+/**
+ * fills database with the cells of the board and the moves between them,
+ * added in bulk by their ids: cell i + 1 is state i.
+ * @param markov_chain an empty chain
+ * @param board
+ * @return EXIT_SUCCESS or EXIT_FAILURE
+ */
+static int fill_database (MarkovChain *markov_chain, const Board *board)
+{
+  size_t size = (size_t) board->size;
+  void **cells = malloc (size * sizeof (void *));
+  MarkovEdge *edges = malloc (size * board->dice_faces
+                              * sizeof (MarkovEdge));
+  if (cells == NULL || edges == NULL)
+  {
+    free (cells);
+    free (edges);
+    return EXIT_FAILURE;
+  }
+  for (size_t i = 0; i < size; i++)
+  {
+    cells[i] = &board->cells[i];
+  }
+  size_t num_edges = 0;
+  for (size_t i = 0; i < size; i++)
+  {
+    const Cell *cell = &board->cells[i];
+    if (cell->snake_to != EMPTY || cell->ladder_to != EMPTY)
+    {
+      uint32_t index_to = (uint32_t) MAX(cell->snake_to, cell->ladder_to) - 1;
+      edges[num_edges++] = (MarkovEdge) {(uint32_t) i, index_to, 1};
+      continue;
+    }
+    for (int j = 1; j <= board->dice_faces; j++)
+    {
+      size_t index_to = i + j;
+      if (index_to >= size)
+      {
+        break;
+      }
+      edges[num_edges++] = (MarkovEdge) {(uint32_t) i, (uint32_t) index_to,
+                                         1};
+    }
+  }
+  bool filled = add_states_to_database (markov_chain, cells,
+                                        (uint32_t) size)
+                && add_edges_to_database (markov_chain, edges, num_edges);
+  free (cells);
+  free (edges);
+  return filled ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
 /**
  * this function checks if the number of the arguments the user entered is
  * valid
  * @param argc
+ * @param analyzing true if --analyze or --simulate was given, the seed and
+ * number of paths are optional then
  * @return
  */
-static _Bool check_number_arguments (int argc)
+static _Bool check_number_arguments (int argc, bool analyzing)
 {
-  if (argc != NUMBER_OF_ARGUNEBTS)
+  if (argc != NUMBER_OF_ARGUNEBTS
+      && (!analyzing || argc != ANALYSIS_ARGUMENTS))
   {
     printf ("USAGE:./program_name seed_value(unsigned_int) "
-            "number_of_paths(int)\n");
+            "number_of_paths(int) [--stats] [--memory] [--analyze] "
+            "[--simulate N] [--threads N] [--horizon N] [--board file]\n"
+            "or: ./program_name [--analyze] [--simulate N] [--threads N] "
+            "[--horizon N] [--board file]\n");
     return false;
   }
   return true;
@@ -255,29 +589,87 @@ static void update_argumantes (size_t *seed, int *num_paths, char *argv[])
  */
 int main (int argc, char *argv[])
 {
-  if (!check_number_arguments (argc))
+  Options options;
+  argc = parse_options (argc, argv, &options);
+  if (argc == -1 || !check_number_arguments (argc, options.analyze
+                                                    || options.simulate > 0))
+  {
+    return EXIT_FAILURE;
+  }
+  size_t seed = 0;
+  int num_paths = 0;
+  if (argc == NUMBER_OF_ARGUNEBTS)
+  {
+    update_argumantes (&seed, &num_paths, argv);
+  }
+  Board board;
+  if ((options.board_path == NULL ? create_board (&board)
+                                  : read_board (options.board_path, &board))
+      == EXIT_FAILURE)
   {
     return EXIT_FAILURE;
   }
-  size_t seed;
-  int num_paths;
-  update_argumantes (&seed, &num_paths, argv);
+  board_size = board.size;
   MarkovChain *markov_chain = create_markov_chain (print_func, copy_func,
                                                    free_func,
                                                    comp_func, is_last);
   if (markov_chain == NULL)
   {
     printf (ALLOCATION_ERROR_MASSAGE);
+    free (board.cells);
     return EXIT_FAILURE;
   }
-  if (fill_database (markov_chain) == EXIT_FAILURE)
+  if (!set_hash_func (markov_chain, hash_func))
+  {
+    free (board.cells);
+    return handle_error (ALLOCATION_ERROR_MASSAGE, &markov_chain);
+  }
+  markov_chain->size_func = size_func;
+  MarkovStats *stats = &markov_chain->stats;
+  double start = markov_stats_clock ();
+  int filled = fill_database (markov_chain, &board);
+  // the chain holds copies of the cells
+  free (board.cells);
+  if (filled == EXIT_FAILURE)
   {
     printf (ALLOCATION_ERROR_MASSAGE);
-    free (markov_chain);
+    free_database (&markov_chain);
     return EXIT_FAILURE;
   }
-  srand (seed);
-  paths_generator (markov_chain, num_paths);
+  stats->phase_seconds[MARKOV_PHASE_TRAIN] = markov_stats_clock () - start;
+  start = markov_stats_clock ();
+  if (!freeze_markov_chain (markov_chain, SAMPLER_ALIAS))
+  {
+    return handle_error (ALLOCATION_ERROR_MASSAGE, &markov_chain);
+  }
+  stats->phase_seconds[MARKOV_PHASE_COMPILE] = markov_stats_clock () - start;
+  start = markov_stats_clock ();
+  Rng rng;
+  rng_seed (&rng, seed);
+  paths_generator (markov_chain, num_paths, &rng);
+  stats->phase_seconds[MARKOV_PHASE_GENERATE] = markov_stats_clock ()
+                                                - start;
+  if (options.analyze && analyze_game (markov_chain, options.horizon)
+                         == EXIT_FAILURE)
+  {
+    return handle_error (ALLOCATION_ERROR_MASSAGE, &markov_chain);
+  }
+  if (options.simulate > 0 && simulate_games (markov_chain, &options, seed)
+                              == EXIT_FAILURE)
+  {
+    return handle_error (ALLOCATION_ERROR_MASSAGE, &markov_chain);
+  }
+  fflush (stdout);
+  if (options.stats)
+  {
+    print_markov_stats (stats, stderr);
+  }
+  if (options.memory)
+  {
+    MarkovMemory memory;
+    measure_markov_chain (markov_chain, &memory);
+    print_markov_memory (&memory, stderr);
+  }
   free_database (&markov_chain);
   return EXIT_SUCCESS;
 }
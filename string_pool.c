@@ -0,0 +1,211 @@
+#include "string_pool.h"
+#include <string.h> // For memcpy(), memcmp()
+#include <stdbool.h> // for bool
+
+#define FNV_OFFSET_BASIS 14695981039346656037ULL
+#define FNV_PRIME 1099511628211ULL
+#define POOL_INITIAL_CAPACITY 1024
+
+/**
+ * copy a string to the end of the current chunk of the pool, starting a new
+ * chunk if it doesn't fit.
+ * @param pool
+ * @param word
+ * @param length
+ * @return the '\0' terminated copy, NULL in case of allocation error.
+ */
+static const char *store_string (StringPool *pool, const char *word,
+                                 size_t length)
+{
+  StringChunk *chunk = pool->chunks;
+  if (chunk == NULL || chunk->size - chunk->used < length + 1)
+  {
+    size_t size = STRING_POOL_CHUNK_SIZE;
+    if (size < length + 1)
+    {
+      size = length + 1;
+    }
+    chunk = malloc (sizeof (StringChunk) + size);
+    if (chunk == NULL)
+    {
+      return NULL;
+    }
+    chunk->next = pool->chunks;
+    chunk->size = size;
+    chunk->used = 0;
+    pool->chunks = chunk;
+  }
+  char *copy = chunk->bytes + chunk->used;
+  memcpy (copy, word, length);
+  copy[length] = '\0';
+  chunk->used += length + 1;
+  return copy;
+}
+/**
+ * rebuild the hash index of the pool with twice its capacity.
+ * @param pool
+ * @return true on success, false in case of allocation error.
+ */
+static bool grow_index (StringPool *pool)
+{
+  size_t new_capacity = pool->index_capacity * 2;
+  uint32_t *new_index = calloc (new_capacity, sizeof (uint32_t));
+  if (new_index == NULL)
+  {
+    return false;
+  }
+  size_t mask = new_capacity - 1;
+  for (uint32_t id = 0; id < pool->size; id++)
+  {
+    size_t i = string_pool_hash (pool->words[id], pool->lengths[id]) & mask;
+    while (new_index[i] != 0)
+    {
+      i = (i + 1) & mask;
+    }
+    new_index[i] = id + 1;
+  }
+  free (pool->index);
+  pool->index = new_index;
+  pool->index_capacity = new_capacity;
+  return true;
+}
+/**
+ * make room for one more string in the words and lengths arrays.
+ * @param pool
+ * @return true on success, false in case of allocation error.
+ */
+static bool grow_words (StringPool *pool)
+{
+  uint32_t new_capacity = pool->capacity * 2;
+  const char **new_words = realloc (pool->words,
+                                    new_capacity * sizeof (const char *));
+  if (new_words == NULL)
+  {
+    return false;
+  }
+  pool->words = new_words;
+  uint32_t *new_lengths = realloc (pool->lengths,
+                                   new_capacity * sizeof (uint32_t));
+  if (new_lengths == NULL)
+  {
+    return false;
+  }
+  pool->lengths = new_lengths;
+  pool->capacity = new_capacity;
+  return true;
+}
+StringPool *string_pool_create (void)
+{
+  StringPool *pool = malloc (sizeof (StringPool));
+  if (pool == NULL)
+  {
+    return NULL;
+  }
+  pool->chunks = NULL;
+  pool->size = 0;
+  pool->capacity = POOL_INITIAL_CAPACITY;
+  pool->index_capacity = POOL_INITIAL_CAPACITY * 2;
+  pool->words = malloc (pool->capacity * sizeof (const char *));
+  pool->lengths = malloc (pool->capacity * sizeof (uint32_t));
+  pool->index = calloc (pool->index_capacity, sizeof (uint32_t));
+  if (pool->words == NULL || pool->lengths == NULL || pool->index == NULL)
+  {
+    string_pool_free (pool);
+    return NULL;
+  }
+  return pool;
+}
+size_t string_pool_hash (const char *word, size_t length)
+{
+  unsigned long long hash = FNV_OFFSET_BASIS;
+  for (size_t i = 0; i < length; i++)
+  {
+    hash ^= (unsigned char) word[i];
+    hash *= FNV_PRIME;
+  }
+  return (size_t) hash;
+}
+/**
+ * find the slot of a string in the index of the pool.
+ * @return the slot holding the string, or the empty slot it would go to.
+ */
+static size_t find_slot (const StringPool *pool, const char *word,
+                         size_t length)
+{
+  size_t mask = pool->index_capacity - 1;
+  size_t i = string_pool_hash (word, length) & mask;
+  while (pool->index[i] != 0)
+  {
+    uint32_t id = pool->index[i] - 1;
+    if (pool->lengths[id] == length
+        && memcmp (pool->words[id], word, length) == 0)
+    {
+      return i;
+    }
+    i = (i + 1) & mask;
+  }
+  return i;
+}
+uint32_t string_pool_find (const StringPool *pool, const char *word,
+                           size_t length)
+{
+  return pool->index[find_slot (pool, word, length)] - 1;
+}
+uint32_t string_pool_intern (StringPool *pool, const char *word,
+                             size_t length)
+{
+  size_t slot = find_slot (pool, word, length);
+  if (pool->index[slot] != 0)
+  {
+    return pool->index[slot] - 1;
+  }
+  if (length >= STRING_POOL_NO_ID || pool->size == STRING_POOL_NO_ID - 1)
+  {
+    return STRING_POOL_NO_ID;
+  }
+  // keep the load factor of the index under 1/2
+  if ((size_t) (pool->size + 1) * 2 > pool->index_capacity)
+  {
+    if (!grow_index (pool))
+    {
+      return STRING_POOL_NO_ID;
+    }
+    slot = find_slot (pool, word, length);
+  }
+  if (pool->size == pool->capacity && !grow_words (pool))
+  {
+    return STRING_POOL_NO_ID;
+  }
+  const char *copy = store_string (pool, word, length);
+  if (copy == NULL)
+  {
+    return STRING_POOL_NO_ID;
+  }
+  uint32_t id = pool->size++;
+  pool->words[id] = copy;
+  pool->lengths[id] = (uint32_t) length;
+  pool->index[slot] = id + 1;
+  return id;
+}
+const char *string_pool_get (const StringPool *pool, uint32_t id)
+{
+  return pool->words[id];
+}
+void string_pool_free (StringPool *pool)
+{
+  if (pool == NULL)
+  {
+    return;
+  }
+  StringChunk *chunk = pool->chunks;
+  while (chunk != NULL)
+  {
+    StringChunk *next = chunk->next;
+    free (chunk);
+    chunk = next;
+  }
+  free (pool->words);
+  free (pool->lengths);
+  free (pool->index);
+  free (pool);
+}
@@ -0,0 +1,88 @@
+#ifndef _STRING_POOL_H_
+#define _STRING_POOL_H_
+#include <stdlib.h> // For malloc(), size_t
+#include <stdint.h> // For uint32_t
+
+#define STRING_POOL_NO_ID UINT32_MAX
+#define STRING_POOL_CHUNK_SIZE (256 * 1024)
+
+/**
+ * a chunk of the pool the interned strings are packed into one after the
+ * other, each one followed by '\0'.
+ */
+typedef struct StringChunk
+{
+    struct StringChunk *next;
+    size_t size;
+    size_t used;
+    char bytes[];
+} StringChunk;
+
+/**
+ * a set of interned strings. every distinct string is stored once, packed
+ * with the others in big chunks, and gets a dense 32 bit id in the order
+ * the strings were first interned. the strings never move, so pointers
+ * returned by the pool stay valid until it is freed.
+ */
+typedef struct StringPool
+{
+    StringChunk *chunks;// the first chunk is the one being filled
+    const char **words;// the interned strings by id
+    uint32_t *lengths;// the lengths of the interned strings by id
+    uint32_t size;// the number of interned strings
+    uint32_t capacity;// the allocated length of words and lengths
+    uint32_t *index;// open addressing hash table of id + 1, 0 if empty
+    size_t index_capacity;// always a power of 2
+} StringPool;
+
+/**
+ * Create a new empty string pool.
+ * @return a pointer to the new pool, NULL if allocation failed.
+ * @attention the pool must be freed with string_pool_free.
+ */
+StringPool *string_pool_create (void);
+
+/**
+ * Hash length bytes of a string with the 64 bit FNV-1a hash.
+ * @param word the bytes to hash, doesn't have to be '\0' terminated
+ * @param length
+ * @return the hash
+ */
+size_t string_pool_hash (const char *word, size_t length);
+
+/**
+ * Get the id of a string in the pool, adding it if it is not there yet.
+ * @param pool
+ * @param word the bytes of the string, doesn't have to be '\0' terminated
+ * @param length the number of bytes in word
+ * @return the id of the string, STRING_POOL_NO_ID in case of allocation
+ * error.
+ */
+uint32_t string_pool_intern (StringPool *pool, const char *word,
+                             size_t length);
+
+/**
+ * Get the id of a string in the pool without adding it.
+ * @param pool
+ * @param word the bytes of the string, doesn't have to be '\0' terminated
+ * @param length the number of bytes in word
+ * @return the id of the string, STRING_POOL_NO_ID if it is not in the pool.
+ */
+uint32_t string_pool_find (const StringPool *pool, const char *word,
+                           size_t length);
+
+/**
+ * Get an interned string by its id.
+ * @param pool
+ * @param id an id returned by the pool
+ * @return the '\0' terminated string owned by the pool
+ */
+const char *string_pool_get (const StringPool *pool, uint32_t id);
+
+/**
+ * Free the pool and all the strings in it.
+ * @param pool
+ */
+void string_pool_free (StringPool *pool);
+
+#endif //_STRING_POOL_H_
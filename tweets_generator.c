@@ -1,21 +1,93 @@
 #include "linked_list.h"
 #include "markov_chain.h"
+#include "compiled_chain.h"
+#include "string_pool.h"
+#include "corpus_reader.h"
+#include "partial_chain.h"
+#include "live_chain.h"
+#include "kgram.h"
+#include "markov_analytics.h"
+#include "dedupe_filter.h"
 #include <string.h>
-#define MAX_LINE_LEN 1000
+#include <pthread.h>
 #define MAX_WORD_LEN 100
 #define ARGUMENTS_WORD_COUNTER 5
 #define ARGUMENTS_NO_COUNTER 4
+#define ARGUMENTS_LOAD 3
 #define READ_WHOLE_FILE (-1)
 #define INT_BASE 10
 #define MAX_LEN_TWEET 20
+#define TWEETS_PER_BATCH 8192
+#define WORDS_PER_PUBLICATION 10000
+#define ANALYTICS_TOP_STATES 10
+// the walks drawn for a tweet with --dedupe before a duplicate is printed
+#define DEDUPE_MAX_ATTEMPTS 16
+// the most tweets --dedupe remembers
+#define DEDUPE_MAX_EMITTED (1 << 22)
+#define DEDUPE_INITIAL_SENTENCES 1024
 
+/**
+ * the pool all the words of the chain are interned in. the states of the
+ * chain point to their word in the pool.
+ */
+static StringPool *word_pool = NULL;
+/**
+ * the number of words in a state of the chain. the states of a chain of
+ * order 1 are the words of word_pool, the states of a higher order are
+ * KGrams of word ids copied into kgram_arena.
+ */
+static uint32_t chain_order = 1;
+static Arena *kgram_arena = NULL;
+/**
+ * the stats of the run, printed with --stats. the counters of the chain are
+ * copied here before it is freed, the walks are added by the slices.
+ */
+static MarkovStats run_stats;
+/**
+ * the state of --dedupe: the sentences of the text and the tweets printed
+ * so far, and how many walks they rejected.
+ */
+typedef struct Dedupe
+{
+    uint64_t *sentences;// the hashes of the sentences of the text, while
+    // it is read
+    size_t num_sentences;
+    size_t sentences_capacity;
+    uint64_t sentence_hash;// the hash of the words of the sentence being
+    // read
+    BloomFilter corpus;// the sentences of the text, once it was read
+    HashSet emitted;// the tweets printed so far
+    uint64_t corpus_rejections;// walks dropped for being a sentence of the
+    // text
+    uint64_t emitted_rejections;// walks dropped for being printed before
+    uint64_t duplicates;// tweets printed after DEDUPE_MAX_ATTEMPTS walks
+    // were all dropped
+    uint64_t forgotten;// tweets not remembered because emitted was full
+} Dedupe;
+/**
+ * the state of --dedupe, NULL without it. the generating threads only read
+ * the filters, the calling thread updates them between the batches.
+ */
+static Dedupe *dedupe = NULL;
 
+/**
+ * does nothing, the words are owned by word_pool and freed with it.
+ * @param pointer
+ */
 static void free_func (void *pointer);
 /**
  * this function print the data inside the generic pointer.
  * @param data
  */
 static void print_func (const void *data);
+/**
+ * append the data inside the generic pointer to a buffer, the same way
+ * print_func prints it.
+ * @param data
+ * @param text
+ * @return false if the buffer failed to grow, true else.
+ */
+static bool format_func (const void *data, ByteBuffer *text);
 /**
  * takes in a word in a collection a return true if the word is last and
  * false else.
@@ -31,41 +103,311 @@ static bool is_last (const void *data);
  */
 static int comp_func (const void *data1, const void *data2);
 /**
- * Duplicates a string or data pointed to by a void pointer.
+ * Interns a string in word_pool.
  *
- * This function takes a void pointer `source` that points to a string or
- * data and creates a dynamically allocated copy of it.
+ * @param source A void pointer pointing to the source string.
+ * @return A void pointer pointing to the copy of the source string owned by
+ * word_pool. Returns NULL if the allocation fails.
  *
- * @param source A void pointer pointing to the source string or data to
- * be duplicated.
- * @return A void pointer pointing to the dynamically allocated copy of the
- * source string or data. Returns NULL if the allocation fails.
- *
- * @note The caller is responsible for freeing the dynamically allocated
- * memory using the `free` function when it is no longer needed to avoid memory
- * leaks.
+ * @note The copy stays valid until word_pool is freed, it must not be freed
+ * on its own.
  */
 static void *copy_func (const void *source);
+/**
+ * hash a string the same way word_pool does.
+ * @param data the string to hash
+ * @return the hash of the string
+ */
+static size_t hash_func (const void *data);
+/**
+ * the number of bytes of a string, with its '\0'.
+ * @param data the string
+ * @return strlen + 1
+ */
+static size_t size_func (const void *data);
+/**
+ * print the last word of a KGram the way print_func prints a word.
+ * @param data the KGram
+ */
+static void gram_print_func (const void *data);
+/**
+ * append the last word of a KGram to a buffer the way format_func appends
+ * a word.
+ * @param data the KGram
+ * @param text
+ * @return false if the buffer failed to grow, true else.
+ */
+static bool gram_format_func (const void *data, ByteBuffer *text);
+/**
+ * append all the words of a KGram but the last one to a buffer, so a tweet
+ * starting from it starts with all its words.
+ * @param data the KGram
+ * @param text
+ * @return false if the buffer failed to grow, true else.
+ */
+static bool format_gram_prefix (const void *data, ByteBuffer *text);
+/**
+ * checks if the last word of a KGram is last.
+ * @param data the KGram
+ * @return true if it is last, false else.
+ */
+static bool gram_is_last (const void *data);
+/**
+ * the number of bytes of a KGram state.
+ */
+static size_t gram_size_func (const void *data);
+/**
+ * copy a KGram into kgram_arena.
+ * @param source the KGram
+ * @return the copy, NULL if the allocation fails.
+ */
+static void *gram_copy_func (const void *source);
+/**
+ * free word_pool, kgram_arena and dedupe.
+ */
+static void free_vocabulary (void);
+/**
+ * the optional flags of the program, given before or between the
+ * positional arguments.
+ */
+typedef struct Options
+{
+    bool opener_starts;// --opener-starts: weight the first word of a tweet
+    // by how often it opened a sentence in the text
+    int threads;// --threads N: the number of threads generating tweets
+    int train_threads;// --train-threads N: the number of threads reading
+    // the text, used only when the whole text is read
+    const char *save_path;// --save path: write the trained chain there
+    const char *load_path;// --load path: generate from a saved chain
+    // instead of reading a text
+    const char *update_path;// --update path: learn this text while the
+    // tweets are generated
+    int order;// --order k: the number of words in a state
+    bool stats;// --stats: print where the time of the run went to stderr
+    bool memory;// --memory: print the memory the trained chain takes to
+    // stderr
+    int prune;// --prune N: drop the transitions seen less than N times and
+    // the states left without use, 0 to keep the chain as trained
+    bool compressed;// --compressed: generate from a chain with packed rows
+    bool analytics;// --analytics: print the stationary distribution and
+    // the entropy of the chain to stderr
+    bool dedupe;// --dedupe: draw a tweet again if it is a sentence of the
+    // text or was printed before
+} Options;
+/**
+ * a tweet drawn with --dedupe, kept until the tweets before it in its batch
+ * were printed.
+ */
+typedef struct DedupeTweet
+{
+    uint64_t hash;// the hash of the words of the tweet
+    Rng rng;// the generator of the tweet after its last walk, to draw
+    // more walks from
+    int attempts;// the number of walks drawn for the tweet
+    size_t end;// the offset of the end of the tweet in the text of its
+    // slice
+} DedupeTweet;
+/**
+ * a slice of a batch of tweets, generated by one thread.
+ */
+typedef struct TweetsSlice
+{
+    const CompiledChain *compiled;// NULL when generating from live
+    LiveChain *live;// the chain to read snapshots of, or NULL
+    int reader;// the reader slot of the slice in live
+    unsigned int seed;
+    int first_tweet;// the number of the first tweet in the slice
+    int count;// the number of tweets in the slice
+    ByteBuffer text;// the formatted tweets of the slice
+    bool failed;// set if text failed to grow
+    MarkovStats stats;// the walks generated by the slice
+    DedupeTweet *tweets;// the tweets of the slice with --dedupe,
+    // NULL without it
+    uint64_t corpus_rejections;// the walks of the slice dropped for being
+    // a sentence of the text
+    uint64_t emitted_rejections;// the walks of the slice dropped for being
+    // printed in an earlier batch
+} TweetsSlice;
 /**
  * this number checks if the number of arguments the user entered is valid
  * to run the program.
  * @param argc
- * @return true if the number of arguments is 4 or 5 and false else.
+ * @param loading true if the chain is loaded with --load
+ * @return true if the number of arguments is 4 or 5, or 3 when loading, and
+ * false else.
  */
-static _Bool check_number_arguments (int argc)
+static _Bool check_number_arguments (int argc, bool loading)
 {
-  if (argc != ARGUMENTS_WORD_COUNTER && argc != ARGUMENTS_NO_COUNTER)
+  if ((!loading && argc != ARGUMENTS_WORD_COUNTER
+       && argc != ARGUMENTS_NO_COUNTER)
+      || (loading && argc != ARGUMENTS_LOAD))
   {
-    printf ("USAGE:./program_name seed_value(unsigned_int) "
-            "number_of_twits(int) optional- number_of_words_to_read(int)\n");
+    printf ("USAGE:./program_name [--opener-starts] [--threads N] "
+            "[--train-threads N] [--save model_path] [--update path] "
+            "[--order k] [--prune N] [--compressed] [--stats] [--memory] "
+            "[--analytics] [--dedupe] "
+            "seed_value(unsigned_int) number_of_twits(int) text_corpus_path "
+            "optional- number_of_words_to_read(int)\n"
+            "or: ./program_name [--threads N] [--compressed] [--stats] "
+            "[--memory] [--analytics] [--dedupe] --load model_path "
+            "seed_value(unsigned_int) number_of_twits(int)\n");
     return false;
   }
   return true;
 }
+/**
+ * separate the flags of the program from its positional arguments. argv
+ * is rearranged so the positional arguments follow the program name.
+ * @param argc
+ * @param argv
+ * @param options out parameter, the flags that were given
+ * @return the number of the program name and positional arguments, or -1
+ * if an unknown flag was given.
+ */
+static int parse_options (int argc, char *argv[], Options *options)
+{
+  *options = (Options) {false, 1, 1, NULL, NULL, NULL, 1, false, false, 0,
+                        false, false, false};
+  int positional = 1;
+  for (int i = 1; i < argc; i++)
+  {
+    if (strncmp (argv[i], "--", 2) != 0)
+    {
+      argv[positional++] = argv[i];
+    }
+    else if (strcmp (argv[i], "--opener-starts") == 0)
+    {
+      options->opener_starts = true;
+    }
+    else if (strcmp (argv[i], "--threads") == 0 && i + 1 < argc)
+    {
+      options->threads = (int) strtol (argv[++i], NULL, INT_BASE);
+      if (options->threads < 1)
+      {
+        printf ("Error: the number of threads must be positive\n");
+        return -1;
+      }
+    }
+    else if (strcmp (argv[i], "--train-threads") == 0 && i + 1 < argc)
+    {
+      options->train_threads = (int) strtol (argv[++i], NULL, INT_BASE);
+      if (options->train_threads < 1)
+      {
+        printf ("Error: the number of threads must be positive\n");
+        return -1;
+      }
+    }
+    else if (strcmp (argv[i], "--save") == 0 && i + 1 < argc)
+    {
+      options->save_path = argv[++i];
+    }
+    else if (strcmp (argv[i], "--load") == 0 && i + 1 < argc)
+    {
+      options->load_path = argv[++i];
+    }
+    else if (strcmp (argv[i], "--update") == 0 && i + 1 < argc)
+    {
+      options->update_path = argv[++i];
+    }
+    else if (strcmp (argv[i], "--stats") == 0)
+    {
+      options->stats = true;
+    }
+    else if (strcmp (argv[i], "--memory") == 0)
+    {
+      options->memory = true;
+    }
+    else if (strcmp (argv[i], "--compressed") == 0)
+    {
+      options->compressed = true;
+    }
+    else if (strcmp (argv[i], "--analytics") == 0)
+    {
+      options->analytics = true;
+    }
+    else if (strcmp (argv[i], "--dedupe") == 0)
+    {
+      options->dedupe = true;
+    }
+    else if (strcmp (argv[i], "--prune") == 0 && i + 1 < argc)
+    {
+      options->prune = (int) strtol (argv[++i], NULL, INT_BASE);
+      if (options->prune < 1)
+      {
+        printf ("Error: the prune threshold must be positive\n");
+        return -1;
+      }
+    }
+    else if (strcmp (argv[i], "--order") == 0 && i + 1 < argc)
+    {
+      options->order = (int) strtol (argv[++i], NULL, INT_BASE);
+      if (options->order < 1)
+      {
+        printf ("Error: the order must be positive\n");
+        return -1;
+      }
+    }
+    else
+    {
+      printf ("Error: unknown option %s\n", argv[i]);
+      return -1;
+    }
+  }
+  if (options->update_path != NULL
+      && (options->load_path != NULL || options->save_path != NULL))
+  {
+    printf ("Error: --update can't be used with --load or --save\n");
+    return -1;
+  }
+  if (options->compressed
+      && (options->update_path != NULL || options->save_path != NULL))
+  {
+    // the snapshots of --update are compiled as they are published, and a
+    // model file holds the rows unpacked
+    printf ("Error: --compressed can't be used with --update or --save\n");
+    return -1;
+  }
+  if ((options->analytics || options->dedupe)
+      && options->update_path != NULL)
+  {
+    // the chain keeps changing while the tweets are generated
+    printf ("Error: --analytics and --dedupe can't be used with --update\n");
+    return -1;
+  }
+  if (options->dedupe && options->train_threads > 1)
+  {
+    // the sentences of the text are hashed as the words are read on one
+    // thread, the shards count single words
+    printf ("Error: --dedupe can't be used with --train-threads\n");
+    return -1;
+  }
+  if (options->prune > 0 && options->load_path != NULL)
+  {
+    printf ("Error: --prune can't be used with --load\n");
+    return -1;
+  }
+  if (options->order > 1
+      && (options->load_path != NULL || options->save_path != NULL))
+  {
+    // a model file holds the data of the states, not the words they refer to
+    printf ("Error: --order can't be used with --load or --save\n");
+    return -1;
+  }
+  if (options->order > 1 && options->update_path != NULL)
+  {
+    // the generating threads read the words of a state from word_pool,
+    // which the updating thread grows
+    printf ("Error: --order can't be used with --update\n");
+    return -1;
+  }
+  return positional;
+}
 /**
  * This function reads from the file the number of words the user choose to
  * read. If the number of words to read is bigger than the number of words
  * in the file,it will read the while file and won't produce and error message.
+ * the file is tokenized in place, a word is copied only the first time it
+ * is seen.
  * @param fp
  * @param word_to_read
  * @param markov_chain
@@ -73,14 +415,27 @@ static _Bool check_number_arguments (int argc)
  */
 static int fill_database (FILE *fp, int word_to_read, MarkovChain
 *markov_chain);
+/**
+ * reads the whole file on several threads, every thread counting a shard of
+ * it into a partial chain, and merges the shards into the database. the
+ * database is the same as the one fill_database builds.
+ * @param fp
+ * @param threads
+ * @param markov_chain
+ * @return 0 if database filled successfully and 1 if not.
+ */
+static int fill_database_sharded (FILE *fp, int threads, MarkovChain
+*markov_chain);
 /**
  * activate the function fill database according to the user arguments.
  * @param words_from_cli
  * @param file_to_read
  * @param markov_chain
+ * @param train_threads the number of threads to read the whole file with
  */
 static int database_with_parameters (char *words_from_cli, FILE *file_to_read,
-                                     MarkovChain *markov_chain);
+                                     MarkovChain *markov_chain,
+                                     int train_threads);
 /**
  * updating current frequencies array with prev.
  * @param markov_chain
@@ -90,136 +445,1089 @@ static int database_with_parameters (char *words_from_cli, FILE *file_to_read,
  */
 static int adding_prev (Node *prev, Node *current, MarkovChain *markov_chain);
 /**
- * pharse a line from fgets into words and put them in the database
+ * the state of filling the database from the words of the corpus.
+ */
+typedef struct FillContext
+{
+    MarkovChain *markov_chain;
+    Node *prev;// the node of the previous word, NULL before the first word
+    int word_to_read;// the number of words left to read, or READ_WHOLE_FILE
+    bool failed;// set in case of allocation error
+    KGramWindow *window;// the last words of the current sentence, NULL
+    // when the states are single words
+} FillContext;
+/**
+ * put a word of the corpus in the database, called by read_corpus for
+ * every word.
+ * @param token the word, not '\0' terminated
+ * @param length
+ * @param context the FillContext
+ * @return true to read the next word, false when done or failed.
+ */
+static bool add_word (const char *token, size_t length, void *context);
+/**
+ * the state of the thread learning the --update text.
+ */
+typedef struct UpdateContext
+{
+    FillContext fill;
+    LiveChain *live;
+    FILE *fp;
+    int words;// the number of words learned since the last publication
+} UpdateContext;
+/**
+ * put a word of the --update text in the live chain, publishing a new
+ * snapshot every WORDS_PER_PUBLICATION words.
+ * @param token the word, not '\0' terminated
+ * @param length
+ * @param context the UpdateContext
+ * @return true to read the next word, false if failed.
+ */
+static bool add_update_word (const char *token, size_t length,
+                             void *context);
+/**
+ * learn the --update text. the start routine of the updating thread.
+ * @param arg the UpdateContext
+ * @return NULL
+ */
+static void *update_chain (void *arg);
+/**
+ * build the chain out of the text given in the arguments. prints the
+ * reason of a failure.
+ * @param argc
+ * @param argv
+ * @param options
+ * @return the chain, whose words live in word_pool, or NULL if the text
+ * could not be read or in case of allocation error.
+ */
+static MarkovChain *train_from_text (int argc, char *argv[],
+                                     const Options *options);
+/**
+ * generate the tweets from a live chain while another thread keeps
+ * teaching it the --update text. every tweet comes from the snapshot that
+ * was the latest when it started, so the output depends on the timing of
+ * the threads. prints the reason of a failure.
+ * @param markov_chain the trained chain
+ * @param options
+ * @param seed
+ * @param number_of_tweets
+ * @return 0 on success, 1 else.
+ */
+static int generate_live (MarkovChain *markov_chain, const Options *options,
+                          unsigned int seed, int number_of_tweets);
+/**
+ * generate and print number_of_tweets random tweets out of the compiled
+ * chain. tweet i draws from stream i of the seed, so the tweets are the same
+ * for any number of threads. the tweets are generated in batches split
+ * between the threads, every thread formats its slice into its own buffer
+ * and the buffers are written in order after every batch.
+ * @param compiled
+ * @param live if not NULL, every tweet is generated from the latest
+ * snapshot of it instead of from compiled
+ * @param number_of_tweets
+ * @param seed
+ * @param threads the number of threads to generate with
+ * @return 0 on success, 1 in case of allocation error.
+ */
+static int tweets_generator (const CompiledChain *compiled, LiveChain *live,
+                             int number_of_tweets, unsigned int seed,
+                             int threads);
+/**
+ * generate the tweets of a slice. the start routine of the generating
+ * threads.
+ * @param arg the TweetsSlice to generate
+ * @return NULL
+ */
+static void *generate_slice (void *arg);
+/**
+ * the longest walk of a tweet: MAX_LEN_TWEET words, the words of its first
+ * state that come before the last one included.
+ * @return the number of states
+ */
+static int tweet_max_length (void);
+/**
+ * append a tweet to a buffer: its number and its words.
+ * @param compiled
+ * @param tweet_number
+ * @param states the walk of the tweet
+ * @param length the number of states in the walk
+ * @param text
+ * @return false if the buffer failed to grow, true else.
+ */
+static bool format_tweet (const CompiledChain *compiled, int tweet_number,
+                          const uint32_t *states, int length,
+                          ByteBuffer *text);
+/**
+ * hash the words of a walk the way the sentences of the text are hashed.
+ * @param compiled
+ * @param states
+ * @param length the number of states in states
+ * @return the finished hash
+ */
+static uint64_t hash_walk (const CompiledChain *compiled,
+                           const uint32_t *states, int length);
+/**
+ * draw walks for a tweet from its generator until one is neither a
+ * sentence of the text nor a tweet in dedupe->emitted, or the tweet drew
+ * DEDUPE_MAX_ATTEMPTS walks.
+ * @param slice counts the draws of the walks in its stats
+ * @param compiled
+ * @param max_length
+ * @param states out parameter, the last walk
+ * @param tweet the tweet, its hash and generator updated
+ * @param corpus_rejections counts the walks that were a sentence
+ * @param emitted_rejections counts the walks that were printed before
+ * @return the length of the last walk
+ */
+static int draw_deduped_walk (TweetsSlice *slice,
+                              const CompiledChain *compiled, int max_length,
+                              uint32_t *states, DedupeTweet *tweet,
+                              uint64_t *corpus_rejections,
+                              uint64_t *emitted_rejections);
+/**
+ * draw a walk from a compiled chain with compiled_walk, and count its draws
+ * in the stats of the slice like get_first_random_node and
+ * get_next_random_node count theirs.
+ * @param slice
+ * @param compiled
+ * @param max_length
+ * @param rng
+ * @param states out parameter, the walk
+ * @return the length of the walk
+ */
+static int draw_walk (TweetsSlice *slice, const CompiledChain *compiled,
+                      int max_length, Rng *rng, uint32_t *states);
+/**
+ * print the tweets of a slice in order with --dedupe, drawing again the
+ * ones printed earlier in the batch, and remember them in dedupe->emitted.
+ * @param slice
+ * @param redrawn a buffer to format the tweets drawn again in
+ * @return false in case of allocation error or if the write failed, true
+ * else.
+ */
+static bool print_deduped_slice (TweetsSlice *slice, ByteBuffer *redrawn);
+/**
+ * allocate dedupe, ready to hash the sentences of the text.
+ * @return false in case of allocation error, true else.
+ */
+static bool create_dedupe (void);
+/**
+ * add a word of the text to the hash of the sentence it is in, and keep the
+ * hash of the sentence once it ends.
  * @param word
- * @param word_to_read
+ * @param length
+ * @return false in case of allocation error, true else.
+ */
+static bool add_sentence_word (const char *word, size_t length);
+/**
+ * build the filter of the sentences of the text and the set of the tweets
+ * to print, once the text was read.
+ * @param number_of_tweets
+ * @return false in case of allocation error, true else.
+ */
+static bool start_dedupe (int number_of_tweets);
+/**
+ * print to stderr what --dedupe rejected and the memory of its filters.
+ */
+static void report_dedupe (void);
+/**
+ * add the counters of a chain to run_stats, with the time it took to train
+ * and to generate from it.
  * @param markov_chain
- * @return 1 if failed and 0 if finished successfully
+ * @param train_seconds
+ * @param generate_seconds
  */
-static int
-word_phraser (char *word, Node *current, int *word_to_read,
-              MarkovChain **markov_chain, Node **prev);
-static void tweets_generator (MarkovChain *markov_chain, int number_of_tweets);
+static void add_chain_stats (const MarkovChain *markov_chain,
+                             double train_seconds, double generate_seconds);
+/**
+ * print the memory the chain takes to stderr if --memory was given, with
+ * the words interned in word_pool.
+ * @param markov_chain
+ * @param options
+ */
+static void report_memory (const MarkovChain *markov_chain,
+                           const Options *options);
+/**
+ * print the stationary distribution of a walk that restarts at the end of
+ * every tweet, its ANALYTICS_TOP_STATES most likely states and the entropy
+ * of the chain to stderr if --analytics was given. the distribution is
+ * computed on --threads threads.
+ * @param compiled a chain that is not packed
+ * @param options
+ * @return false in case of allocation error, true else.
+ */
+static bool report_analytics (const CompiledChain *compiled,
+                              const Options *options);
 int main (int argc, char *argv[])
 {
-  if (!check_number_arguments (argc))
+  Options options;
+  argc = parse_options (argc, argv, &options);
+  if (argc == -1 || !check_number_arguments (argc, options.load_path != NULL))
   {
     return EXIT_FAILURE;
   }
-  FILE *file_to_read = fopen (argv[3], "r");//set file pointer
-  if (file_to_read == NULL)//checks if succeed
-  {
-    printf ("Error: failed to open the file or path is invalid\n");
-    return EXIT_FAILURE;
-  }
-  MarkovChain *markov_chain = create_markov_chain (print_func, copy_func,
-                                                   free_func,
-                                                   comp_func, is_last);
-  if (markov_chain == NULL)//try to create a new markov chain and checks it
+  chain_order = (uint32_t) options.order;
+  if (options.dedupe && !create_dedupe ())
   {
     printf (ALLOCATION_ERROR_MASSAGE);
     return EXIT_FAILURE;
   }
   unsigned int seed = (unsigned int) strtol (argv[1], NULL,
                                              INT_BASE);
-  srand (seed);
   int number_of_tweets = (int) strtol (argv[2], NULL,
                                        INT_BASE);
-  if (argc == ARGUMENTS_WORD_COUNTER)
+  CompiledChain *compiled = NULL;
+  // loading a model takes the place of training on a text in the stats
+  double start = markov_stats_clock ();
+  if (options.load_path != NULL)
   {
-    if (database_with_parameters (argv[4], file_to_read,
-                                  markov_chain) == 1)
+    compiled = load_compiled_chain (options.load_path, SAMPLER_ALIAS,
+                                    format_func);
+    if (compiled == NULL)
     {
-      printf (ALLOCATION_ERROR_MASSAGE);
-      free_database (&markov_chain);
-      fclose (file_to_read);
+      printf ("Error: failed to load the model or it is invalid\n");
+      free_vocabulary ();
       return EXIT_FAILURE;
     }
+    run_stats.phase_seconds[MARKOV_PHASE_TRAIN] = markov_stats_clock ()
+                                                  - start;
   }
-  if (argc == ARGUMENTS_NO_COUNTER)
+  else
   {
-    if (database_with_parameters ("-1", file_to_read,
-                                  markov_chain) == 1)
+    MarkovChain *markov_chain = train_from_text (argc, argv, &options);
+    if (markov_chain == NULL)
+    {
+      free_vocabulary ();
+      return EXIT_FAILURE;
+    }
+    MarkovPruneReport pruned;
+    if (options.prune > 0
+        && !prune_markov_chain (markov_chain, options.prune, &pruned))
     {
       printf (ALLOCATION_ERROR_MASSAGE);
       free_database (&markov_chain);
-      fclose (file_to_read);
+      free_vocabulary ();
+      return EXIT_FAILURE;
+    }
+    if (options.prune > 0)
+    {
+      fprintf (stderr, "pruned %zu transitions and %zu states, %zu of %zu "
+                       "bytes reclaimed\n", pruned.transitions_removed,
+               pruned.states_removed,
+               pruned.bytes_before - pruned.bytes_after, pruned.bytes_before);
+    }
+    double trained = markov_stats_clock ();
+    if (options.update_path != NULL)
+    {
+      int generated = generate_live (markov_chain, &options, seed,
+                                     number_of_tweets);
+      add_chain_stats (markov_chain, trained - start,
+                       markov_stats_clock () - trained);
+      report_memory (markov_chain, &options);
+      free_database (&markov_chain);
+      free_vocabulary ();
+      if (options.stats)
+      {
+        fflush (stdout);
+        print_markov_stats (&run_stats, stderr);
+      }
+      return (generated == 1) ? EXIT_FAILURE : EXIT_SUCCESS;
+    }
+    // the words live in word_pool, so the chain is not needed once it is
+    // compiled for generation
+    compiled = compile_markov_chain (markov_chain, SAMPLER_ALIAS);
+    add_chain_stats (markov_chain, trained - start, 0.0);
+    run_stats.phase_seconds[MARKOV_PHASE_COMPILE] = markov_stats_clock ()
+                                                    - trained;
+    report_memory (markov_chain, &options);
+    free_database (&markov_chain);
+    if (compiled == NULL)
+    {
+      printf (ALLOCATION_ERROR_MASSAGE);
+      free_vocabulary ();
       return EXIT_FAILURE;
     }
   }
-  tweets_generator (markov_chain, number_of_tweets);
-  free_database (&markov_chain);
-  fclose (file_to_read);
+  if (options.save_path != NULL
+      && !save_compiled_chain (compiled, size_func, options.save_path))
+  {
+    printf ("Error: failed to write the model file\n");
+    free_compiled_chain (&compiled);
+    free_vocabulary ();
+    return EXIT_FAILURE;
+  }
+  if (!report_analytics (compiled, &options)
+      || (dedupe != NULL && !start_dedupe (number_of_tweets)))
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    free_compiled_chain (&compiled);
+    free_vocabulary ();
+    return EXIT_FAILURE;
+  }
+  size_t unpacked_bytes = compiled_chain_bytes (compiled);
+  start = markov_stats_clock ();
+  if (options.compressed && !pack_compiled_chain (compiled))
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    free_compiled_chain (&compiled);
+    free_vocabulary ();
+    return EXIT_FAILURE;
+  }
+  run_stats.phase_seconds[MARKOV_PHASE_COMPILE] += markov_stats_clock ()
+                                                   - start;
+  if (options.memory)
+  {
+    fprintf (stderr, "compiled chain       %12zu bytes", unpacked_bytes);
+    if (options.compressed)
+    {
+      fprintf (stderr, " (%zu packed)", compiled_chain_bytes (compiled));
+    }
+    fprintf (stderr, "\n");
+  }
+  start = markov_stats_clock ();
+  int generated = tweets_generator (compiled, NULL, number_of_tweets, seed,
+                                    options.threads);
+  run_stats.phase_seconds[MARKOV_PHASE_GENERATE] = markov_stats_clock ()
+                                                   - start;
+  report_dedupe ();
+  free_compiled_chain (&compiled);
+  free_vocabulary ();
+  if (generated == 1)
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    return EXIT_FAILURE;
+  }
+  if (options.stats)
+  {
+    fflush (stdout);
+    print_markov_stats (&run_stats, stderr);
+  }
   return EXIT_SUCCESS;
 }
-static void tweets_generator (MarkovChain *markov_chain, int number_of_tweets)
+static MarkovChain *train_from_text (int argc, char *argv[],
+                                     const Options *options)
 {
-  int i = 1;
-  while (number_of_tweets >= i)
+  FILE *file_to_read = fopen (argv[3], "r");//set file pointer
+  if (file_to_read == NULL)//checks if succeed
   {
-
-    printf ("Tweet %d: ", i);
-    generate_tweet (markov_chain, NULL, (MAX_LEN_TWEET));
-    printf ("\n");
-    i++;
+    printf ("Error: failed to open the file or path is invalid\n");
+    return NULL;
+  }
+  word_pool = string_pool_create ();
+  if (chain_order > 1)
+  {
+    kgram_arena = arena_create (ARENA_DEFAULT_BLOCK_SIZE);
+  }
+  if (word_pool == NULL || (chain_order > 1 && kgram_arena == NULL))
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    free_vocabulary ();
+    fclose (file_to_read);
+    return NULL;
+  }
+  MarkovChain *markov_chain = NULL;
+  if (chain_order > 1)
+  {
+    markov_chain = create_markov_chain (gram_print_func, gram_copy_func,
+                                        free_func, kgram_compare,
+                                        gram_is_last);
+  }
+  else
+  {
+    markov_chain = create_markov_chain (print_func, copy_func, free_func,
+                                        comp_func, is_last);
+  }
+  if (markov_chain == NULL)//try to create a new markov chain and checks it
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    free_vocabulary ();
+    fclose (file_to_read);
+    return NULL;
+  }
+  if (!set_hash_func (markov_chain, (chain_order > 1) ? kgram_hash
+                                                      : hash_func))
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    free_database (&markov_chain);
+    free_vocabulary ();
+    fclose (file_to_read);
+    return NULL;
   }
+  markov_chain->weighted_starts = options->opener_starts;
+  markov_chain->format_func = (chain_order > 1) ? gram_format_func
+                                                : format_func;
+  markov_chain->size_func = (chain_order > 1) ? gram_size_func : size_func;
+  char *words_to_read = (argc == ARGUMENTS_WORD_COUNTER) ? argv[4] : "-1";
+  if (database_with_parameters (words_to_read, file_to_read,
+                                markov_chain, options->train_threads) == 1)
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    free_database (&markov_chain);
+    free_vocabulary ();
+    fclose (file_to_read);
+    return NULL;
+  }
+  fclose (file_to_read);
+  return markov_chain;
 }
-static int fill_database (FILE *fp, int word_to_read, MarkovChain
-*markov_chain)
+static int generate_live (MarkovChain *markov_chain, const Options *options,
+                          unsigned int seed, int number_of_tweets)
 {
-
-  char line[MAX_LINE_LEN];
-  char *word = NULL;
-  Node *prev = NULL;
-  Node *current = NULL;
-  while ((word_to_read > 0 || word_to_read == READ_WHOLE_FILE)
-         && fgets (line, MAX_LINE_LEN, fp))
+  FILE *fp = fopen (options->update_path, "r");
+  if (fp == NULL)
   {
-
-    word = strtok (line, " \n\r");
-    if (word_phraser (word, current, &word_to_read, &markov_chain, &prev) == 1)
+    printf ("Error: failed to open the file or path is invalid\n");
+    return 1;
+  }
+  LiveChain *live = live_chain_create (markov_chain, SAMPLER_ALIAS);
+  if (live == NULL)
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    fclose (fp);
+    return 1;
+  }
+  UpdateContext update = {{NULL, NULL, READ_WHOLE_FILE, false, NULL}, live,
+                          fp, 0};
+  pthread_t writer;
+  bool writing = pthread_create (&writer, NULL, update_chain, &update) == 0;
+  if (!writing)
+  {
+    // learn the whole text first if there is no thread to learn it with
+    update_chain (&update);
+  }
+  int generated = tweets_generator (NULL, live, number_of_tweets, seed,
+                                    options->threads);
+  if (writing)
+  {
+    pthread_join (writer, NULL);
+  }
+  live_chain_free (&live);
+  fclose (fp);
+  if (generated == 1 || update.fill.failed)
+  {
+    printf (ALLOCATION_ERROR_MASSAGE);
+    return 1;
+  }
+  return 0;
+}
+static void *update_chain (void *arg)
+{
+  UpdateContext *update = (UpdateContext *) arg;
+  update->fill.markov_chain = live_chain_begin_update (update->live);
+  if (read_corpus (update->fp, add_update_word, update) == 1)
+  {
+    update->fill.failed = true;
+  }
+  if (!live_chain_end_update (update->live))
+  {
+    update->fill.failed = true;
+  }
+  return NULL;
+}
+static bool add_update_word (const char *token, size_t length,
+                             void *context)
+{
+  UpdateContext *update = (UpdateContext *) context;
+  if (!add_word (token, length, &update->fill))
+  {
+    return false;
+  }
+  if (++update->words == WORDS_PER_PUBLICATION)
+  {
+    update->words = 0;
+    if (!live_chain_publish (update->live))
     {
-      return 1;
+      update->fill.failed = true;
+      return false;
     }
   }
-  return 0;
+  return true;
 }
-static int
-word_phraser (char *word, Node *current, int *word_to_read, MarkovChain
-**markov_chain, Node **prev)
+static int tweets_generator (const CompiledChain *compiled, LiveChain *live,
+                             int number_of_tweets, unsigned int seed,
+                             int threads)
 {
-  while ((word != NULL)
-         && ((*word_to_read) > 0 || (*word_to_read) == READ_WHOLE_FILE))
+  TweetsSlice *slices = malloc (threads * sizeof (TweetsSlice));
+  pthread_t *workers = malloc (threads * sizeof (pthread_t));
+  bool *started = malloc (threads * sizeof (bool));
+  if (slices == NULL || workers == NULL || started == NULL)
   {
-    current = add_to_database ((*markov_chain), word);
-
-    if (current == NULL)
+    free (slices);
+    free (workers);
+    free (started);
+    return 1;
+  }
+  ByteBuffer redrawn;
+  byte_buffer_init (&redrawn);
+  bool failed = false;
+  for (int t = 0; t < threads; t++)
+  {
+    byte_buffer_init (&slices[t].text);
+    memset (&slices[t].stats, 0, sizeof (MarkovStats));
+    slices[t].corpus_rejections = 0;
+    slices[t].emitted_rejections = 0;
+    slices[t].tweets = NULL;
+    if (dedupe != NULL)
     {
-//      free_database (markov_chain);
-      return 1;
+      // a slice has at most TWEETS_PER_BATCH / threads tweets, rounded up
+      slices[t].tweets = malloc (((TWEETS_PER_BATCH + threads - 1) / threads)
+                                 * sizeof (DedupeTweet));
+      failed = failed || slices[t].tweets == NULL;
     }
-    if (*prev)
+    slices[t].live = live;
+    slices[t].reader = (live != NULL) ? live_chain_register_reader (live) : 0;
+    failed = failed || slices[t].reader == -1;
+  }
+  for (int first = 1; first <= number_of_tweets && !failed;
+       first += TWEETS_PER_BATCH)
+  {
+    int batch = number_of_tweets - first + 1;
+    if (batch > TWEETS_PER_BATCH)
+    {
+      batch = TWEETS_PER_BATCH;
+    }
+    // slice t gets the tweets [batch * t / threads, batch * (t+1) / threads)
+    for (int t = 0; t < threads; t++)
     {
-      //assert((*prev)->data);
-      if (!(*markov_chain)->is_last ((*prev)->data->data))
+      int begin = (int) ((long long) batch * t / threads);
+      int end = (int) ((long long) batch * (t + 1) / threads);
+      slices[t].compiled = compiled;
+      slices[t].seed = seed;
+      slices[t].first_tweet = first + begin;
+      slices[t].count = end - begin;
+      slices[t].failed = false;
+      // the calling thread generates slice 0, and any slice whose thread
+      // could not be started
+      started[t] = t > 0 && pthread_create (&workers[t], NULL,
+                                            generate_slice, &slices[t]) == 0;
+    }
+    for (int t = 0; t < threads; t++)
+    {
+      if (!started[t])
       {
-        if (adding_prev ((*prev), current, (*markov_chain)) == 1)// try to
-          // add prev
-          // to freq list of current
-        {
-          return 1;
-        }
+        generate_slice (&slices[t]);
       }
     }
-    *prev = current;
-    word = strtok (NULL, " \n\r");
-    if ((*word_to_read) != -1)
+    for (int t = 1; t < threads; t++)
     {
-      (*word_to_read)--;
-
+      if (started[t])
+      {
+        pthread_join (workers[t], NULL);
+      }
+    }
+    // the slices follow each other, so writing them in order prints the
+    // tweets in order
+    for (int t = 0; t < threads; t++)
+    {
+      failed = failed || slices[t].failed;
+      if (slices[t].tweets != NULL && !failed)
+      {
+        failed = !print_deduped_slice (&slices[t], &redrawn);
+      }
+      else
+      {
+        byte_buffer_flush (&slices[t].text, stdout);
+      }
     }
   }
-  return 0;
+  for (int t = 0; t < threads; t++)
+  {
+    run_stats.first_node_draws += slices[t].stats.first_node_draws;
+    run_stats.next_node_draws += slices[t].stats.next_node_draws;
+    run_stats.walks += slices[t].stats.walks;
+    run_stats.walk_steps += slices[t].stats.walk_steps;
+    if (dedupe != NULL)
+    {
+      dedupe->corpus_rejections += slices[t].corpus_rejections;
+      dedupe->emitted_rejections += slices[t].emitted_rejections;
+    }
+    free (slices[t].tweets);
+    byte_buffer_free (&slices[t].text);
+    if (live != NULL && slices[t].reader != -1)
+    {
+      live_chain_unregister_reader (live, slices[t].reader);
+    }
+  }
+  byte_buffer_free (&redrawn);
+  free (slices);
+  free (workers);
+  free (started);
+  return failed ? 1 : 0;
+}
+static void *generate_slice (void *arg)
+{
+  TweetsSlice *slice = (TweetsSlice *) arg;
+  uint32_t states[MAX_LEN_TWEET];
+  int max_length = tweet_max_length ();
+  for (int i = 0; i < slice->count && !slice->failed; i++)
+  {
+    Rng rng;
+    int tweet_number = slice->first_tweet + i;
+    rng_seed_stream (&rng, slice->seed, (uint64_t) tweet_number);
+    const CompiledChain *compiled = slice->compiled;
+    if (slice->live != NULL)
+    {
+      compiled = live_chain_enter (slice->live, slice->reader);
+    }
+    int length = 0;
+    if (slice->tweets == NULL)
+    {
+      length = draw_walk (slice, compiled, max_length, &rng, states);
+    }
+    else
+    {
+      DedupeTweet *tweet = &slice->tweets[i];
+      tweet->rng = rng;
+      tweet->attempts = 0;
+      length = draw_deduped_walk (slice, compiled, max_length, states, tweet,
+                                  &slice->corpus_rejections,
+                                  &slice->emitted_rejections);
+    }
+    MARKOV_STAT (slice, walks, 1);
+    MARKOV_STAT (slice, walk_steps, (uint64_t) length);
+    slice->failed = !format_tweet (compiled, tweet_number, states, length,
+                                   &slice->text);
+    if (slice->tweets != NULL)
+    {
+      slice->tweets[i].end = slice->text.length;
+    }
+    if (slice->live != NULL)
+    {
+      live_chain_exit (slice->live, slice->reader);
+    }
+  }
+  return NULL;
+}
+static int tweet_max_length (void)
+{
+  // room for the words of the first state that come before its last word
+  int max_length = MAX_LEN_TWEET - (int) (chain_order - 1);
+  return (max_length < 1) ? 1 : max_length;
+}
+static bool format_tweet (const CompiledChain *compiled, int tweet_number,
+                          const uint32_t *states, int length,
+                          ByteBuffer *text)
+{
+  return byte_buffer_printf (text, "Tweet %d: ", tweet_number)
+         && (chain_order == 1 || length == 0
+             || format_gram_prefix (compiled->state_data[states[0]], text))
+         && format_compiled_walk (compiled, states, length, text)
+         && byte_buffer_append (text, "\n", 1);
+}
+static uint64_t hash_walk (const CompiledChain *compiled,
+                           const uint32_t *states, int length)
+{
+  uint64_t hash = DEDUPE_HASH_EMPTY;
+  for (int i = 0; i < length; i++)
+  {
+    const void *data = compiled->state_data[states[i]];
+    if (chain_order == 1)
+    {
+      const char *word = (const char *) data;
+      hash = dedupe_hash_word (hash, word, strlen (word));
+      continue;
+    }
+    // the first state brings all its words, the others their last word
+    const KGram *gram = (const KGram *) data;
+    for (uint32_t w = (i == 0) ? 0 : gram->order - 1; w < gram->order; w++)
+    {
+      const char *word = string_pool_get (word_pool, gram->ids[w]);
+      hash = dedupe_hash_word (hash, word, strlen (word));
+    }
+  }
+  return dedupe_hash_finish (hash);
+}
+static int draw_walk (TweetsSlice *slice, const CompiledChain *compiled,
+                      int max_length, Rng *rng, uint32_t *states)
+{
+  (void) slice;// used only by the stats
+  int length = compiled_walk (compiled, COMPILED_RANDOM_START, max_length,
+                              rng, states);
+  if (length > 0)
+  {
+    // a walk draws its first state, then every state after it
+    MARKOV_STAT (slice, first_node_draws, 1);
+    MARKOV_STAT (slice, next_node_draws, (uint64_t) length - 1);
+  }
+  return length;
+}
+static int draw_deduped_walk (TweetsSlice *slice,
+                              const CompiledChain *compiled, int max_length,
+                              uint32_t *states, DedupeTweet *tweet,
+                              uint64_t *corpus_rejections,
+                              uint64_t *emitted_rejections)
+{
+  int length = 0;
+  do
+  {
+    length = draw_walk (slice, compiled, max_length, &tweet->rng, states);
+    tweet->attempts++;
+    tweet->hash = hash_walk (compiled, states, length);
+    if (bloom_filter_contains (&dedupe->corpus, tweet->hash))
+    {
+      (*corpus_rejections)++;
+    }
+    else if (hash_set_contains (&dedupe->emitted, tweet->hash))
+    {
+      (*emitted_rejections)++;
+    }
+    else
+    {
+      break;
+    }
+  }
+  while (tweet->attempts < DEDUPE_MAX_ATTEMPTS);
+  return length;
+}
+static bool print_deduped_slice (TweetsSlice *slice, ByteBuffer *redrawn)
+{
+  uint32_t states[MAX_LEN_TWEET];
+  int max_length = tweet_max_length ();
+  size_t begin = 0;
+  bool printed = true;
+  for (int i = 0; i < slice->count && printed; i++)
+  {
+    DedupeTweet *tweet = &slice->tweets[i];
+    // the slices drew their tweets with the tweets of the earlier batches
+    // in emitted, a tweet may repeat one printed before it in this batch
+    if (hash_set_contains (&dedupe->emitted, tweet->hash)
+        && tweet->attempts < DEDUPE_MAX_ATTEMPTS)
+    {
+      dedupe->emitted_rejections++;
+      int length = draw_deduped_walk (slice, slice->compiled, max_length,
+                                      states, tweet,
+                                      &dedupe->corpus_rejections,
+                                      &dedupe->emitted_rejections);
+      printed = format_tweet (slice->compiled, slice->first_tweet + i,
+                              states, length, redrawn)
+                && byte_buffer_flush (redrawn, stdout);
+    }
+    else
+    {
+      size_t length = tweet->end - begin;
+      printed = fwrite (slice->text.bytes + begin, 1, length, stdout)
+                == length;
+    }
+    begin = tweet->end;
+    if (bloom_filter_contains (&dedupe->corpus, tweet->hash)
+        || hash_set_contains (&dedupe->emitted, tweet->hash))
+    {
+      dedupe->duplicates++;
+    }
+    if (!hash_set_insert (&dedupe->emitted, tweet->hash))
+    {
+      dedupe->forgotten++;
+    }
+  }
+  slice->text.length = 0;
+  return printed;
+}
+static bool create_dedupe (void)
+{
+  dedupe = calloc (1, sizeof (Dedupe));
+  if (dedupe == NULL)
+  {
+    return false;
+  }
+  dedupe->sentence_hash = DEDUPE_HASH_EMPTY;
+  return true;
+}
+static bool add_sentence_word (const char *word, size_t length)
+{
+  dedupe->sentence_hash = dedupe_hash_word (dedupe->sentence_hash, word,
+                                            length);
+  if (!is_last (word))
+  {
+    return true;
+  }
+  if (dedupe->num_sentences == dedupe->sentences_capacity)
+  {
+    size_t capacity = (dedupe->sentences_capacity == 0)
+                      ? DEDUPE_INITIAL_SENTENCES
+                      : dedupe->sentences_capacity * 2;
+    uint64_t *sentences = realloc (dedupe->sentences,
+                                   capacity * sizeof (uint64_t));
+    if (sentences == NULL)
+    {
+      return false;
+    }
+    dedupe->sentences = sentences;
+    dedupe->sentences_capacity = capacity;
+  }
+  dedupe->sentences[dedupe->num_sentences++] = dedupe_hash_finish
+      (dedupe->sentence_hash);
+  dedupe->sentence_hash = DEDUPE_HASH_EMPTY;
+  return true;
+}
+static bool start_dedupe (int number_of_tweets)
+{
+  // the filter is sized once the number of sentences is known, then the
+  // hashes are not needed anymore
+  if (!bloom_filter_init (&dedupe->corpus, dedupe->num_sentences))
+  {
+    return false;
+  }
+  for (size_t i = 0; i < dedupe->num_sentences; i++)
+  {
+    bloom_filter_add (&dedupe->corpus, dedupe->sentences[i]);
+  }
+  free (dedupe->sentences);
+  dedupe->sentences = NULL;
+  dedupe->sentences_capacity = 0;
+  size_t remembered = (number_of_tweets > DEDUPE_MAX_EMITTED)
+                      ? DEDUPE_MAX_EMITTED : (size_t) number_of_tweets;
+  return hash_set_init (&dedupe->emitted, remembered);
+}
+static void report_dedupe (void)
+{
+  if (dedupe == NULL)
+  {
+    return;
+  }
+  fflush (stdout);
+  fprintf (stderr, "text sentences       %12zu in a %zu byte filter "
+                   "(%.2f%% false positives)\n", dedupe->num_sentences,
+           (size_t) (dedupe->corpus.num_bits / 8),
+           100 * bloom_filter_false_positive_rate (&dedupe->corpus));
+  fprintf (stderr, "tweets remembered    %12zu in a %zu byte set (%llu "
+                   "forgotten)\n", dedupe->emitted.size,
+           dedupe->emitted.capacity * sizeof (uint64_t),
+           (unsigned long long) dedupe->forgotten);
+  fprintf (stderr, "walks drawn again    %12llu (%llu text sentences, %llu "
+                   "repeated tweets)\n",
+           (unsigned long long) (dedupe->corpus_rejections
+                                 + dedupe->emitted_rejections),
+           (unsigned long long) dedupe->corpus_rejections,
+           (unsigned long long) dedupe->emitted_rejections);
+  fprintf (stderr, "duplicates printed   %12llu\n",
+           (unsigned long long) dedupe->duplicates);
+}
+static void add_chain_stats (const MarkovChain *markov_chain,
+                             double train_seconds, double generate_seconds)
+{
+  // the walks are drawn from the compiled chain, so their counters were
+  // added to run_stats by the slices
+  MarkovStats walked = run_stats;
+  run_stats = markov_chain->stats;
+  run_stats.first_node_draws += walked.first_node_draws;
+  run_stats.next_node_draws += walked.next_node_draws;
+  run_stats.walks += walked.walks;
+  run_stats.walk_steps += walked.walk_steps;
+  run_stats.phase_seconds[MARKOV_PHASE_TRAIN] = train_seconds;
+  run_stats.phase_seconds[MARKOV_PHASE_GENERATE] = generate_seconds;
+}
+static void report_memory (const MarkovChain *markov_chain,
+                           const Options *options)
+{
+  if (!options->memory)
+  {
+    return;
+  }
+  MarkovMemory memory;
+  measure_markov_chain (markov_chain, &memory);
+  fflush (stdout);
+  print_markov_memory (&memory, stderr);
+  fprintf (stderr, "vocabulary           %12u words\n",
+           word_pool->size);
+}
+static bool report_analytics (const CompiledChain *compiled,
+                              const Options *options)
+{
+  if (!options->analytics)
+  {
+    return true;
+  }
+  uint32_t num_states = compiled->num_states;
+  MarkovMatrix matrix;
+  if (!build_compiled_matrix (compiled, &matrix))
+  {
+    return false;
+  }
+  double *rank = malloc (((size_t) num_states + 1) * sizeof (double));
+  double *entropy = malloc (((size_t) num_states + 1) * sizeof (double));
+  StationaryReport report;
+  double start = markov_stats_clock ();
+  // a walk restarts from the states a tweet starts from
+  bool ranked = rank != NULL && entropy != NULL
+                && stationary_distribution (&matrix, compiled->start_ids,
+                                            compiled->num_starts,
+                                            ANALYTICS_DAMPING,
+                                            options->threads, rank, &report);
+  double rate = -1;
+  if (ranked)
+  {
+    state_entropies (&matrix, entropy);
+    rate = entropy_rate (&matrix, rank, entropy, compiled->start_ids,
+                         compiled->num_starts);
+  }
+  double seconds = markov_stats_clock () - start;
+  uint32_t top[ANALYTICS_TOP_STATES];
+  ByteBuffer text;
+  byte_buffer_init (&text);
+  bool failed = rate < 0;
+  if (!failed)
+  {
+    uint32_t with_successors = 0;
+    double entropy_sum = 0;
+    for (uint32_t id = 0; id < num_states; id++)
+    {
+      if (matrix.row_offsets[id] < matrix.row_offsets[id + 1])
+      {
+        with_successors++;
+        entropy_sum += entropy[id];
+      }
+    }
+    failed = !byte_buffer_printf (&text, "stationary distribution: %d "
+                                         "iterations in %.3f ms, L1 change "
+                                         "%.3e (%s)\n"
+                                         "entropy rate: %.6f bits per word\n"
+                                         "mean successor entropy: %.6f bits "
+                                         "over %u states\n"
+                                         "rank  probability  entropy  "
+                                         "state\n",
+                                  report.iterations, seconds * 1000,
+                                  report.change,
+                                  report.converged ? "converged"
+                                                   : "not converged",
+                                  rate, with_successors > 0
+                                        ? entropy_sum / with_successors : 0,
+                                  with_successors);
+    uint32_t found = top_ranked_states (rank, num_states,
+                                        ANALYTICS_TOP_STATES, top);
+    for (uint32_t i = 0; i < found && !failed; i++)
+    {
+      const void *data = compiled->state_data[top[i]];
+      failed = !byte_buffer_printf (&text, "%4u  %11.9f  %7.4f  ", i + 1,
+                                    rank[top[i]], entropy[top[i]])
+               || (chain_order > 1 && !format_gram_prefix (data, &text))
+               || !compiled->format_func (data, &text)
+               || !byte_buffer_append (&text, "\n", 1);
+    }
+  }
+  if (!failed)
+  {
+    fflush (stdout);
+    byte_buffer_flush (&text, stderr);
+  }
+  byte_buffer_free (&text);
+  free (rank);
+  free (entropy);
+  free_markov_matrix (&matrix);
+  return !failed;
+}
+static int fill_database (FILE *fp, int word_to_read, MarkovChain
+*markov_chain)
+{
+  KGramWindow window = {0, 0, NULL};
+  if (chain_order > 1 && !kgram_window_init (&window, chain_order))
+  {
+    return 1;
+  }
+  FillContext fill = {markov_chain, NULL, word_to_read, false,
+                      (chain_order > 1) ? &window : NULL};
+  bool failed = read_corpus (fp, add_word, &fill) == 1 || fill.failed;
+  kgram_window_free (&window);
+  return failed ? 1 : 0;
+}
+static int fill_database_sharded (FILE *fp, int threads, MarkovChain
+*markov_chain)
+{
+  PartialChain *partials = malloc (threads * sizeof (PartialChain));
+  void **contexts = malloc (threads * sizeof (void *));
+  if (partials == NULL || contexts == NULL)
+  {
+    free (partials);
+    free (contexts);
+    return 1;
+  }
+  bool failed = false;
+  for (int i = 0; i < threads; i++)
+  {
+    failed = !partial_chain_init (&partials[i], is_last) || failed;
+    contexts[i] = &partials[i];
+  }
+  if (!failed)
+  {
+    failed = read_corpus_shards (fp, threads, partial_chain_add_word,
+                                 contexts) == 1;
+  }
+  for (int i = 0; i < threads; i++)
+  {
+    failed = failed || partials[i].failed;
+  }
+  if (!failed)
+  {
+    failed = !merge_partial_chains (markov_chain, partials, threads);
+  }
+  for (int i = 0; i < threads; i++)
+  {
+    partial_chain_free (&partials[i]);
+  }
+  free (partials);
+  free (contexts);
+  return failed ? 1 : 0;
+}
+static bool add_word (const char *token, size_t length, void *context)
+{
+  FillContext *fill = (FillContext *) context;
+  if (fill->word_to_read == 0)
+  {
+    return false;
+  }
+  // a word already in the vocabulary is found without copying it
+  uint32_t id = string_pool_intern (word_pool, token, length);
+  if (id == STRING_POOL_NO_ID)
+  {
+    fill->failed = true;
+    return false;
+  }
+  const char *word = string_pool_get (word_pool, id);
+  void *data = (char *) word;
+  if (fill->window != NULL)
+  {
+    // the state is the window of the last words of the sentence, it is
+    // looked up by its rolling hash and copied only if it is new
+    kgram_window_push (fill->window, id);
+    data = fill->window->gram;
+  }
+  Node *current = add_to_database (fill->markov_chain, data);
+  if (current == NULL)
+  {
+    fill->failed = true;
+    return false;
+  }
+  Node *prev = fill->prev;
+  if (prev == NULL || fill->markov_chain->is_last (prev->data->data))
+  {
+    // the first word of the text and every word after a last word open a
+    // sentence
+    if (!add_sentence_start (fill->markov_chain, current->data))
+    {
+      fill->failed = true;
+      return false;
+    }
+  }
+  else if (adding_prev (prev, current, fill->markov_chain) == 1)
+  {
+    fill->failed = true;
+    return false;
+  }
+  if (dedupe != NULL && !add_sentence_word (word, length))
+  {
+    fill->failed = true;
+    return false;
+  }
+  fill->prev = current;
+  if (fill->window != NULL && is_last (word))
+  {
+    // a state never spans two sentences
+    kgram_window_reset (fill->window);
+  }
+  if (fill->word_to_read != READ_WHOLE_FILE)
+  {
+    fill->word_to_read--;
+  }
+  return true;
 }
 static int adding_prev (Node *prev, Node *current, MarkovChain *markov_chain)
 {
@@ -235,7 +1543,8 @@ static int adding_prev (Node *prev, Node *current, MarkovChain *markov_chain)
   return 0;
 }
 static int database_with_parameters (char *words_from_cli, FILE *file_to_read,
-                                     MarkovChain *markov_chain)
+                                     MarkovChain *markov_chain,
+                                     int train_threads)
 {
   int words_to_read = 0;
   if (strcmp (words_from_cli, "-1") == 0)
@@ -247,6 +1556,12 @@ static int database_with_parameters (char *words_from_cli, FILE *file_to_read,
     words_to_read = (int) strtol (words_from_cli, NULL, INT_BASE);
   }
 
+  // the shards count single words, so order-k chains are read on one thread
+  if (words_to_read == READ_WHOLE_FILE && train_threads > 1
+      && chain_order == 1)
+  {
+    return fill_database_sharded (file_to_read, train_threads, markov_chain);
+  }
   if (fill_database (file_to_read, words_to_read,
                      markov_chain) == 1)
   {
@@ -258,7 +1573,7 @@ static int database_with_parameters (char *words_from_cli, FILE *file_to_read,
 //***************markov chain functions***************//
 static void free_func (void *pointer)
 {
-  free ((char *) pointer);
+  (void) pointer;
 }
 static bool is_last (const void *data)
 {
@@ -278,15 +1593,21 @@ static int comp_func (const void *data1, const void *data2)
 static void *copy_func (const void *source)
 {
   const char *str = (const char *) source;
-  int len = (int) strlen (str);
-  char *duplicate = malloc (sizeof (char) * (len + 1));
-
-  if (duplicate == NULL)
+  uint32_t id = string_pool_intern (word_pool, str, strlen (str));
+  if (id == STRING_POOL_NO_ID)
   {
     return NULL;
   }
-  strcpy (duplicate, str);
-  return (void *) duplicate;
+  return (void *) string_pool_get (word_pool, id);
+}
+static size_t size_func (const void *data)
+{
+  return strlen ((const char *) data) + 1;
+}
+static size_t hash_func (const void *data)
+{
+  const char *str = (const char *) data;
+  return string_pool_hash (str, strlen (str));
 }
 static void print_func (const void *data)
 {
@@ -297,3 +1618,63 @@ static void print_func (const void *data)
     printf (" ");
   }
 }
+static bool format_func (const void *data, ByteBuffer *text)
+{
+  const char *str = (const char *) data;
+  if (!byte_buffer_append_string (text, str))
+  {
+    return false;
+  }
+  return is_last (str) || byte_buffer_append (text, " ", 1);
+}
+static void gram_print_func (const void *data)
+{
+  const KGram *gram = (const KGram *) data;
+  print_func (string_pool_get (word_pool, gram->ids[gram->order - 1]));
+}
+static bool gram_format_func (const void *data, ByteBuffer *text)
+{
+  const KGram *gram = (const KGram *) data;
+  return format_func (string_pool_get (word_pool, gram->ids[gram->order - 1]),
+                      text);
+}
+static bool format_gram_prefix (const void *data, ByteBuffer *text)
+{
+  const KGram *gram = (const KGram *) data;
+  for (uint32_t i = 0; i + 1 < gram->order; i++)
+  {
+    if (!format_func (string_pool_get (word_pool, gram->ids[i]), text))
+    {
+      return false;
+    }
+  }
+  return true;
+}
+static size_t gram_size_func (const void *data)
+{
+  return kgram_size ((const KGram *) data);
+}
+static bool gram_is_last (const void *data)
+{
+  const KGram *gram = (const KGram *) data;
+  return is_last (string_pool_get (word_pool, gram->ids[gram->order - 1]));
+}
+static void *gram_copy_func (const void *source)
+{
+  return kgram_copy ((const KGram *) source, kgram_arena);
+}
+static void free_vocabulary (void)
+{
+  string_pool_free (word_pool);
+  word_pool = NULL;
+  arena_free (kgram_arena);
+  kgram_arena = NULL;
+  if (dedupe != NULL)
+  {
+    free (dedupe->sentences);
+    bloom_filter_free (&dedupe->corpus);
+    hash_set_free (&dedupe->emitted);
+    free (dedupe);
+    dedupe = NULL;
+  }
+}